@@ -0,0 +1,189 @@
+#include "detector_session.h"
+
+#include <algorithm>
+
+#ifdef WITH_VILIB
+#include "vilib/cuda_common.h"
+#include "vilib/preprocess/pyramid.h"
+#include "vilib/storage/pyramid_pool.h"
+#include "vilib/feature_detection/fast/fast_gpu.h"
+#endif
+
+namespace {
+
+ThresholdControlParams thresholdParams(const DetectorParams& params)
+{
+    ThresholdControlParams p;
+    p.cell_target = params.cell_target;
+    return p;
+}
+
+} // namespace
+
+DetectorSession::DetectorSession(DetectorBackend backend, const DetectorParams& params)
+    : backend_(backend)
+    , params_(params)
+    , rebuilds_(0)
+    , controller_(thresholdParams(params))
+#ifdef WITH_VILIB
+    , pool_init_(false)
+#endif
+{
+    CV_Assert(backend == DetectorBackend::CPU || hasGPU());
+}
+
+DetectorSession::~DetectorSession()
+{
+    release();
+}
+
+bool DetectorSession::hasGPU()
+{
+#ifdef WITH_VILIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+const char* DetectorSession::name(DetectorBackend backend)
+{
+    return backend == DetectorBackend::GPU ? "GPU" : "CPU";
+}
+
+void DetectorSession::release()
+{
+#ifdef WITH_VILIB
+    detector_gpu_.reset();
+    if (pool_init_) {
+        vilib::PyramidPool::deinit();
+        pool_init_ = false;
+    }
+#endif
+    detector_cpu_.reset();
+}
+
+void DetectorSession::rebuild(const cv::Size& size)
+{
+    release();
+    size_ = size;
+    ++rebuilds_;
+
+    if (backend_ == DetectorBackend::CPU) {
+        detector_cpu_.reset(new FastCPU(size.width,
+            size.height,
+            params_.cell_size_width,
+            params_.cell_size_height,
+            params_.min_level,
+            params_.max_level,
+            params_.horizontal_border,
+            params_.vertical_border,
+            params_.threshold,
+            params_.min_arc_length,
+            params_.score,
+            params_.per_level_grid));
+        controller_.reset(detector_cpu_->getPoints().size(), params_.threshold);
+        return;
+    }
+
+#ifdef WITH_VILIB
+    detector_gpu_.reset(new vilib::FASTGPU(size.width,
+        size.height,
+        params_.cell_size_width,
+        params_.cell_size_height,
+        params_.min_level,
+        params_.max_level,
+        params_.horizontal_border,
+        params_.vertical_border,
+        params_.threshold,
+        params_.min_arc_length,
+        params_.score));
+
+    // Initialize the pyramid pool, Frames below take their buffers from it
+    vilib::PyramidPool::init(1,
+        size.width,
+        size.height,
+        1, // grayscale
+        params_.pyramid_levels,
+        IMAGE_PYRAMID_MEMORY_TYPE);
+    pool_init_ = true;
+    controller_.reset(1, params_.threshold); //FASTGPU has a single, fixed threshold
+#endif
+}
+
+int DetectorSession::gridCols() const
+{
+    return (size_.width + params_.cell_size_width - 1) / params_.cell_size_width;
+}
+
+int DetectorSession::gridRows() const
+{
+    return (size_.height + params_.cell_size_height - 1) / params_.cell_size_height;
+}
+
+bool DetectorSession::inMask(const std::vector<uchar>& cell_mask, float x, float y) const
+{
+    if (cell_mask.empty())
+        return true;
+    const int cx{ std::min(gridCols() - 1, std::max(0, (int)x / params_.cell_size_width)) };
+    const int cy{ std::min(gridRows() - 1, std::max(0, (int)y / params_.cell_size_height)) };
+    return cell_mask[cy * gridCols() + cx] != 0;
+}
+
+void DetectorSession::detect(const cv::Mat& gray, KeypointBuffer& kps)
+{
+    detect(gray, kps, std::vector<uchar>());
+}
+
+void DetectorSession::detect(const cv::Mat& gray, KeypointBuffer& kps, const std::vector<uchar>& cell_mask)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    if (rebuilds_ == 0 || gray.size() != size_)
+        rebuild(gray.size());
+    CV_Assert(cell_mask.empty() || (int)cell_mask.size() == gridCols() * gridRows());
+
+    kps.clear(); //Capacity is kept
+    if (backend_ == DetectorBackend::CPU) {
+        detector_cpu_->reset();
+        detector_cpu_->setCellMask(cell_mask);
+        detector_cpu_->detect(pyramid_.build(gray, params_.pyramid_levels));
+
+        const std::vector<FastCorner>& grid = detector_cpu_->getPoints();
+        kps.reserve(grid.size());
+        for (size_t i{ 0 }; i < grid.size(); ++i)
+            if (grid[i].score_ > 0.0f && inMask(cell_mask, grid[i].x_, grid[i].y_))
+                kps.push_back(grid[i].x_, grid[i].y_, grid[i].score_, grid[i].level_);
+        const size_t found{ kps.size() };
+        if (params_.max_keypoints > 0)
+            kps.keepStrongest(params_.max_keypoints);
+
+        // Thresholds for the next frame, the budget term sees the count before the cap
+        if (params_.adaptive_threshold) {
+            controller_.update(detector_cpu_->cellCounts(), found, params_.max_keypoints, detector_cpu_->cellActive());
+            detector_cpu_->setCellThresholds(controller_.thresholds());
+        }
+        return;
+    }
+
+#ifdef WITH_VILIB
+    {
+        // Upload + pyramid into pooled buffers (returned to the pool when frame0 goes out of scope)
+        std::shared_ptr<vilib::Frame> frame0(new vilib::Frame(gray, 0, params_.pyramid_levels));
+        // Reset detector's grid
+        detector_gpu_->reset();
+        detector_gpu_->detect(frame0->pyramid_);
+    }
+
+    auto& points_gpu = detector_gpu_->getPoints();
+    kps.reserve(points_gpu.size());
+    for (auto it = points_gpu.begin(); it != points_gpu.end(); ++it) {
+        if (it->x_ == 0.0 && it->y_ == 0.0) //Empty cell
+            continue;
+        if (!inMask(cell_mask, (float)it->x_, (float)it->y_)) //FASTGPU searches the whole frame
+            continue;
+        kps.push_back((float)it->x_, (float)it->y_, (float)it->score_, (int)it->level_);
+    }
+    if (params_.max_keypoints > 0)
+        kps.keepStrongest(params_.max_keypoints);
+#endif
+}
@@ -0,0 +1,92 @@
+/*
+ * detector_session.h
+ * Long-lived FAST detector session (GPU: vilib FASTGPU, CPU: FastCPU)
+ *
+ * Detector state, pyramid buffers & grid are allocated once per resolution
+ * & only rebuilt when the frame size changes, so each detect() call is just
+ * upload (GPU) + detection.
+ * Remark: vilib's PyramidPool is global, keep a single GPU session alive.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef DETECTOR_SESSION_H
+#define DETECTOR_SESSION_H
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "fast_cpu.h"
+#include "keypoints.h"
+#include "pyramid_cpu.h"
+#include "threshold_controller.h"
+
+#ifdef WITH_VILIB
+namespace vilib {
+class DetectorBaseGPU;
+}
+#endif
+
+enum class DetectorBackend { GPU, CPU };
+
+struct DetectorParams {
+    int pyramid_levels;
+    int min_level, max_level; //Levels [min_level, max_level) are searched
+    float threshold; //FAST epsilon
+    int min_arc_length;
+    vilib::fast_score score;
+    int horizontal_border, vertical_border;
+    int cell_size_width, cell_size_height;
+    bool per_level_grid; //CPU only: 1 grid per level instead of a shared level 0 grid
+    bool adaptive_threshold; //CPU only: per cell threshold, see FastThresholdController
+    float cell_target; //Corners wanted per cell when adaptive
+    int max_keypoints; //Overall budget, the strongest are kept (0: unbounded)
+};
+
+class DetectorSession {
+public:
+    DetectorSession(DetectorBackend backend, const DetectorParams& params);
+    ~DetectorSession();
+
+    // Detect on a grayscale frame, kps is refilled with the occupied grid cells
+    // (at most 1 per cell, in cell order, at most max_keypoints), in level 0 coordinates
+    void detect(const cv::Mat& gray, KeypointBuffer& kps);
+    // Same, only keeping corners in the cells set in cell_mask (gridCols() x gridRows()
+    // level 0 cells, row major, empty: all). The CPU backend skips the other cells.
+    void detect(const cv::Mat& gray, KeypointBuffer& kps, const std::vector<uchar>& cell_mask);
+
+    DetectorBackend backend() const { return backend_; }
+    const DetectorParams& params() const { return params_; }
+    int rebuilds() const { return rebuilds_; } //Times the state was (re)allocated
+    // Level 0 grid of the current frame size
+    int gridCols() const;
+    int gridRows() const;
+    // Thresholds for the next frame (constant unless adaptive)
+    const ThresholdStats& thresholdStats() const { return controller_.stats(); }
+    const std::vector<float>& cellThresholds() const { return controller_.thresholds(); }
+
+    static bool hasGPU();
+    static const char* name(DetectorBackend backend);
+
+private:
+    void rebuild(const cv::Size& size);
+    void release();
+    bool inMask(const std::vector<uchar>& cell_mask, float x, float y) const;
+
+    DetectorBackend backend_;
+    DetectorParams params_;
+    cv::Size size_;
+    int rebuilds_;
+
+#ifdef WITH_VILIB
+    std::shared_ptr<vilib::DetectorBaseGPU> detector_gpu_;
+    bool pool_init_;
+#endif
+    std::unique_ptr<FastCPU> detector_cpu_;
+    HalfSamplePyramid pyramid_; //CPU pyramid, level 0 is a header of the input
+    FastThresholdController controller_;
+};
+
+#endif
@@ -0,0 +1,454 @@
+#include "fast_cpu.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FAST_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FAST_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FAST_SIMD_NEON
+#endif
+
+namespace {
+
+// Bresenham circle of radius 3, clockwise from 12 o'clock
+const int circle_x[16] = { 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3, -3, -3, -2, -1 };
+const int circle_y[16] = { -3, -3, -2, -1, 0, 1, 2, 3, 3, 3, 2, 1, 0, -1, -2, -3 };
+
+// === VECTOR PRIMITIVES ===
+// Pixels are compared as signed bytes on x86 (flipped by 0x80), so a single
+// cmpgt gives the lane mask. Arc counters never exceed 31, so they compare
+// the same way signed or unsigned.
+
+#if defined(FAST_SIMD_AVX2)
+typedef __m256i vu8;
+const int VL{ 32 };
+inline vu8 vload(const uchar* p) { return _mm256_loadu_si256((const __m256i*)p); }
+inline void vstore(uchar* p, vu8 a) { _mm256_storeu_si256((__m256i*)p, a); }
+inline vu8 vset1(int v) { return _mm256_set1_epi8((char)v); }
+inline vu8 vzero() { return _mm256_setzero_si256(); }
+inline vu8 vflip(vu8 a) { return _mm256_xor_si256(a, _mm256_set1_epi8((char)0x80)); }
+inline vu8 vgt(vu8 a, vu8 b) { return _mm256_cmpgt_epi8(a, b); }
+inline vu8 vand(vu8 a, vu8 b) { return _mm256_and_si256(a, b); }
+inline vu8 vor(vu8 a, vu8 b) { return _mm256_or_si256(a, b); }
+inline vu8 vadds(vu8 a, vu8 b) { return _mm256_adds_epu8(a, b); }
+inline vu8 vsubs(vu8 a, vu8 b) { return _mm256_subs_epu8(a, b); }
+inline vu8 vinc(vu8 a) { return _mm256_sub_epi8(a, _mm256_set1_epi8(-1)); }
+inline vu8 vmax(vu8 a, vu8 b) { return _mm256_max_epu8(a, b); }
+inline bool vany(vu8 a) { return _mm256_movemask_epi8(a) != 0; }
+#elif defined(FAST_SIMD_SSE2)
+typedef __m128i vu8;
+const int VL{ 16 };
+inline vu8 vload(const uchar* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline void vstore(uchar* p, vu8 a) { _mm_storeu_si128((__m128i*)p, a); }
+inline vu8 vset1(int v) { return _mm_set1_epi8((char)v); }
+inline vu8 vzero() { return _mm_setzero_si128(); }
+inline vu8 vflip(vu8 a) { return _mm_xor_si128(a, _mm_set1_epi8((char)0x80)); }
+inline vu8 vgt(vu8 a, vu8 b) { return _mm_cmpgt_epi8(a, b); }
+inline vu8 vand(vu8 a, vu8 b) { return _mm_and_si128(a, b); }
+inline vu8 vor(vu8 a, vu8 b) { return _mm_or_si128(a, b); }
+inline vu8 vadds(vu8 a, vu8 b) { return _mm_adds_epu8(a, b); }
+inline vu8 vsubs(vu8 a, vu8 b) { return _mm_subs_epu8(a, b); }
+inline vu8 vinc(vu8 a) { return _mm_sub_epi8(a, _mm_set1_epi8(-1)); }
+inline vu8 vmax(vu8 a, vu8 b) { return _mm_max_epu8(a, b); }
+inline bool vany(vu8 a) { return _mm_movemask_epi8(a) != 0; }
+#elif defined(FAST_SIMD_NEON)
+typedef uint8x16_t vu8;
+const int VL{ 16 };
+inline vu8 vload(const uchar* p) { return vld1q_u8(p); }
+inline void vstore(uchar* p, vu8 a) { vst1q_u8(p, a); }
+inline vu8 vset1(int v) { return vdupq_n_u8((uint8_t)v); }
+inline vu8 vzero() { return vdupq_n_u8(0); }
+inline vu8 vflip(vu8 a) { return a; } //Unsigned compare available
+inline vu8 vgt(vu8 a, vu8 b) { return vcgtq_u8(a, b); }
+inline vu8 vand(vu8 a, vu8 b) { return vandq_u8(a, b); }
+inline vu8 vor(vu8 a, vu8 b) { return vorrq_u8(a, b); }
+inline vu8 vadds(vu8 a, vu8 b) { return vqaddq_u8(a, b); }
+inline vu8 vsubs(vu8 a, vu8 b) { return vqsubq_u8(a, b); }
+inline vu8 vinc(vu8 a) { return vaddq_u8(a, vdupq_n_u8(1)); }
+inline vu8 vmax(vu8 a, vu8 b) { return vmaxq_u8(a, b); }
+#if defined(__aarch64__)
+inline bool vany(vu8 a) { return vmaxvq_u8(a) != 0; }
+#else
+inline bool vany(vu8 a)
+{
+    uint8x8_t m = vorr_u8(vget_low_u8(a), vget_high_u8(a));
+    return vget_lane_u64(vreinterpret_u64_u8(m), 0) != 0;
+}
+#endif
+#endif
+
+// === SCALAR ===
+
+// Longest circular run of set bits in a 16 bit mask
+inline int longestArc(unsigned mask, int& start)
+{
+    int best{ 0 }, run{ 0 };
+    start = 0;
+    if (mask == 0xFFFF)
+        return 16;
+    for (int i{ 0 }; i < 32; ++i) {
+        if (mask & (1u << (i & 15))) {
+            if (++run > best) {
+                best = run;
+                start = i - run + 1;
+            }
+        }
+        else
+            run = 0;
+    }
+    start &= 15;
+    return std::min(best, 16);
+}
+
+// Bright / dark masks of the circle for threshold t
+inline void circleMasks(const uchar* p, const long* off, int t, unsigned& bright, unsigned& dark)
+{
+    const int c{ p[0] };
+    bright = dark = 0;
+    for (int k{ 0 }; k < 16; ++k) {
+        const int v{ p[off[k]] };
+        bright |= (unsigned)(v > c + t) << k;
+        dark |= (unsigned)(v < c - t) << k;
+    }
+}
+
+inline bool segmentTest(const uchar* p, const long* off, int t, int n)
+{
+    unsigned bright, dark;
+    int s;
+    circleMasks(p, off, t, bright, dark);
+    return longestArc(bright, s) >= n || longestArc(dark, s) >= n;
+}
+
+// Sum of (|I_p - I_c| - t) over the pixels of the longest arc
+inline float arcScore(const uchar* p, const long* off, int t, int n)
+{
+    unsigned bright, dark;
+    int sb, sd;
+    circleMasks(p, off, t, bright, dark);
+    const int lb{ longestArc(bright, sb) }, ld{ longestArc(dark, sd) };
+    float score{ 0.0f };
+    if (lb >= n) {
+        float s{ 0.0f };
+        for (int i{ 0 }; i < lb; ++i)
+            s += std::abs(p[off[(sb + i) & 15]] - p[0]) - t;
+        score = s;
+    }
+    if (ld >= n) {
+        float s{ 0.0f };
+        for (int i{ 0 }; i < ld; ++i)
+            s += std::abs(p[off[(sd + i) & 15]] - p[0]) - t;
+        score = std::max(score, s);
+    }
+    return score;
+}
+
+// Largest threshold the pixel still passes the segment test with
+inline float maxThresholdScore(const uchar* p, const long* off, int t, int n)
+{
+    int lo{ t }, hi{ 255 };
+    while (lo < hi) {
+        const int mid{ (lo + hi + 1) / 2 };
+        if (segmentTest(p, off, mid, n))
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return (float)std::max(lo, 1);
+}
+
+// v > c + eps on integer pixels
+inline int pixelThreshold(float eps)
+{
+    return std::max(0, std::min(255, (int)eps));
+}
+
+// === SEGMENT TEST ===
+
+// Appends the x of every pixel in [x0, x1) of the row passing the segment test
+void segmentTestRow(const uchar* row, const long* off, int x0, int x1, int t, int n, std::vector<int>& xs)
+{
+    int x{ x0 };
+#if defined(FAST_SIMD_AVX2) || defined(FAST_SIMD_SSE2) || defined(FAST_SIMD_NEON)
+    const vu8 vt{ vset1(t) }, vn{ vset1(n - 1) };
+    const bool quick{ n >= 8 }; //An arc of >= 8 covers 2 adjacent compass points
+    alignas(32) uchar lanes[32];
+    for (; x + VL <= x1; x += VL) {
+        const uchar* p = row + x;
+        const vu8 c{ vload(p) };
+        const vu8 hi{ vflip(vadds(c, vt)) }, lo{ vflip(vsubs(c, vt)) };
+        vu8 b[16], d[16];
+        for (int k{ 0 }; k < 16; k += 4) {
+            const vu8 v{ vflip(vload(p + off[k])) };
+            b[k] = vgt(v, hi);
+            d[k] = vgt(lo, v);
+        }
+        if (quick) {
+            vu8 q{ vor(vand(b[0], b[4]), vand(b[4], b[8])) };
+            q = vor(q, vor(vand(b[8], b[12]), vand(b[12], b[0])));
+            q = vor(q, vor(vand(d[0], d[4]), vand(d[4], d[8])));
+            q = vor(q, vor(vand(d[8], d[12]), vand(d[12], d[0])));
+            if (!vany(q))
+                continue;
+        }
+        for (int k{ 1 }; k < 16; ++k) {
+            if ((k & 3) == 0)
+                continue;
+            const vu8 v{ vflip(vload(p + off[k])) };
+            b[k] = vgt(v, hi);
+            d[k] = vgt(lo, v);
+        }
+        // Running length of the bright/dark arc, wrapping around the circle
+        vu8 cb{ vzero() }, cd{ vzero() }, mb{ vzero() }, md{ vzero() };
+        for (int i{ 0 }; i < 16 + n - 1; ++i) {
+            cb = vand(vinc(cb), b[i & 15]);
+            cd = vand(vinc(cd), d[i & 15]);
+            mb = vmax(mb, cb);
+            md = vmax(md, cd);
+        }
+        const vu8 pass{ vor(vgt(mb, vn), vgt(md, vn)) };
+        if (!vany(pass))
+            continue;
+        vstore(lanes, pass);
+        for (int j{ 0 }; j < VL; ++j)
+            if (lanes[j])
+                xs.push_back(x + j);
+    }
+#endif
+    for (; x < x1; ++x)
+        if (segmentTest(row + x, off, t, n))
+            xs.push_back(x);
+}
+
+} // namespace
+
+// === DETECTOR ===
+
+FastCPU::FastCPU(int image_width, int image_height,
+    int cell_size_width, int cell_size_height,
+    int min_level, int max_level,
+    int horizontal_border, int vertical_border,
+    float threshold, int min_arc_length, vilib::fast_score score,
+    bool per_level_grid)
+    : image_width_(image_width)
+    , image_height_(image_height)
+    , cell_size_width_(cell_size_width)
+    , cell_size_height_(cell_size_height)
+    , min_level_(min_level)
+    , max_level_(max_level)
+    , horizontal_border_(horizontal_border)
+    , vertical_border_(vertical_border)
+    , threshold_(threshold)
+    , min_arc_length_(min_arc_length)
+    , score_(score)
+    , per_level_grid_(per_level_grid)
+    , span_row_(-1)
+{
+    CV_Assert(min_arc_length >= 1 && min_arc_length <= 16);
+    CV_Assert(min_level >= 0 && max_level > min_level);
+    grid_cols_ = (image_width + cell_size_width - 1) / cell_size_width;
+    grid_rows_ = (image_height + cell_size_height - 1) / cell_size_height;
+
+    // Cell layout per level, levels are (w >> l, h >> l) as built by HalfSamplePyramid
+    level_offset_.assign(max_level, 0);
+    level_cols_.assign(max_level, grid_cols_);
+    level_rows_.assign(max_level, grid_rows_);
+    int cells{ per_level_grid ? 0 : grid_cols_ * grid_rows_ };
+    if (per_level_grid) {
+        for (int l{ min_level }; l < max_level; ++l) {
+            level_offset_[l] = cells;
+            level_cols_[l] = ((image_width >> l) + cell_size_width - 1) / cell_size_width;
+            level_rows_[l] = ((image_height >> l) + cell_size_height - 1) / cell_size_height;
+            cells += level_cols_[l] * level_rows_[l];
+        }
+    }
+    points_.resize(cells);
+    cell_count_.resize(cells);
+    score_map_.resize(max_level);
+    setThreshold(threshold);
+    reset();
+}
+
+void FastCPU::setThreshold(float threshold)
+{
+    threshold_ = threshold;
+    cell_threshold_.assign(points_.size(), threshold);
+    cell_t_.assign(points_.size(), pixelThreshold(threshold));
+}
+
+void FastCPU::setCellThresholds(const std::vector<float>& thresholds)
+{
+    CV_Assert(thresholds.size() == points_.size());
+    cell_threshold_ = thresholds;
+    for (size_t i{ 0 }; i < thresholds.size(); ++i)
+        cell_t_[i] = pixelThreshold(thresholds[i]);
+}
+
+const char* FastCPU::simd()
+{
+#if defined(FAST_SIMD_AVX2)
+    return "AVX2";
+#elif defined(FAST_SIMD_SSE2)
+    return "SSE2";
+#elif defined(FAST_SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+void FastCPU::reset()
+{
+    FastCorner empty = { 0.0f, 0.0f, 0.0f, 0 };
+    std::fill(points_.begin(), points_.end(), empty);
+    std::fill(cell_count_.begin(), cell_count_.end(), 0);
+}
+
+void FastCPU::detect(const std::vector<cv::Mat>& pyramid)
+{
+    CV_Assert(!pyramid.empty() && pyramid[0].cols == image_width_ && pyramid[0].rows == image_height_);
+    for (int l{ min_level_ }; l < max_level_ && l < (int)pyramid.size(); ++l)
+        detectLevel(pyramid[l], l);
+}
+
+int FastCPU::level0Cell(int x, int y, int level) const
+{
+    const int c{ level ? (1 << (level - 1)) - 1 : 0 }; //Pixel centre in level 0, rounded down
+    return (((y << level) + c) / cell_size_height_) * grid_cols_ + ((x << level) + c) / cell_size_width_;
+}
+
+int FastCPU::cellIndex(int x, int y, int level) const
+{
+    if (per_level_grid_)
+        return level_offset_[level] + (y / cell_size_height_) * level_cols_[level] + x / cell_size_width_;
+    return level0Cell(x, y, level);
+}
+
+void FastCPU::setCellMask(const std::vector<uchar>& mask)
+{
+    CV_Assert(mask.empty() || (int)mask.size() == grid_cols_ * grid_rows_);
+    cell_mask_ = mask;
+    cell_active_.clear();
+    if (mask.empty())
+        return;
+    if (!per_level_grid_) {
+        cell_active_ = mask;
+        return;
+    }
+    // Per level cells follow the level 0 cell under their centre
+    cell_active_.resize(points_.size());
+    for (int l{ min_level_ }; l < max_level_; ++l) {
+        const int w{ image_width_ >> l }, h{ image_height_ >> l };
+        for (int cy{ 0 }; cy < level_rows_[l]; ++cy)
+            for (int cx{ 0 }; cx < level_cols_[l]; ++cx) {
+                const int x{ std::min(w - 1, cx * cell_size_width_ + cell_size_width_ / 2) };
+                const int y{ std::min(h - 1, cy * cell_size_height_ + cell_size_height_ / 2) };
+                cell_active_[level_offset_[l] + cy * level_cols_[l] + cx] = mask[level0Cell(x, y, l)];
+            }
+    }
+}
+
+void FastCPU::maskedSpans(int row0, int level, int x0, int x1)
+{
+    // Level pixels [start(c), start(c + 1)) fall in level 0 column c
+    const int s{ 1 << level }, c{ level ? (1 << (level - 1)) - 1 : 0 };
+    spans_.clear();
+    for (int col{ 0 }; col < grid_cols_; ++col) {
+        if (!cell_mask_[row0 * grid_cols_ + col])
+            continue;
+        const int a{ std::max(x0, col == 0 ? 0 : (col * cell_size_width_ - c + s - 1) / s) };
+        const int b{ std::min(x1, ((col + 1) * cell_size_width_ - c + s - 1) / s) };
+        if (a >= b)
+            continue;
+        if (!spans_.empty() && spans_.back().second == a)
+            spans_.back().second = b; //Merge with the previous column
+        else
+            spans_.push_back(std::make_pair(a, b));
+    }
+}
+
+void FastCPU::detectLevel(const cv::Mat& img, int level)
+{
+    CV_Assert(img.type() == CV_8UC1);
+    CV_Assert(!per_level_grid_ || (img.cols <= level_cols_[level] * cell_size_width_ && img.rows <= level_rows_[level] * cell_size_height_));
+    const int n{ min_arc_length_ };
+    const int bx{ std::max(3, horizontal_border_ >> level) };
+    const int by{ std::max(3, vertical_border_ >> level) };
+    const int cols{ per_level_grid_ ? level_cols_[level] : grid_cols_ };
+
+    long off[16];
+    for (int k{ 0 }; k < 16; ++k)
+        off[k] = circle_y[k] * (long)img.step + circle_x[k];
+
+    cv::Mat& smap = score_map_[level];
+    if (smap.size() != img.size())
+        smap = cv::Mat::zeros(img.size(), CV_32F);
+
+    // Segment test + score. The row is tested with the lowest threshold of its
+    // cells, candidates in cells with a higher one are re-tested with it
+    candidates_.clear();
+    span_row_ = -1;
+    for (int y{ by }; y < img.rows - by; ++y) {
+        const uchar* row = img.ptr<uchar>(y);
+        float* srow = smap.ptr<float>(y);
+        const int* row_t = &cell_t_[cellIndex(0, y, level)]; //Cells of this row
+        const int t_row{ *std::min_element(row_t, row_t + cols) };
+        row_xs_.clear();
+        if (cell_mask_.empty())
+            segmentTestRow(row, off, bx, img.cols - bx, t_row, n, row_xs_);
+        else {
+            // Only the spans of active level 0 cells, rebuilt when the cell row changes
+            const int row0{ level0Cell(0, y, level) / grid_cols_ };
+            if (row0 != span_row_) {
+                maskedSpans(row0, level, bx, img.cols - bx);
+                span_row_ = row0;
+            }
+            for (size_t k{ 0 }; k < spans_.size(); ++k)
+                segmentTestRow(row, off, spans_[k].first, spans_[k].second, t_row, n, row_xs_);
+        }
+        for (size_t i{ 0 }; i < row_xs_.size(); ++i) {
+            const int x{ row_xs_[i] };
+            const int t{ cell_t_[cellIndex(x, y, level)] };
+            if (t > t_row && !segmentTest(row + x, off, t, n))
+                continue;
+            srow[x] = score_ == vilib::MAX_THRESHOLD ? maxThresholdScore(row + x, off, t, n)
+                                                    : arcScore(row + x, off, t, n);
+            candidates_.push_back(cv::Point(x, y));
+        }
+    }
+
+    // 3x3 NMS, then keep the best per cell. Ties go to the first pixel in raster order: a pixel is suppressed by an
+    // equal neighbour before it (<=) but not by one after it (<), and the cell keeps its first best score
+    const float scale{ (float)(1 << level) };
+    for (size_t i{ 0 }; i < candidates_.size(); ++i) {
+        const cv::Point& pt = candidates_[i];
+        const float s{ smap.at<float>(pt) };
+        const float* r0 = smap.ptr<float>(pt.y - 1) + pt.x;
+        const float* r1 = smap.ptr<float>(pt.y) + pt.x;
+        const float* r2 = smap.ptr<float>(pt.y + 1) + pt.x;
+        if (s <= r0[-1] || s <= r0[0] || s <= r0[1] || s <= r1[-1]
+            || s < r1[1] || s < r2[-1] || s < r2[0] || s < r2[1])
+            continue;
+
+        const int idx{ cellIndex(pt.x, pt.y, level) };
+        ++cell_count_[idx];
+        FastCorner& cell = points_[idx];
+        if (s > cell.score_) {
+            // Centre of the level pixel in level 0 (each level pixel averages 2^l x 2^l pixels)
+            cell.x_ = (pt.x + 0.5f) * scale - 0.5f;
+            cell.y_ = (pt.y + 0.5f) * scale - 0.5f;
+            cell.score_ = s;
+            cell.level_ = level;
+        }
+    }
+
+    // Leave the score map zeroed for the next frame
+    for (size_t i{ 0 }; i < candidates_.size(); ++i)
+        smap.at<float>(candidates_[i]) = 0.0f;
+}
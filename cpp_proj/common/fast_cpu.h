@@ -0,0 +1,120 @@
+/*
+ * fast_cpu.h
+ * CPU FAST corner detector, mirrors vilib's FASTGPU
+ *
+ * Same parameters as FASTGPU (epsilon, min arc length, score, cell grid NMS)
+ * & same output layout: getPoints() holds 1 point per grid cell (the best
+ * one over all levels, in level 0 coordinates), empty cells are all zero.
+ * With per_level_grid each level gets its own grid instead (cells of the
+ * same size in that level's pixels, stored level after level), so coarse
+ * levels have their own cell budget rather than competing with level 0.
+ * The threshold can be set per cell (see FastThresholdController), cellCounts()
+ * reports how many corners survived NMS in each cell. setCellMask() limits
+ * the search to some level 0 cells (e.g. the ones short of tracks).
+ * The segment test is vectorized with AVX2 / SSE2 / NEON, picked at compile
+ * time; a scalar fallback is used otherwise.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef FAST_CPU_H
+#define FAST_CPU_H
+
+#include <opencv2/core.hpp>
+
+#include <utility>
+#include <vector>
+
+#ifdef WITH_VILIB
+#include "vilib/feature_detection/fast/fast_common.h"
+#else
+namespace vilib {
+// Same as vilib's fast_score, so FAST_SCORE also resolves without vilib
+enum fast_score : unsigned char {
+    SUM_OF_ABS_DIFF_ALL = 0,
+    SUM_OF_ABS_DIFF_ON_ARC,
+    MAX_THRESHOLD
+};
+}
+#endif
+
+// Detected corner, same field names as vilib's FeaturePoint
+struct FastCorner {
+    float x_, y_; //Level 0 coordinates (pixel centre of the level pixel)
+    float score_; //0: empty cell
+    int level_;
+};
+
+class FastCPU {
+public:
+    FastCPU(int image_width, int image_height,
+        int cell_size_width, int cell_size_height,
+        int min_level, int max_level, //Levels [min_level, max_level) are searched
+        int horizontal_border, int vertical_border,
+        float threshold, int min_arc_length, vilib::fast_score score,
+        bool per_level_grid = false);
+
+    // Clear the grid & the cell counts
+    void reset();
+    // Same threshold for every cell
+    void setThreshold(float threshold);
+    // 1 threshold per cell, in getPoints() order
+    void setCellThresholds(const std::vector<float>& thresholds);
+    const std::vector<float>& cellThresholds() const { return cell_threshold_; }
+    float threshold() const { return threshold_; } //Initial threshold
+    // Only search the level 0 cells set in mask (gridCols() x gridRows(), row major), empty: all
+    void setCellMask(const std::vector<uchar>& mask);
+    // Mask in getPoints() order, empty when there is no mask
+    const std::vector<uchar>& cellActive() const { return cell_active_; }
+    // Detect on the pyramid (level 0 first), results are merged into the grid
+    void detect(const std::vector<cv::Mat>& pyramid);
+
+    const std::vector<FastCorner>& getPoints() const { return points_; }
+    // Corners found in each cell by the last detect() (after NMS, before keeping the best)
+    const std::vector<int>& cellCounts() const { return cell_count_; }
+    int gridCols() const { return grid_cols_; } //Level 0 grid
+    int gridRows() const { return grid_rows_; }
+    bool perLevelGrid() const { return per_level_grid_; }
+    // First cell of a level in getPoints() & its number of cells (all levels share the level 0 grid otherwise)
+    int levelOffset(int level) const { return level_offset_[level]; }
+    int levelCells(int level) const { return level_cols_[level] * level_rows_[level]; }
+    int width() const { return image_width_; }
+    int height() const { return image_height_; }
+
+    // Instruction set used by the segment test
+    static const char* simd();
+
+private:
+    void detectLevel(const cv::Mat& img, int level);
+    // Cell of a level pixel, in getPoints() & in the level 0 grid
+    int cellIndex(int x, int y, int level) const;
+    int level0Cell(int x, int y, int level) const;
+    // Level pixel spans in [x0, x1) of the active cells of a level 0 cell row
+    void maskedSpans(int row0, int level, int x0, int x1);
+
+    int image_width_, image_height_;
+    int cell_size_width_, cell_size_height_;
+    int min_level_, max_level_;
+    int horizontal_border_, vertical_border_;
+    float threshold_;
+    int min_arc_length_;
+    vilib::fast_score score_;
+
+    int grid_cols_, grid_rows_;
+    bool per_level_grid_;
+    std::vector<int> level_offset_, level_cols_, level_rows_;
+    std::vector<FastCorner> points_;
+    std::vector<int> cell_count_;
+    std::vector<float> cell_threshold_;
+    std::vector<int> cell_t_; //cell_threshold_ as integer pixel thresholds
+    std::vector<uchar> cell_mask_, cell_active_;
+
+    // Reused across frames
+    std::vector<cv::Mat> score_map_; //Per level, CV_32F, kept all zero between calls
+    std::vector<cv::Point> candidates_;
+    std::vector<int> row_xs_;
+    std::vector<std::pair<int, int> > spans_;
+    int span_row_;
+};
+
+#endif
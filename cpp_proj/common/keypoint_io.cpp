@@ -0,0 +1,138 @@
+#include "keypoint_io.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const char magic[4] = { 'K', 'P', 'S', '1' };
+
+// JSON string body, only quotes, backslashes & control characters need escaping
+std::string jsonEscape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i{ 0 }; i < s.size(); ++i) {
+        const char c{ s[i] };
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else
+            out += c;
+    }
+    return out;
+}
+
+// The file is little endian, host arrays are swapped on big endian hosts
+bool bigEndian()
+{
+    const uint32_t one{ 1 };
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 0;
+}
+
+void swap32(void* data, size_t n)
+{
+    unsigned char* p = (unsigned char*)data;
+    for (size_t i{ 0 }; i < n; ++i, p += 4) {
+        std::swap(p[0], p[3]);
+        std::swap(p[1], p[2]);
+    }
+}
+
+// n 32 bit values
+bool write32(const void* data, size_t n, FILE* f)
+{
+    if (!bigEndian())
+        return fwrite(data, 4, n, f) == n;
+    std::vector<unsigned char> tmp((const unsigned char*)data, (const unsigned char*)data + 4 * n);
+    swap32(tmp.data(), n);
+    return fwrite(tmp.data(), 4, n, f) == n;
+}
+
+bool read32(void* data, size_t n, FILE* f)
+{
+    if (fread(data, 4, n, f) != n)
+        return false;
+    if (bigEndian())
+        swap32(data, n);
+    return true;
+}
+
+} // namespace
+
+bool writeKeypointsBinary(const std::string& path, const KeypointView& kps, const cv::Size& size)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    const uint32_t header[3] = { (uint32_t)kps.size, (uint32_t)size.width, (uint32_t)size.height };
+    bool ok{ fwrite(magic, 1, 4, f) == 4 && write32(header, 3, f) };
+    if (ok && kps.size > 0) {
+        ok = write32(kps.x, kps.size, f)
+            && write32(kps.y, kps.size, f)
+            && write32(kps.score, kps.size, f)
+            && write32(kps.level, kps.size, f);
+    }
+    return fclose(f) == 0 && ok;
+}
+
+bool readKeypointsBinary(const std::string& path, KeypointBuffer& kps, cv::Size& size)
+{
+    kps.clear();
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    char m[4];
+    uint32_t header[3];
+    bool ok{ fread(m, 1, 4, f) == 4 && memcmp(m, magic, 4) == 0 && read32(header, 3, f) };
+    if (ok) {
+        // The count must match the file size before anything is allocated for it
+        const long start{ ftell(f) };
+        ok = start >= 0 && fseek(f, 0, SEEK_END) == 0;
+        const long end{ ok ? ftell(f) : -1 };
+        ok = ok && end >= start && (uint64_t)(end - start) == 16 * (uint64_t)header[0] && fseek(f, start, SEEK_SET) == 0
+            && header[1] <= INT32_MAX && header[2] <= INT32_MAX;
+    }
+    if (ok) {
+        const size_t n{ header[0] };
+        size = cv::Size((int)header[1], (int)header[2]);
+        std::vector<float> x(n), y(n), score(n);
+        std::vector<int32_t> level(n);
+        ok = read32(x.data(), n, f)
+            && read32(y.data(), n, f)
+            && read32(score.data(), n, f)
+            && read32(level.data(), n, f);
+        if (ok) {
+            kps.reserve(n);
+            for (size_t i{ 0 }; i < n; ++i)
+                kps.push_back(x[i], y[i], score[i], level[i]);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+bool writeKeypointsJson(const std::string& path, const KeypointView& kps, const cv::Size& size, const std::string& image)
+{
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    bool ok{ fprintf(f, "{\"image\": \"%s\", \"width\": %d, \"height\": %d, \"keypoints\": [",
+                 jsonEscape(image).c_str(), size.width, size.height)
+        > 0 };
+    for (size_t i{ 0 }; ok && i < kps.size; ++i)
+        ok = fprintf(f, "%s[%.3f, %.3f, %.3f, %d]", i ? ", " : "", kps.x[i], kps.y[i], kps.score[i], kps.level[i]) > 0;
+    ok = ok && fprintf(f, "]}\n") > 0;
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,28 @@
+/*
+ * keypoint_io.h
+ * Keypoint files, for datasets & regression baselines
+ *
+ * Binary (.kps), little endian on any host:
+ *   char[4] "KPS1", uint32 count, uint32 width, uint32 height,
+ *   float x[count], float y[count], float score[count], int32 level[count]
+ * i.e. the KeypointBuffer arrays as they are, in level 0 pixel coordinates.
+ * JSON: {"image": ..., "width": ..., "height": ..., "keypoints": [[x, y, score, level], ...]}
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef KEYPOINT_IO_H
+#define KEYPOINT_IO_H
+
+#include <opencv2/core.hpp>
+
+#include <string>
+
+#include "keypoints.h"
+
+bool writeKeypointsBinary(const std::string& path, const KeypointView& kps, const cv::Size& size);
+// False on a short / corrupt file (the count must match the file size), kps is left empty
+bool readKeypointsBinary(const std::string& path, KeypointBuffer& kps, cv::Size& size);
+bool writeKeypointsJson(const std::string& path, const KeypointView& kps, const cv::Size& size, const std::string& image);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * keypoints.h
+ * Flat structure-of-arrays keypoint buffer
+ *
+ * x, y, score & level are stored in contiguous arrays whose capacity is kept
+ * across frames (clear() does not free), so filling it every frame does not
+ * allocate once warmed up. KeypointView is a cheap non-owning view for the
+ * drawing & export paths.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef KEYPOINTS_H
+#define KEYPOINTS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Non-owning view, valid until the buffer is modified
+struct KeypointView {
+    const float* x;
+    const float* y;
+    const float* score;
+    const int* level;
+    size_t size;
+
+    bool empty() const { return size == 0; }
+};
+
+class KeypointBuffer {
+public:
+    KeypointBuffer() {}
+    explicit KeypointBuffer(size_t capacity) { reserve(capacity); }
+
+    void clear()
+    {
+        x_.clear();
+        y_.clear();
+        score_.clear();
+        level_.clear();
+    }
+
+    void reserve(size_t n)
+    {
+        x_.reserve(n);
+        y_.reserve(n);
+        score_.reserve(n);
+        level_.reserve(n);
+    }
+
+    void push_back(float x, float y, float score, int level)
+    {
+        x_.push_back(x);
+        y_.push_back(y);
+        score_.push_back(score);
+        level_.push_back(level);
+    }
+
+    // Keep the n highest scores (ties: the first ones), order is preserved
+    void keepStrongest(size_t n)
+    {
+        if (size() <= n)
+            return;
+        if (n == 0) {
+            clear();
+            return;
+        }
+        rank_.assign(score_.begin(), score_.end());
+        std::nth_element(rank_.begin(), rank_.begin() + (n - 1), rank_.end(), std::greater<float>());
+        const float cut{ rank_[n - 1] };
+        size_t ties{ n - (size_t)std::count_if(score_.begin(), score_.end(), [cut](float s) { return s > cut; }) };
+        size_t j{ 0 };
+        for (size_t i{ 0 }; i < score_.size(); ++i) {
+            if (score_[i] < cut)
+                continue;
+            if (score_[i] == cut) {
+                if (ties == 0)
+                    continue;
+                --ties;
+            }
+            x_[j] = x_[i];
+            y_[j] = y_[i];
+            score_[j] = score_[i];
+            level_[j] = level_[i];
+            ++j;
+        }
+        x_.resize(n);
+        y_.resize(n);
+        score_.resize(n);
+        level_.resize(n);
+    }
+
+    size_t size() const { return x_.size(); }
+    size_t capacity() const { return x_.capacity(); }
+    bool empty() const { return x_.empty(); }
+
+    const float* x() const { return x_.data(); }
+    const float* y() const { return y_.data(); }
+    const float* score() const { return score_.data(); }
+    const int* level() const { return level_.data(); }
+
+    KeypointView view() const
+    {
+        KeypointView v = { x_.data(), y_.data(), score_.data(), level_.data(), x_.size() };
+        return v;
+    }
+
+private:
+    std::vector<float> x_, y_, score_;
+    std::vector<int> level_;
+    std::vector<float> rank_; //keepStrongest() scratch
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "klt_tracker.h"
+
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <utility>
+
+KltTracker::KltTracker(const KltParams& params)
+    : params_(params)
+    , next_id_(0)
+    , cell_w_(0)
+    , cell_h_(0)
+    , cols_(0)
+    , rows_(0)
+{
+    reset();
+}
+
+void KltTracker::reset()
+{
+    pts_.clear();
+    ids_.clear();
+    ages_.clear();
+    score_.clear();
+    level_.clear();
+    kps_.clear();
+    prev_pyr_.clear();
+    stats_ = KltStats();
+}
+
+void KltTracker::process(const cv::Mat& gray, DetectorSession& session)
+{
+    CV_Assert(gray.type() == CV_8UC1);
+    const cv::Size win(params_.win_size, params_.win_size);
+    cv::buildOpticalFlowPyramid(gray, cur_pyr_, win, params_.max_level);
+
+    // Level 0 grid of the detector, the same cells are used for the track counts
+    const DetectorParams& dp = session.params();
+    cell_w_ = dp.cell_size_width;
+    cell_h_ = dp.cell_size_height;
+    cols_ = (gray.cols + cell_w_ - 1) / cell_w_;
+    rows_ = (gray.rows + cell_h_ - 1) / cell_h_;
+
+    stats_ = KltStats();
+    if (!prev_pyr_.empty() && prev_pyr_[0].size() != cur_pyr_[0].size())
+        reset(); //Resolution changed, the tracks are meaningless
+    if (!pts_.empty())
+        track();
+    redetect(gray, session);
+
+    kps_.clear();
+    kps_.reserve(pts_.size());
+    for (size_t i{ 0 }; i < pts_.size(); ++i)
+        kps_.push_back(pts_[i].x, pts_[i].y, score_[i], level_[i]);
+    std::swap(prev_pyr_, cur_pyr_); //Buffers are kept for the next frame
+}
+
+void KltTracker::track()
+{
+    const cv::Size win(params_.win_size, params_.win_size);
+    const cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, params_.max_iterations, params_.epsilon);
+    cv::calcOpticalFlowPyrLK(prev_pyr_, cur_pyr_, pts_, next_pts_, status_, err_, win, params_.max_level, criteria);
+    const bool fb{ params_.fb_threshold > 0.0f };
+    if (fb) {
+        // Back to the previous frame, starting from where the track was
+        back_pts_ = pts_;
+        cv::calcOpticalFlowPyrLK(cur_pyr_, prev_pyr_, next_pts_, back_pts_, back_status_, err_, win, params_.max_level, criteria,
+            cv::OPTFLOW_USE_INITIAL_FLOW);
+    }
+
+    // Compact the surviving tracks in place, oldest first, capped per cell
+    const float b{ (float)params_.border };
+    const float w{ (float)cur_pyr_[0].cols - b }, h{ (float)cur_pyr_[0].rows - b };
+    const float fb2{ params_.fb_threshold * params_.fb_threshold };
+    cell_count_.assign(cols_ * rows_, 0);
+    size_t j{ 0 };
+    for (size_t i{ 0 }; i < pts_.size(); ++i) {
+        const cv::Point2f& p = next_pts_[i];
+        if (!status_[i] || p.x < b || p.y < b || p.x >= w || p.y >= h)
+            continue;
+        if (fb) {
+            const float dx{ back_pts_[i].x - pts_[i].x }, dy{ back_pts_[i].y - pts_[i].y };
+            if (!back_status_[i] || dx * dx + dy * dy > fb2)
+                continue;
+        }
+        int& count = cell_count_[((int)p.y / cell_h_) * cols_ + (int)p.x / cell_w_];
+        if (count >= params_.max_tracks_per_cell)
+            continue;
+        ++count;
+        pts_[j] = p;
+        ids_[j] = ids_[i];
+        ages_[j] = ages_[i] + 1;
+        score_[j] = score_[i];
+        level_[j] = level_[i];
+        ++j;
+    }
+    stats_.tracked = j;
+    stats_.lost = pts_.size() - j;
+    pts_.resize(j);
+    ids_.resize(j);
+    ages_.resize(j);
+    score_.resize(j);
+    level_.resize(j);
+}
+
+bool KltTracker::nearTrack(const cv::Point2f& p, int cx, int cy) const
+{
+    const float d2{ params_.min_distance * params_.min_distance };
+    for (int y{ std::max(0, cy - 1) }; y <= std::min(rows_ - 1, cy + 1); ++y)
+        for (int x{ std::max(0, cx - 1) }; x <= std::min(cols_ - 1, cx + 1); ++x)
+            for (int t{ cell_head_[y * cols_ + x] }; t >= 0; t = cell_next_[t]) {
+                const float dx{ pts_[t].x - p.x }, dy{ pts_[t].y - p.y };
+                if (dx * dx + dy * dy < d2)
+                    return true;
+            }
+    return false;
+}
+
+void KltTracker::redetect(const cv::Mat& gray, DetectorSession& session)
+{
+    // Per cell lists of the current tracks
+    const int cells{ cols_ * rows_ };
+    cell_count_.assign(cells, 0);
+    cell_head_.assign(cells, -1);
+    cell_next_.resize(pts_.size());
+    for (size_t i{ 0 }; i < pts_.size(); ++i) {
+        const int c{ ((int)pts_[i].y / cell_h_) * cols_ + (int)pts_[i].x / cell_w_ };
+        ++cell_count_[c];
+        cell_next_[i] = cell_head_[c];
+        cell_head_[c] = (int)i;
+    }
+
+    cell_mask_.resize(cells);
+    for (int c{ 0 }; c < cells; ++c) {
+        cell_mask_[c] = cell_count_[c] < params_.min_tracks_per_cell;
+        stats_.cells_redetected += cell_mask_[c];
+    }
+    if (stats_.cells_redetected == 0)
+        return;
+    session.detect(gray, fresh_, cell_mask_);
+
+    // New tracks, not too close to the existing ones
+    const float b{ (float)params_.border };
+    const size_t n_before{ pts_.size() };
+    for (size_t i{ 0 }; i < fresh_.size(); ++i) {
+        const cv::Point2f p(fresh_.x()[i], fresh_.y()[i]);
+        if (p.x < b || p.y < b || p.x >= gray.cols - b || p.y >= gray.rows - b)
+            continue;
+        const int cx{ (int)p.x / cell_w_ }, cy{ (int)p.y / cell_h_ };
+        const int c{ cy * cols_ + cx };
+        if (cell_count_[c] >= params_.max_tracks_per_cell || nearTrack(p, cx, cy))
+            continue;
+        ++cell_count_[c];
+        cell_next_.push_back(cell_head_[c]);
+        cell_head_[c] = (int)pts_.size();
+        pts_.push_back(p);
+        ids_.push_back(next_id_++);
+        ages_.push_back(0);
+        score_.push_back(fresh_.score()[i]);
+        level_.push_back(fresh_.level()[i]);
+    }
+    stats_.added = pts_.size() - n_before;
+}
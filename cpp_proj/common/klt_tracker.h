@@ -0,0 +1,89 @@
+/*
+ * klt_tracker.h
+ * Track-and-redetect keypoint tracker (pyramidal Lucas-Kanade + FAST)
+ *
+ * Tracks from the previous frame are followed with calcOpticalFlowPyrLK
+ * (optional forward-backward check), then FAST only runs in the level 0
+ * grid cells left with fewer than min_tracks_per_cell tracks. Tracks keep
+ * their ID for life & their age counts the frames since detection; they are
+ * stored oldest first, so the oldest win when a cell is over its cap.
+ * The LK pyramid of a frame is reused as the previous one of the next.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef KLT_TRACKER_H
+#define KLT_TRACKER_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "detector_session.h"
+#include "keypoints.h"
+
+struct KltParams {
+    int win_size = 21;
+    int max_level = 3; //LK pyramid levels above the base
+    int max_iterations = 30;
+    double epsilon = 0.01;
+    float fb_threshold = 1.0f; //Max forward-backward error (px), <= 0: no check
+    int min_tracks_per_cell = 1; //Cells below are redetected
+    int max_tracks_per_cell = 3; //The youngest tracks over it are dropped
+    float min_distance = 8.0f; //New corners closer than this to a track are skipped
+    int border = 4; //Tracks closer to the image border are dropped
+};
+
+struct KltStats {
+    size_t tracked; //Tracks carried over from the previous frame
+    size_t lost;
+    size_t added; //New tracks from detection
+    size_t cells_redetected;
+};
+
+class KltTracker {
+public:
+    explicit KltTracker(const KltParams& params = KltParams());
+
+    // Track into gray (CV_8UC1), then redetect with session where tracks are missing
+    void process(const cv::Mat& gray, DetectorSession& session);
+    // Drop all the tracks, IDs keep increasing
+    void reset();
+
+    // Track positions, score & level are the ones of their detection
+    const KeypointBuffer& keypoints() const { return kps_; }
+    const std::vector<long>& ids() const { return ids_; }
+    const std::vector<int>& ages() const { return ages_; } //Frames since detection
+    const KltStats& stats() const { return stats_; }
+    size_t size() const { return pts_.size(); }
+
+private:
+    void track();
+    void redetect(const cv::Mat& gray, DetectorSession& session);
+    bool nearTrack(const cv::Point2f& p, int cx, int cy) const;
+
+    KltParams params_;
+    KltStats stats_;
+    long next_id_;
+
+    // Tracks, oldest first
+    std::vector<cv::Point2f> pts_;
+    std::vector<long> ids_;
+    std::vector<int> ages_;
+    std::vector<float> score_;
+    std::vector<int> level_;
+    KeypointBuffer kps_;
+
+    // Reused across frames
+    std::vector<cv::Mat> prev_pyr_, cur_pyr_;
+    std::vector<cv::Point2f> next_pts_, back_pts_;
+    std::vector<uchar> status_, back_status_;
+    std::vector<float> err_;
+    KeypointBuffer fresh_;
+    int cell_w_, cell_h_, cols_, rows_;
+    std::vector<int> cell_count_, cell_head_, cell_next_; //Tracks per cell & their linked lists
+    std::vector<uchar> cell_mask_;
+};
+
+#endif
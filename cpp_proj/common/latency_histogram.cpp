@@ -0,0 +1,104 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram(double min_ms, double max_ms, int bins_per_octave)
+    : min_ms_(min_ms)
+    , log_min_(std::log2(min_ms))
+    , bins_per_octave_(bins_per_octave)
+    , bins_((size_t)std::ceil(std::log2(max_ms / min_ms) * bins_per_octave) + 1, 0)
+{
+    clear();
+}
+
+void LatencyHistogram::add(double ms)
+{
+    ++bins_[bin(ms)];
+    if (!count_ || ms < min_)
+        min_ = ms;
+    if (!count_ || ms > max_)
+        max_ = ms;
+    ++count_;
+    sum_ += ms;
+    sum_sq_ += ms * ms;
+}
+
+void LatencyHistogram::clear()
+{
+    std::fill(bins_.begin(), bins_.end(), 0);
+    count_ = 0;
+    sum_ = sum_sq_ = min_ = max_ = 0.0;
+}
+
+double LatencyHistogram::stddev() const
+{
+    if (count_ < 2)
+        return 0.0;
+    const double m{ mean() };
+    return std::sqrt(std::max(0.0, sum_sq_ / count_ - m * m));
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    if (!count_)
+        return 0.0;
+    const double rank{ std::min(std::max(p, 0.0), 100.0) / 100.0 * count_ };
+    uint64_t below{ 0 };
+    for (size_t b{ 0 }; b < bins_.size(); ++b) {
+        if (!bins_[b] || below + bins_[b] < rank) {
+            below += bins_[b];
+            continue;
+        }
+        // Geometric interpolation inside the bin, clamped to what was actually seen
+        const double f{ (rank - below) / bins_[b] };
+        const double v{ lower((int)b) * std::pow(2.0, f / bins_per_octave_) };
+        return std::min(std::max(v, min_), max_);
+    }
+    return max_;
+}
+
+std::string LatencyHistogram::summary() const
+{
+    char buf[160];
+    snprintf(buf, sizeof(buf), "n %llu  mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms",
+        (unsigned long long)count_, mean(), percentile(50), percentile(90), percentile(99), max());
+    return buf;
+}
+
+void LatencyHistogram::print(std::ostream& os, const std::string& title, int bar_width) const
+{
+    os << title << ": " << summary() << "\n";
+    if (!count_)
+        return;
+    const int first{ bin(min_) }, last{ bin(max_) };
+    const uint64_t peak{ *std::max_element(bins_.begin() + first, bins_.begin() + last + 1) };
+    char buf[64];
+    for (int b{ first }; b <= last; ++b) {
+        // Collapse gaps, outliers would otherwise leave screens of empty bins
+        int e{ b };
+        while (e < last && !bins_[e] && !bins_[e + 1])
+            ++e;
+        if (e > b) {
+            os << "  ...\n";
+            b = e;
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "  %9.3f - %9.3f ms %8llu ", lower(b), lower(b + 1), (unsigned long long)bins_[b]);
+        os << buf << std::string((size_t)(bins_[b] * bar_width / peak), '#') << "\n";
+    }
+}
+
+int LatencyHistogram::bin(double ms) const
+{
+    if (!(ms > min_ms_)) //Also catches NaN
+        return 0;
+    const int b{ (int)((std::log2(ms) - log_min_) * bins_per_octave_) };
+    return std::min(b, (int)bins_.size() - 1);
+}
+
+double LatencyHistogram::lower(int b) const
+{
+    return min_ms_ * std::pow(2.0, b / bins_per_octave_);
+}
@@ -0,0 +1,52 @@
+/*
+ * latency_histogram.h
+ * Log-binned latency histogram for benchmarks
+ *
+ * Samples (ms) are counted in bins spaced bins_per_octave per doubling, so
+ * the relative resolution is the same from microseconds to seconds & add()
+ * is O(1) without keeping the samples. Min, max, mean & stddev are exact,
+ * percentiles are interpolated within their bin. Samples outside
+ * [min_ms, max_ms] land in the first/last bin.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class LatencyHistogram {
+public:
+    explicit LatencyHistogram(double min_ms = 0.01, double max_ms = 10000.0, int bins_per_octave = 8);
+
+    void add(double ms);
+    void clear();
+
+    size_t count() const { return (size_t)count_; }
+    double min() const { return count_ ? min_ : 0.0; }
+    double max() const { return count_ ? max_ : 0.0; }
+    double mean() const { return count_ ? sum_ / count_ : 0.0; }
+    double stddev() const;
+    double percentile(double p) const; //p in [0, 100]
+
+    // "n 1234  mean 1.23  p50 1.20  p90 1.50  p99 2.10  max 3.40 ms"
+    std::string summary() const;
+    // Summary followed by one bar per bin, over the non-empty bin range
+    void print(std::ostream& os, const std::string& title, int bar_width = 40) const;
+
+private:
+    int bin(double ms) const;
+    double lower(int b) const; //Lower edge of bin b (ms)
+
+    double min_ms_, log_min_, bins_per_octave_;
+    std::vector<uint64_t> bins_;
+    uint64_t count_;
+    double sum_, sum_sq_, min_, max_;
+};
+
+#endif
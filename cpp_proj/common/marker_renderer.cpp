@@ -0,0 +1,150 @@
+#include "marker_renderer.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+namespace {
+
+const int band_rows{ 16 }; //Rows per parallel work item
+
+} // namespace
+
+// Blends the markers of a range of bands, each band only touches its own rows
+class MarkerRenderer::BandBody : public cv::ParallelLoopBody {
+public:
+    BandBody(cv::Mat& img, const MarkerRenderer& r)
+        : img_(img)
+        , r_(r)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        const int cn{ img_.channels() };
+        for (int b{ range.start }; b < range.end; ++b) {
+            const int lo{ b * band_rows }, hi{ std::min(img_.rows, lo + band_rows) };
+            for (int k{ r_.band_start_[b] }; k < r_.band_start_[b + 1]; ++k) {
+                const Marker& m = r_.markers_[r_.band_items_[k]];
+                const Sprite& s = r_.sprites_[m.style];
+                uchar c[4];
+                if (cn == 1)
+                    c[0] = cv::saturate_cast<uchar>(0.114 * s.color[0] + 0.587 * s.color[1] + 0.299 * s.color[2]);
+                else
+                    for (int i{ 0 }; i < 4; ++i)
+                        c[i] = cv::saturate_cast<uchar>(s.color[i]);
+
+                // Sprite rows falling in this band
+                const int dy0{ std::max(lo - m.y, -s.half) }, dy1{ std::min(hi - 1 - m.y, s.half) };
+                if (dy0 > dy1)
+                    continue;
+                const int p1{ s.row_start[dy1 + s.half + 1] };
+                for (int p{ s.row_start[dy0 + s.half] }; p < p1; ++p) {
+                    const int x{ m.x + s.dx[p] };
+                    if (x < 0 || x >= img_.cols)
+                        continue;
+                    uchar* d = img_.ptr<uchar>(m.y + s.dy[p]) + x * cn;
+                    const int a{ s.alpha[p] };
+                    for (int i{ 0 }; i < cn; ++i)
+                        d[i] = (uchar)((d[i] * (255 - a) + c[i] * a + 127) / 255);
+                }
+            }
+        }
+    }
+
+private:
+    cv::Mat& img_;
+    const MarkerRenderer& r_;
+};
+
+MarkerRenderer::MarkerRenderer()
+{
+}
+
+int MarkerRenderer::style(int radius, const cv::Scalar& color, int thickness)
+{
+    for (size_t i{ 0 }; i < sprites_.size(); ++i)
+        if (sprites_[i].radius == radius && sprites_[i].thickness == thickness && sprites_[i].color == color)
+            return (int)i;
+
+    // Rasterize once, anti-aliased, & keep the covered pixels
+    Sprite s;
+    s.radius = radius;
+    s.thickness = thickness;
+    s.color = color;
+    s.half = radius + std::max(1, thickness) / 2 + 2;
+    const int size{ 2 * s.half + 1 };
+    cv::Mat a = cv::Mat::zeros(size, size, CV_8UC1);
+    cv::circle(a, cv::Point(s.half, s.half), radius, cv::Scalar(255), thickness, cv::LINE_AA);
+    s.row_start.push_back(0);
+    for (int y{ 0 }; y < size; ++y) {
+        const uchar* row = a.ptr<uchar>(y);
+        for (int x{ 0 }; x < size; ++x)
+            if (row[x]) {
+                s.dx.push_back((short)(x - s.half));
+                s.dy.push_back((short)(y - s.half));
+                s.alpha.push_back(row[x]);
+            }
+        s.row_start.push_back((int)s.dx.size());
+    }
+    sprites_.push_back(s);
+    return (int)sprites_.size() - 1;
+}
+
+void MarkerRenderer::add(float x, float y, int style)
+{
+    CV_Assert(style >= 0 && style < (int)sprites_.size());
+    Marker m = { cvRound(x), cvRound(y), style };
+    markers_.push_back(m);
+}
+
+void MarkerRenderer::add(const KeypointView& kps, int style)
+{
+    markers_.reserve(markers_.size() + kps.size);
+    for (size_t i{ 0 }; i < kps.size; ++i)
+        add(kps.x[i], kps.y[i], style);
+}
+
+void MarkerRenderer::add(const std::vector<cv::KeyPoint>& kps, int style)
+{
+    markers_.reserve(markers_.size() + kps.size());
+    for (size_t i{ 0 }; i < kps.size(); ++i)
+        add(kps[i].pt.x, kps[i].pt.y, style);
+}
+
+void MarkerRenderer::render(cv::Mat& img)
+{
+    CV_Assert(img.depth() == CV_8U && img.channels() <= 4);
+    const int bands{ (img.rows + band_rows - 1) / band_rows };
+
+    // Bucket the markers by the bands they cover (counting sort), off-image ones are dropped
+    band_start_.assign(bands + 1, 0);
+    for (size_t i{ 0 }; i < markers_.size(); ++i) {
+        const Marker& m = markers_[i];
+        const int h{ sprites_[m.style].half };
+        if (m.x + h < 0 || m.x - h >= img.cols || m.y + h < 0 || m.y - h >= img.rows)
+            continue;
+        const int b0{ std::max(0, m.y - h) / band_rows }, b1{ std::min(img.rows - 1, m.y + h) / band_rows };
+        for (int b{ b0 }; b <= b1; ++b)
+            ++band_start_[b + 1];
+    }
+    for (int b{ 0 }; b < bands; ++b)
+        band_start_[b + 1] += band_start_[b];
+    band_items_.resize(band_start_[bands]);
+    std::vector<int>& fill = band_start_; //Fill pointers, shifted back below
+    for (size_t i{ 0 }; i < markers_.size(); ++i) {
+        const Marker& m = markers_[i];
+        const int h{ sprites_[m.style].half };
+        if (m.x + h < 0 || m.x - h >= img.cols || m.y + h < 0 || m.y - h >= img.rows)
+            continue;
+        const int b0{ std::max(0, m.y - h) / band_rows }, b1{ std::min(img.rows - 1, m.y + h) / band_rows };
+        for (int b{ b0 }; b <= b1; ++b)
+            band_items_[fill[b]++] = (int)i;
+    }
+    for (int b{ bands }; b > 0; --b)
+        band_start_[b] = band_start_[b - 1];
+    band_start_[0] = 0;
+
+    cv::parallel_for_(cv::Range(0, bands), BandBody(img, *this));
+    markers_.clear();
+}
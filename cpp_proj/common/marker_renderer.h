@@ -0,0 +1,60 @@
+/*
+ * marker_renderer.h
+ * Batched keypoint marker rasterizer for annotation overlays
+ *
+ * Every style (circle radius, thickness, colour) is rasterized once into an
+ * anti-aliased sprite, stored as a sparse list of (dx, dy, alpha). Markers
+ * are queued with add() & stamped by render() in one pass: they are bucketed
+ * by row band, bands are blended in parallel (cv::parallel_for_), each one
+ * only writing its own rows, & sprites are clipped at the image border.
+ * Marker centres are rounded to the nearest pixel.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef MARKER_RENDERER_H
+#define MARKER_RENDERER_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include "keypoints.h"
+
+class MarkerRenderer {
+public:
+    MarkerRenderer();
+
+    // Id of the sprite for this style, built on first use
+    int style(int radius, const cv::Scalar& color, int thickness = 1);
+    // Queue markers, drawn by the next render()
+    void add(float x, float y, int style);
+    void add(const KeypointView& kps, int style);
+    void add(const std::vector<cv::KeyPoint>& kps, int style);
+    // Stamp the queued markers on img (CV_8UC1 / CV_8UC3 / CV_8UC4) & clear the queue
+    void render(cv::Mat& img);
+    void clear() { markers_.clear(); }
+    size_t size() const { return markers_.size(); }
+
+private:
+    struct Sprite {
+        int radius, thickness;
+        cv::Scalar color;
+        int half; //Pixels may be up to half away from the centre
+        std::vector<short> dx, dy; //Sorted by dy
+        std::vector<uchar> alpha;
+        std::vector<int> row_start; //First pixel of each dy, 2 * half + 2 entries
+    };
+    struct Marker {
+        int x, y, style;
+    };
+    class BandBody;
+
+    std::vector<Sprite> sprites_;
+    std::vector<Marker> markers_;
+    // Reused across frames
+    std::vector<int> band_start_, band_items_;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "pyramid_cpu.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PYR_SIMD_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PYR_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PYR_SIMD_NEON
+#endif
+
+namespace {
+
+// Output pixels [x0, w) of one row from the 2 source rows
+inline void halfSampleScalar(const uchar* r0, const uchar* r1, uchar* d, int x0, int w)
+{
+    for (int x{ x0 }; x < w; ++x)
+        d[x] = (uchar)((r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1] + 2) >> 2);
+}
+
+void halfSampleRow(const uchar* r0, const uchar* r1, uchar* d, int w)
+{
+    int x{ 0 };
+#if defined(PYR_SIMD_AVX2)
+    const __m256i lo{ _mm256_set1_epi16(0x00FF) }, two{ _mm256_set1_epi16(2) };
+    for (; x + 32 <= w; x += 32) {
+        __m256i s[2];
+        for (int k{ 0 }; k < 2; ++k) {
+            const __m256i a{ _mm256_loadu_si256((const __m256i*)(r0 + 2 * x + 32 * k)) };
+            const __m256i b{ _mm256_loadu_si256((const __m256i*)(r1 + 2 * x + 32 * k)) };
+            // Even + odd bytes of both rows, as 16 bit sums
+            __m256i t{ _mm256_add_epi16(_mm256_and_si256(a, lo), _mm256_srli_epi16(a, 8)) };
+            t = _mm256_add_epi16(t, _mm256_add_epi16(_mm256_and_si256(b, lo), _mm256_srli_epi16(b, 8)));
+            s[k] = _mm256_srli_epi16(_mm256_add_epi16(t, two), 2);
+        }
+        // packus works per 128 bit lane, restore the order
+        const __m256i p{ _mm256_permute4x64_epi64(_mm256_packus_epi16(s[0], s[1]), 0xD8) };
+        _mm256_storeu_si256((__m256i*)(d + x), p);
+    }
+#elif defined(PYR_SIMD_SSE2)
+    const __m128i lo{ _mm_set1_epi16(0x00FF) }, two{ _mm_set1_epi16(2) };
+    for (; x + 16 <= w; x += 16) {
+        __m128i s[2];
+        for (int k{ 0 }; k < 2; ++k) {
+            const __m128i a{ _mm_loadu_si128((const __m128i*)(r0 + 2 * x + 16 * k)) };
+            const __m128i b{ _mm_loadu_si128((const __m128i*)(r1 + 2 * x + 16 * k)) };
+            __m128i t{ _mm_add_epi16(_mm_and_si128(a, lo), _mm_srli_epi16(a, 8)) };
+            t = _mm_add_epi16(t, _mm_add_epi16(_mm_and_si128(b, lo), _mm_srli_epi16(b, 8)));
+            s[k] = _mm_srli_epi16(_mm_add_epi16(t, two), 2);
+        }
+        _mm_storeu_si128((__m128i*)(d + x), _mm_packus_epi16(s[0], s[1]));
+    }
+#elif defined(PYR_SIMD_NEON)
+    for (; x + 16 <= w; x += 16) {
+        // Pairwise add of adjacent bytes, then rounding shift (s + 2) >> 2
+        const uint16x8_t a0{ vpaddlq_u8(vld1q_u8(r0 + 2 * x)) }, a1{ vpaddlq_u8(vld1q_u8(r0 + 2 * x + 16)) };
+        const uint16x8_t b0{ vpaddlq_u8(vld1q_u8(r1 + 2 * x)) }, b1{ vpaddlq_u8(vld1q_u8(r1 + 2 * x + 16)) };
+        const uint8x8_t lo8{ vrshrn_n_u16(vaddq_u16(a0, b0), 2) }, hi8{ vrshrn_n_u16(vaddq_u16(a1, b1), 2) };
+        vst1q_u8(d + x, vcombine_u8(lo8, hi8));
+    }
+#endif
+    halfSampleScalar(r0, r1, d, x, w);
+}
+
+} // namespace
+
+const char* HalfSamplePyramid::simd()
+{
+#if defined(PYR_SIMD_AVX2)
+    return "AVX2";
+#elif defined(PYR_SIMD_SSE2)
+    return "SSE2";
+#elif defined(PYR_SIMD_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+void HalfSamplePyramid::halfSample(const cv::Mat& src, cv::Mat& dst)
+{
+    CV_Assert(src.type() == CV_8UC1);
+    dst.create(src.rows / 2, src.cols / 2, CV_8UC1); //No-op when the size is unchanged
+    for (int y{ 0 }; y < dst.rows; ++y)
+        halfSampleRow(src.ptr<uchar>(2 * y), src.ptr<uchar>(2 * y + 1), dst.ptr<uchar>(y), dst.cols);
+}
+
+const std::vector<cv::Mat>& HalfSamplePyramid::build(const cv::Mat& img, int n_levels)
+{
+    constexpr int min_size{ 16 }; //Smaller levels are not worth detecting on
+    if ((int)buffers_.size() < n_levels)
+        buffers_.resize(n_levels);
+    levels_.resize(1);
+    levels_[0] = img;
+    for (int l{ 1 }; l < n_levels; ++l) {
+        const cv::Mat& prev = levels_[l - 1];
+        if (prev.cols / 2 < min_size || prev.rows / 2 < min_size)
+            break;
+        halfSample(prev, buffers_[l]);
+        levels_.push_back(buffers_[l]);
+    }
+    return levels_;
+}
@@ -0,0 +1,34 @@
+/*
+ * pyramid_cpu.h
+ * 2x2 half-sample image pyramid for the CPU detector
+ *
+ * Each level is the rounded mean of 2x2 blocks of the previous one (AVX2 /
+ * SSE2 / NEON, scalar fallback). Level 0 is a header of the input, the other
+ * levels are buffers reused across frames.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef PYRAMID_CPU_H
+#define PYRAMID_CPU_H
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+class HalfSamplePyramid {
+public:
+    // Build n_levels levels from a CV_8UC1 image, stops early if a level gets too small
+    const std::vector<cv::Mat>& build(const cv::Mat& img, int n_levels);
+    const std::vector<cv::Mat>& levels() const { return levels_; }
+
+    // dst = 2x2 mean of src, dst is (re)allocated to (src.cols / 2, src.rows / 2)
+    static void halfSample(const cv::Mat& src, cv::Mat& dst);
+    static const char* simd();
+
+private:
+    std::vector<cv::Mat> levels_;
+    std::vector<cv::Mat> buffers_; //Owned storage of levels 1..n
+};
+
+#endif
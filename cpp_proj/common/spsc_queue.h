@@ -0,0 +1,82 @@
+/*
+ * spsc_queue.h
+ * Bounded single-producer/single-consumer queue between pipeline stages
+ *
+ * push() blocks while the queue is full (backpressure), pop() blocks while
+ * it is empty; both sleep on a condition variable instead of spinning.
+ * close() wakes everyone up: push() then fails & pop() drains the remaining
+ * items before failing, so shutdown cascades down the pipeline.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : ring_(capacity)
+        , head_(0)
+        , count_(0)
+        , closed_(false)
+    {
+    }
+
+    // False if the queue was closed
+    bool push(const T& item)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notFull_.wait(lk, [this] { return count_ < ring_.size() || closed_; });
+        if (closed_)
+            return false;
+        ring_[(head_ + count_) % ring_.size()] = item;
+        ++count_;
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // False once the queue is closed & drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notEmpty_.wait(lk, [this] { return count_ > 0 || closed_; });
+        if (count_ == 0)
+            return false;
+        item = ring_[head_];
+        head_ = (head_ + 1) % ring_.size();
+        --count_;
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        return count_;
+    }
+    size_t capacity() const { return ring_.size(); }
+
+private:
+    std::vector<T> ring_;
+    size_t head_, count_;
+    bool closed_;
+    mutable std::mutex m_;
+    std::condition_variable notFull_, notEmpty_;
+};
+
+#endif
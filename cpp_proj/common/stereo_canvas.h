@@ -0,0 +1,75 @@
+/*
+ * stereo_canvas.h
+ * Reusable side-by-side canvas for dual camera / stereo previews
+ *
+ * The canvas owns one double-width buffer and exposes each half as a ROI
+ * header. Capture, decode or remap outputs written into left()/right() land
+ * directly in place, so no hconcat (allocation + 2 frame copies) per frame.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef STEREO_CANVAS_H
+#define STEREO_CANVAS_H
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+class StereoCanvas {
+public:
+    StereoCanvas() {}
+    StereoCanvas(const cv::Size& half, int type) { create(half, type); }
+
+    // (Re)allocate only when the size/type of a half changes
+    void create(const cv::Size& half, int type)
+    {
+        if (!canvas_.empty() && half == half_ && type == canvas_.type())
+            return;
+        half_ = half;
+        canvas_.create(half.height, half.width * 2, type);
+        left_ = canvas_(roi(0));
+        right_ = canvas_(roi(1));
+    }
+
+    // Destination views, pass these as output of read()/remap()/imdecode()...
+    cv::Mat& left() { return left_; }
+    cv::Mat& right() { return right_; }
+
+    // Composed image. Halves that were reallocated by their writer (first
+    // frame, or size/type mismatch) are copied back once & rebound.
+    cv::Mat& compose()
+    {
+        cv::Mat l{ left_ }, r{ right_ }; // Keep the writer's buffers alive
+        if (!l.empty())
+            create(l.size(), l.type());
+        if (canvas_.empty())
+            return canvas_;
+        place(l, left_, 0);
+        place(r, right_, 1);
+        return canvas_;
+    }
+
+    cv::Size halfSize() const { return half_; }
+    bool empty() const { return canvas_.empty(); }
+
+private:
+    cv::Rect roi(int idx) const { return cv::Rect(idx * half_.width, 0, half_.width, half_.height); }
+
+    void place(const cv::Mat& src, cv::Mat& view, int idx)
+    {
+        cv::Mat dst{ canvas_(roi(idx)) };
+        if (!src.empty() && src.data != dst.data) {
+            CV_Assert(src.type() == canvas_.type());
+            if (src.size() == half_)
+                src.copyTo(dst);
+            else
+                cv::resize(src, dst, half_); //Mismatched cameras, fit into the half
+        }
+        view = dst;
+    }
+
+    cv::Size half_;
+    cv::Mat canvas_, left_, right_;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "threshold_controller.h"
+
+#include <algorithm>
+
+FastThresholdController::FastThresholdController(const ThresholdControlParams& params)
+    : params_(params)
+    , bias_(0.0f)
+    , kept_ema_(0.0f)
+{
+    reset(0, params.min_threshold);
+}
+
+void FastThresholdController::reset(size_t cells, float threshold)
+{
+    threshold = std::max(params_.min_threshold, std::min(params_.max_threshold, threshold));
+    cell_.assign(cells, threshold);
+    ema_.assign(cells, params_.cell_target); //Start in band, no change before real counts come in
+    effective_ = cell_;
+    bias_ = 0.0f;
+    kept_ema_ = 0.0f;
+    updateStats();
+    stats_.raised = stats_.lowered = 0;
+}
+
+const std::vector<float>& FastThresholdController::update(const std::vector<int>& counts, size_t kept, size_t budget,
+    const std::vector<unsigned char>& active)
+{
+    const float a{ params_.smoothing };
+    const float lo{ params_.cell_target * (1.0f - params_.hysteresis) };
+    const float hi{ params_.cell_target * (1.0f + params_.hysteresis) };
+    const size_t n{ std::min(counts.size(), cell_.size()) };
+
+    // Anti-windup: while the budget holds the thresholds up, cells under target are the ones it emptied on purpose
+    const bool capped{ bias_ > 0.0f };
+    stats_.raised = stats_.lowered = 0;
+    for (size_t i{ 0 }; i < n; ++i) {
+        if (!active.empty() && !active[i])
+            continue;
+        ema_[i] = a * counts[i] + (1.0f - a) * ema_[i];
+        if (ema_[i] < lo && !capped && cell_[i] > params_.min_threshold) {
+            cell_[i] = std::max(params_.min_threshold, cell_[i] * (1.0f - params_.step));
+            ++stats_.lowered;
+        }
+        else if (ema_[i] > hi && cell_[i] < params_.max_threshold) {
+            cell_[i] = std::min(params_.max_threshold, cell_[i] * (1.0f + params_.step));
+            ++stats_.raised;
+        }
+    }
+
+    // Global bias: only ever raises the thresholds, back off to 0 once under budget
+    if (budget > 0) {
+        kept_ema_ = a * kept + (1.0f - a) * kept_ema_;
+        const float unit{ std::max(1.0f, stats_.mean * params_.step) };
+        if (kept_ema_ > budget * (1.0f + params_.budget_hysteresis))
+            bias_ = std::min(params_.max_threshold, bias_ + unit);
+        else if (kept_ema_ < budget * (1.0f - params_.budget_hysteresis))
+            bias_ = std::max(0.0f, bias_ - unit);
+    }
+    else
+        bias_ = 0.0f;
+
+    for (size_t i{ 0 }; i < cell_.size(); ++i)
+        effective_[i] = std::min(params_.max_threshold, cell_[i] + bias_);
+    updateStats();
+    return effective_;
+}
+
+void FastThresholdController::updateStats()
+{
+    stats_.bias = bias_;
+    if (effective_.empty()) {
+        stats_.min = stats_.mean = stats_.max = 0.0f;
+        return;
+    }
+    double sum{ 0.0 };
+    stats_.min = stats_.max = effective_[0];
+    for (size_t i{ 0 }; i < effective_.size(); ++i) {
+        stats_.min = std::min(stats_.min, effective_[i]);
+        stats_.max = std::max(stats_.max, effective_[i]);
+        sum += effective_[i];
+    }
+    stats_.mean = (float)(sum / effective_.size());
+}
@@ -0,0 +1,69 @@
+/*
+ * threshold_controller.h
+ * Per-cell FAST threshold controller
+ *
+ * Every frame, the number of corners found in each grid cell is smoothed
+ * (EMA) & compared to the cell target: the cell threshold is lowered when the
+ * cell is under target*(1-hysteresis), raised when it is over
+ * target*(1+hysteresis) & left alone in between, so it settles instead of
+ * oscillating. A global bias, driven the same way by the kept keypoints vs
+ * the overall budget, is added on top of every cell.
+ *
+ * With at most one corner per cell, the budget can only be met by emptying
+ * cells, which then read as under target. Cell thresholds are therefore
+ * not lowered while the bias is above 0: otherwise they wind down to
+ * min_threshold under a growing bias & flood once it decays.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef THRESHOLD_CONTROLLER_H
+#define THRESHOLD_CONTROLLER_H
+
+#include <cstddef>
+#include <vector>
+
+struct ThresholdControlParams {
+    float cell_target = 4.0f; //Corners (after NMS) wanted per cell
+    float hysteresis = 0.5f; //Dead band: [1 - h, 1 + h] x target
+    float budget_hysteresis = 0.1f; //Same for the overall keypoint budget
+    float step = 0.1f; //Relative threshold change per frame when out of band
+    float smoothing = 0.5f; //EMA weight of the newest count, (0, 1]
+    float min_threshold = 3.0f, max_threshold = 120.0f;
+};
+
+// Metrics of the thresholds used for the next frame
+struct ThresholdStats {
+    float min, mean, max;
+    float bias; //Global term from the keypoint budget
+    int raised, lowered; //Cells changed by the last update
+};
+
+class FastThresholdController {
+public:
+    explicit FastThresholdController(const ThresholdControlParams& params = ThresholdControlParams());
+
+    // cells thresholds all starting at threshold
+    void reset(size_t cells, float threshold);
+    // counts: corners per cell of the last frame, kept: keypoints kept overall,
+    // budget: overall target (0: none), active: cells searched (empty: all, the
+    // others are left as they are). Returns the thresholds for the next frame
+    const std::vector<float>& update(const std::vector<int>& counts, size_t kept, size_t budget,
+        const std::vector<unsigned char>& active = std::vector<unsigned char>());
+
+    const std::vector<float>& thresholds() const { return effective_; }
+    const ThresholdStats& stats() const { return stats_; }
+    const ThresholdControlParams& params() const { return params_; }
+
+private:
+    void updateStats();
+
+    ThresholdControlParams params_;
+    std::vector<float> cell_; //Per cell term
+    std::vector<float> ema_; //Smoothed counts
+    std::vector<float> effective_; //cell_ + bias_, clamped
+    float bias_, kept_ema_;
+    ThresholdStats stats_;
+};
+
+#endif
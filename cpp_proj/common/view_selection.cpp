@@ -0,0 +1,174 @@
+#include "view_selection.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+namespace {
+
+// Pose feature weights, a unit of distance is roughly "a different view"
+const double w_centre{ 1.0 }; //Per image width/height
+const double w_size{ 2.0 }; //Per sqrt(board area / image area)
+const double w_tilt{ 1.5 }; //Per log ratio of opposite edge lengths
+const double w_roll{ 0.5 };
+const double w_coverage{ 4.0 }; //Bonus for covering the whole grid where no view is yet
+
+} // namespace
+
+ViewSelector::ViewSelector(const cv::Size& imageSize, const cv::Size& boardSize, const cv::Size& grid)
+    : imageSize_(imageSize)
+    , boardSize_(boardSize)
+    , grid_(grid)
+{
+}
+
+void ViewSelector::add(const cv::Mat& corners)
+{
+    views_.push_back(describe(corners));
+}
+
+double ViewSelector::novelty(const cv::Mat& corners) const
+{
+    const View v{ describe(corners) };
+    double dist{ views_.empty() ? 10.0 : std::numeric_limits<double>::max() };
+    std::vector<int> heat(grid_.area(), 0);
+    for (const View& o : views_) {
+        dist = std::min(dist, cv::norm(v.pose - o.pose));
+        for (int c : o.cells)
+            ++heat[c];
+    }
+    double gain{ 0.0 };
+    for (int c : v.cells)
+        gain += 1.0 / (1 + heat[c]);
+    return dist + w_coverage / grid_.area() * gain;
+}
+
+ViewSelector::View ViewSelector::describe(const cv::Mat& corners) const
+{
+    std::vector<cv::Point2f> pts;
+    corners.reshape(2, (int)corners.total()).convertTo(pts, CV_32FC2);
+    CV_Assert((int)pts.size() == boardSize_.area());
+
+    const int w{ boardSize_.width }, h{ boardSize_.height };
+    const cv::Point2f c00{ pts[0] }, c10{ pts[w - 1] }, c01{ pts[(h - 1) * w] }, c11{ pts[h * w - 1] };
+    cv::Point2f centre;
+    for (const cv::Point2f& p : pts)
+        centre += p;
+    centre *= 1.f / pts.size();
+
+    std::vector<cv::Point2f> hull;
+    cv::convexHull(pts, hull);
+    const double area{ cv::contourArea(hull) };
+    const double top{ cv::norm(c10 - c00) }, bottom{ cv::norm(c11 - c01) };
+    const double left{ cv::norm(c01 - c00) }, right{ cv::norm(c11 - c10) };
+    const cv::Point2f across{ (c10 - c00) + (c11 - c01) };
+    const double roll{ std::atan2(across.y, across.x) };
+
+    View v;
+    v.pose[0] = w_centre * centre.x / imageSize_.width;
+    v.pose[1] = w_centre * centre.y / imageSize_.height;
+    v.pose[2] = w_size * std::sqrt(area / imageSize_.area());
+    v.pose[3] = w_tilt * std::log((top + 1e-3) / (bottom + 1e-3));
+    v.pose[4] = w_tilt * std::log((left + 1e-3) / (right + 1e-3));
+    v.pose[5] = w_roll * std::cos(roll);
+    v.pose[6] = w_roll * std::sin(roll);
+
+    // Cells whose centre is inside the board hull, at least the cell of the board centre
+    const double cw{ (double)imageSize_.width / grid_.width }, ch{ (double)imageSize_.height / grid_.height };
+    const cv::Rect box{ cv::boundingRect(hull) };
+    const int x0{ std::max(0, (int)(box.x / cw)) }, x1{ std::min(grid_.width - 1, (int)((box.x + box.width) / cw)) };
+    const int y0{ std::max(0, (int)(box.y / ch)) }, y1{ std::min(grid_.height - 1, (int)((box.y + box.height) / ch)) };
+    for (int y{ y0 }; y <= y1; ++y)
+        for (int x{ x0 }; x <= x1; ++x)
+            if (cv::pointPolygonTest(hull, cv::Point2f((float)((x + 0.5) * cw), (float)((y + 0.5) * ch)), false) >= 0)
+                v.cells.push_back(y * grid_.width + x);
+    if (v.cells.empty()) {
+        const int x{ std::min(grid_.width - 1, std::max(0, (int)(centre.x / cw))) };
+        const int y{ std::min(grid_.height - 1, std::max(0, (int)(centre.y / ch))) };
+        v.cells.push_back(y * grid_.width + x);
+    }
+    return v;
+}
+
+std::vector<int> ViewSelector::select(int maxViews) const
+{
+    const int n{ (int)views_.size() };
+    std::vector<int> picked;
+    if (maxViews <= 0 || maxViews >= n) {
+        for (int i{ 0 }; i < n; ++i)
+            picked.push_back(i);
+        return picked;
+    }
+
+    std::vector<double> minDist(n, std::numeric_limits<double>::max());
+    std::vector<int> heat(grid_.area(), 0);
+    std::vector<bool> taken(n, false);
+    const double cellWeight{ w_coverage / grid_.area() };
+    while ((int)picked.size() < maxViews) {
+        int best{ -1 };
+        double bestScore{ -1.0 };
+        for (int i{ 0 }; i < n; ++i) {
+            if (taken[i])
+                continue;
+            double gain{ 0.0 };
+            for (int c : views_[i].cells)
+                gain += 1.0 / (1 + heat[c]);
+            // The first pick has no pose distance, it is the view covering the most
+            const double score{ (picked.empty() ? 0.0 : minDist[i]) + cellWeight * gain };
+            if (score > bestScore) {
+                bestScore = score;
+                best = i;
+            }
+        }
+
+        taken[best] = true;
+        picked.push_back(best);
+        for (int c : views_[best].cells)
+            ++heat[c];
+        for (int i{ 0 }; i < n; ++i)
+            if (!taken[i])
+                minDist[i] = std::min(minDist[i], cv::norm(views_[i].pose - views_[best].pose));
+    }
+    return picked;
+}
+
+cv::Mat ViewSelector::coverage(const std::vector<int>& views) const
+{
+    cv::Mat heat = cv::Mat::zeros(grid_, CV_32SC1);
+    int* p = heat.ptr<int>();
+    for (int i : views)
+        for (int c : views_[i].cells)
+            ++p[c];
+    return heat;
+}
+
+double ViewSelector::coveredFraction(const std::vector<int>& views) const
+{
+    return (double)cv::countNonZero(coverage(views)) / grid_.area();
+}
+
+cv::Mat ViewSelector::heatmap(const std::vector<int>& views, const cv::Size& size) const
+{
+    const cv::Mat heat{ coverage(views) };
+    double maxHeat;
+    cv::minMaxLoc(heat, nullptr, &maxHeat);
+    cv::Mat scaled, colour, out;
+    heat.convertTo(scaled, CV_8U, maxHeat > 0 ? 255.0 / maxHeat : 0.0);
+    cv::applyColorMap(scaled, colour, cv::COLORMAP_JET);
+    colour.setTo(cv::Scalar::all(0), heat == 0);
+    cv::resize(colour, out, size, 0, 0, cv::INTER_NEAREST);
+
+    // Cell grid & counts, for reading the map without a legend
+    const double cw{ (double)size.width / grid_.width }, ch{ (double)size.height / grid_.height };
+    for (int y{ 0 }; y < grid_.height; ++y)
+        for (int x{ 0 }; x < grid_.width; ++x) {
+            const cv::Rect cell(cvRound(x * cw), cvRound(y * ch), cvRound((x + 1) * cw) - cvRound(x * cw), cvRound((y + 1) * ch) - cvRound(y * ch));
+            cv::rectangle(out, cell, cv::Scalar::all(64), 1);
+            cv::putText(out, std::to_string(heat.at<int>(y, x)), cell.tl() + cv::Point(4, cell.height / 2 + 5),
+                cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar::all(255), 1, cv::LINE_AA);
+        }
+    return out;
+}
@@ -0,0 +1,58 @@
+/*
+ * view_selection.h
+ * Pose-diversity selection of calibration views
+ *
+ * Describes every view by a cheap pose proxy computed from its detected
+ * board corners alone (board centre, apparent size, foreshortening of
+ * opposite board edges & in-plane rotation) and by the cells of a coarse
+ * image grid its board covers. select() then greedily picks a bounded
+ * subset: each step takes the view that is farthest from the ones already
+ * picked in pose space, plus a bonus for covering cells few picked views
+ * cover yet, so near-duplicate frames are skipped & the image area
+ * (distortion is largest at the border) is filled first.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef VIEW_SELECTION_H
+#define VIEW_SELECTION_H
+
+#include "opencv2/core.hpp"
+#include <vector>
+
+class ViewSelector {
+public:
+    // grid: coverage cells over the image
+    ViewSelector(const cv::Size& imageSize, const cv::Size& boardSize, const cv::Size& grid = cv::Size(16, 12));
+
+    // Detected inner corners of one view (calcChessboardCorners order, CV_32FC2 or CV_64FC2)
+    void add(const cv::Mat& corners);
+    size_t size() const { return views_.size(); }
+
+    // What a new view would add, as scored by select(): pose distance to the closest view added so far
+    // (10 if none) + bonus for the grid cells it covers that few added views cover
+    double novelty(const cv::Mat& corners) const;
+
+    // Indexes of at most maxViews views, in pick order (all views if maxViews <= 0 or >= size())
+    std::vector<int> select(int maxViews) const;
+
+    // Number of views covering each grid cell (CV_32SC1, grid size)
+    cv::Mat coverage(const std::vector<int>& views) const;
+    // Fraction of the grid cells covered by at least one of views
+    double coveredFraction(const std::vector<int>& views) const;
+    // Colour-mapped coverage at the given size, cells no view covers in black
+    cv::Mat heatmap(const std::vector<int>& views, const cv::Size& size) const;
+
+private:
+    struct View {
+        cv::Vec<double, 7> pose; //Weighted: centre x, y, size, 2 x foreshortening, cos & sin roll
+        std::vector<int> cells; //Covered grid cells (y * grid.width + x)
+    };
+
+    View describe(const cv::Mat& corners) const;
+
+    cv::Size imageSize_, boardSize_, grid_;
+    std::vector<View> views_;
+};
+
+#endif
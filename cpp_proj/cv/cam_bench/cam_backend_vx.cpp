@@ -0,0 +1,103 @@
+/*
+ * cam_backend_vx.cpp
+ * VisionWorks (NVXIO) capture backend, only built when VisionWorks is found
+ *
+ * Same frame source & render as visionwork_cam, the overlay goes to the
+ * render's text viewport.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "cam_bench.h"
+
+#include <VX/vx.h>
+
+#include "OVX/FrameSourceOVX.hpp"
+#include "OVX/RenderOVX.hpp"
+#include "OVX/UtilityOVX.hpp"
+
+namespace {
+
+void keyboardEventCallback(void* context, vx_char key, vx_uint32 /*x*/, vx_uint32 /*y*/)
+{
+    static_cast<Controls*>(context)->key(key);
+}
+
+class VxBackend : public CaptureBackend {
+public:
+    VxBackend(const std::string& uri, bool display)
+        : uri_(uri)
+        , display_(display)
+    {
+    }
+
+    ~VxBackend()
+    {
+        if (frame_)
+            vxReleaseImage(&frame_);
+    }
+
+    bool open(const cv::Size& size) override
+    {
+        vxRegisterLogCallback(context_, &ovxio::stdoutLogCallback, vx_false_e);
+
+        source_ = ovxio::createDefaultFrameSource(context_, uri_);
+        config_.frameWidth = size.width;
+        config_.frameHeight = size.height;
+        if (!source_ || !source_->setConfiguration(config_) || !source_->open())
+            return false;
+        config_ = source_->getConfiguration();
+
+        if (display_) {
+            render_ = ovxio::createDefaultRender(context_, "Capture benchmark", config_.frameWidth, config_.frameHeight);
+            if (!render_)
+                return false;
+            render_->setOnKeyboardEventCallback(keyboardEventCallback, &controls_);
+        }
+
+        frame_ = vxCreateImage(context_, config_.frameWidth, config_.frameHeight, config_.format);
+        return vxGetStatus((vx_reference)frame_) == VX_SUCCESS;
+    }
+
+    Status fetch() override
+    {
+        switch (source_->fetch(frame_)) {
+        case ovxio::FrameSource::OK:
+            return OK;
+        case ovxio::FrameSource::TIMEOUT:
+            return TIMEOUT;
+        default:
+            return CLOSED;
+        }
+    }
+
+    bool render(const std::string& overlay) override
+    {
+        if (!render_)
+            return true;
+        const ovxio::Render::TextBoxStyle style = { { 255, 255, 255, 255 }, { 0, 0, 0, 127 }, { 10, 10 } };
+        render_->putImage(frame_);
+        render_->putTextViewport(overlay, style);
+        return render_->flush();
+    }
+
+    cv::Size size() const override { return cv::Size(config_.frameWidth, config_.frameHeight); }
+    double fps() const override { return config_.fps; }
+    std::string name() const override { return "vx:" + uri_; }
+
+private:
+    std::string uri_;
+    bool display_;
+    ovxio::ContextGuard context_; //Released last
+    ovxio::FrameSource::Parameters config_;
+    std::unique_ptr<ovxio::FrameSource> source_;
+    std::unique_ptr<ovxio::Render> render_;
+    vx_image frame_{ nullptr };
+};
+
+} // namespace
+
+std::unique_ptr<CaptureBackend> makeVxBackend(const std::string& source, bool display)
+{
+    return std::unique_ptr<CaptureBackend>(new VxBackend(source, display));
+}
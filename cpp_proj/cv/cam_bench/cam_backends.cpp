@@ -0,0 +1,175 @@
+#include "cam_bench.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char* const window{ "Capture benchmark" };
+
+// Text box in the top left corner, like the NVXIO text viewport
+void drawOverlay(cv::Mat& img, const std::string& overlay)
+{
+    std::vector<std::string> lines;
+    std::istringstream stream(overlay);
+    std::string line;
+    int width{ 0 }, base{ 0 };
+    while (std::getline(stream, line)) {
+        width = std::max(width, cv::getTextSize(line, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &base).width);
+        lines.push_back(line);
+    }
+    const int lineH{ 20 };
+    cv::Rect box(10, 10, width + 20, (int)lines.size() * lineH + 10);
+    box &= cv::Rect(0, 0, img.cols, img.rows);
+    cv::Mat bg = img(box);
+    bg.convertTo(bg, -1, 0.5); //50% black
+    for (size_t i{ 0 }; i < lines.size(); ++i)
+        cv::putText(img, lines[i], cv::Point(20, 10 + (int)(i + 1) * lineH), cv::FONT_HERSHEY_SIMPLEX, 0.5,
+            cv::Scalar(255, 255, 255), 1, cv::LINE_AA);
+}
+
+// Shared by the OpenCV based backends, false once the window was closed
+bool showFrame(cv::Mat& img, const std::string& overlay, bool display, Controls& ctl)
+{
+    if (!display || img.empty())
+        return true;
+    drawOverlay(img, overlay);
+    cv::imshow(window, img);
+    ctl.key(cv::waitKey(1) & 0xff);
+    return cv::getWindowProperty(window, cv::WND_PROP_AUTOSIZE) >= 0;
+}
+
+// CSI camera, the mode is picked by nvarguscamerasrc from the caps. No
+// framerate caps, so the frame rate is not constrained.
+std::string csiPipeline(const cv::Size& size)
+{
+    return "nvarguscamerasrc sensor_id=0 ! video/x-raw(memory:NVMM), width=(int)" + std::to_string(size.width) +
+        ", height=(int)" + std::to_string(size.height) +
+        ", format=(string)NV12 ! nvvidconv ! video/x-raw, format=(string)BGRx ! videoconvert ! "
+        "video/x-raw, format=(string)BGR ! appsink drop=true max-buffers=1";
+}
+
+// OpenCV VideoCapture: "csi", "<N>" V4L2 device, GStreamer pipeline or file
+class CvBackend : public CaptureBackend {
+public:
+    CvBackend(const std::string& source, bool display)
+        : source_(source)
+        , display_(display)
+    {
+    }
+
+    bool open(const cv::Size& size) override
+    {
+        char* end{ nullptr };
+        const long dev{ std::strtol(source_.c_str(), &end, 10) };
+        if (source_ == "csi")
+            cap_.open(csiPipeline(size), cv::CAP_GSTREAMER);
+        else if (!source_.empty() && *end == '\0') {
+            cap_.open((int)dev);
+            cap_.set(cv::CAP_PROP_FRAME_WIDTH, size.width);
+            cap_.set(cv::CAP_PROP_FRAME_HEIGHT, size.height);
+        }
+        else if (!cap_.open(source_, cv::CAP_GSTREAMER))
+            cap_.open(source_);
+        if (!cap_.isOpened())
+            return false;
+
+        const int w{ (int)cap_.get(cv::CAP_PROP_FRAME_WIDTH) }, h{ (int)cap_.get(cv::CAP_PROP_FRAME_HEIGHT) };
+        size_ = (w > 0 && h > 0) ? cv::Size(w, h) : size;
+        fps_ = cap_.get(cv::CAP_PROP_FPS);
+        return true;
+    }
+
+    Status fetch() override { return cap_.read(frame_) ? OK : CLOSED; }
+    bool render(const std::string& overlay) override { return showFrame(frame_, overlay, display_, controls_); }
+    cv::Size size() const override { return size_; }
+    double fps() const override { return fps_ > 0 ? fps_ : 0.0; }
+    std::string name() const override { return "cv:" + source_; }
+
+private:
+    std::string source_;
+    bool display_;
+    cv::VideoCapture cap_;
+    cv::Mat frame_;
+    cv::Size size_;
+    double fps_{ 0.0 };
+};
+
+// Moving pattern, fps <= 0 runs unthrottled
+class SyntheticBackend : public CaptureBackend {
+public:
+    SyntheticBackend(double fps, bool display)
+        : fps_(fps)
+        , display_(display)
+    {
+    }
+
+    bool open(const cv::Size& size) override
+    {
+        // Gradient + checkerboard, 2x wide/high, frames are shifted ROIs of it
+        size_ = size;
+        pattern_.create(size.height * 2, size.width * 2, CV_8UC3);
+        for (int y{ 0 }; y < pattern_.rows; ++y) {
+            cv::Vec3b* row = pattern_.ptr<cv::Vec3b>(y);
+            for (int x{ 0 }; x < pattern_.cols; ++x) {
+                const uchar g = ((x / 32 + y / 32) & 1) ? 200 : 55;
+                row[x] = cv::Vec3b((uchar)x, g, (uchar)y);
+            }
+        }
+        next_ = Clock::now();
+        return true;
+    }
+
+    Status fetch() override
+    {
+        if (fps_ > 0) {
+            next_ += std::chrono::microseconds((long)(1e6 / fps_));
+            std::this_thread::sleep_until(next_);
+        }
+        const int ox{ (int)(frame_idx_ * 3 % size_.width) }, oy{ (int)(frame_idx_ * 2 % size_.height) };
+        pattern_(cv::Rect(ox, oy, size_.width, size_.height)).copyTo(frame_); //In place after the 1st frame
+        ++frame_idx_;
+        return OK;
+    }
+
+    bool render(const std::string& overlay) override { return showFrame(frame_, overlay, display_, controls_); }
+    cv::Size size() const override { return size_; }
+    double fps() const override { return fps_ > 0 ? fps_ : 0.0; }
+    std::string name() const override { return "synth"; }
+
+private:
+    double fps_;
+    bool display_;
+    cv::Size size_;
+    cv::Mat pattern_, frame_;
+    long frame_idx_{ 0 };
+    Clock::time_point next_;
+};
+
+} // namespace
+
+bool parseResolution(const std::string& resolution, cv::Size& size)
+{
+    for (const char* mode : cam_modes)
+        if (resolution == mode) {
+            std::istringstream stream(resolution);
+            char x;
+            return (stream >> size.width >> x >> size.height) && x == 'x';
+        }
+    return false;
+}
+
+std::unique_ptr<CaptureBackend> makeBackend(const std::string& backend, const std::string& source, bool display)
+{
+    if (backend == "cv")
+        return std::unique_ptr<CaptureBackend>(new CvBackend(source.empty() ? "csi" : source, display));
+    if (backend == "synth")
+        return std::unique_ptr<CaptureBackend>(new SyntheticBackend(atof(source.c_str()), display));
+#ifdef WITH_VISIONWORKS
+    if (backend == "vx")
+        return makeVxBackend(source.empty() ? "device:///nvcamera" : source, display);
+#endif
+    return nullptr;
+}
@@ -0,0 +1,134 @@
+/*
+ * cam_bench.cpp
+ * Capture benchmark across capture backends, in the visionwork_cam modes
+ *
+ * Every frame, the fetch & render latencies & the frame period are added
+ * to histograms, which are printed on pause & at exit instead of a report
+ * per frame. The overlay shows the running percentiles.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "cam_bench.h"
+#include "latency_histogram.h"
+
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+static double ms(Clock::time_point a, Clock::time_point b)
+{
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static void printReport(const CaptureBackend& cam, const LatencyHistogram& fetch,
+    const LatencyHistogram& render, const LatencyHistogram& period, long timeouts)
+{
+    std::cout << "\n[" << cam.name() << " " << cam.size().width << "x" << cam.size().height << "]  timeouts: " << timeouts << "\n";
+    fetch.print(std::cout, "Fetch");
+    render.print(std::cout, "Render");
+    period.print(std::cout, "Frame period");
+    std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+        return err((std::string) "\nUsage: " + argv[0] + "  [cv|synth|vx]  [RESOLUTION (1280x720)]  [DURATION (s, 0: until Esc)]  [DISPLAY (0|1, 1)]  [SOURCE]\n", 1);
+
+    const std::string backendName{ argv[1] };
+    cv::Size size(1280, 720);
+    if (argc > 2 && !parseResolution(argv[2], size)) {
+        std::string modes;
+        for (const char* m : cam_modes)
+            modes += (std::string) " " + m;
+        return err("\nInvalid resolution, use one of:" + modes + "\n", 2);
+    }
+    const double duration{ argc > 3 ? atof(argv[3]) : 0.0 };
+    const bool display{ argc > 4 ? atoi(argv[4]) != 0 : true };
+    const std::string source{ argc > 5 ? argv[5] : "" };
+    if (!display && duration <= 0)
+        return err("\n[DURATION] has to be > 0 without display!\n", 2);
+
+    std::unique_ptr<CaptureBackend> cam = makeBackend(backendName, source, display);
+    if (!cam)
+        return err("\nUnknown backend: " + backendName + " (VisionWorks: " +
+#ifdef WITH_VISIONWORKS
+                "yes"
+#else
+                "no"
+#endif
+                + ")\n",
+            2);
+    if (!cam->open(size))
+        return err("Error: cannot open source!", -1);
+    size = cam->size();
+
+    std::cout << "Running with OpenCV Version: " << CV_VERSION << "\n"
+              << "\n[CONFIG]\nBackend:\t" << cam->name() << "\nCamera mode:\t" << size.width << "x" << size.height
+              << " " << cam->fps() << " FPS\nDuration (s):\t" << (duration > 0 ? std::to_string(duration) : "until Esc")
+              << "\nDisplay:\t" << (display ? "on" : "off") << "\n"
+              << (display ? "\nSpace - pause/resume\nEsc - close\n" : "") << std::endl;
+
+    LatencyHistogram hFetch, hRender, hPeriod;
+    Controls& ctl = cam->controls();
+    long timeouts{ 0 };
+    bool paused{ false };
+    Clock::time_point tPrev; //Last frame, reset by a pause so it is not counted
+    const Clock::time_point tStart{ Clock::now() };
+
+    while (ctl.alive) {
+        if (duration > 0 && ms(tStart, Clock::now()) >= duration * 1000.0)
+            break;
+
+        if (ctl.pause != paused) {
+            paused = ctl.pause;
+            tPrev = Clock::time_point();
+            if (paused)
+                printReport(*cam, hFetch, hRender, hPeriod, timeouts);
+        }
+
+        const Clock::time_point t0{ Clock::now() };
+        CaptureBackend::Status status{ CaptureBackend::OK };
+        if (!paused)
+            status = cam->fetch();
+        const Clock::time_point t1{ Clock::now() };
+        if (status == CaptureBackend::CLOSED)
+            break;
+        if (status == CaptureBackend::TIMEOUT) {
+            ++timeouts;
+            continue;
+        }
+
+        char txt[256];
+        snprintf(txt, sizeof(txt), "Camera mode: %dx%d %.0f FPS\nBackend: %s\nFetch p50/p99: %.2f / %.2f ms\n"
+                                   "Render p50/p99: %.2f / %.2f ms\nPeriod p50: %.2f ms (%.1f FPS)\n%s\nSpace - pause/resume\nEsc - close",
+            size.width, size.height, cam->fps(), cam->name().c_str(), hFetch.percentile(50), hFetch.percentile(99),
+            hRender.percentile(50), hRender.percentile(99), hPeriod.percentile(50),
+            hPeriod.count() ? 1000.0 / hPeriod.percentile(50) : 0.0, paused ? "PAUSED" : "FRAME RATE IS NOT CONSTRAINED");
+
+        const Clock::time_point t2{ Clock::now() };
+        if (!cam->render(txt))
+            ctl.alive = false;
+        const Clock::time_point t3{ Clock::now() };
+
+        if (paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        hFetch.add(ms(t0, t1));
+        hRender.add(ms(t2, t3));
+        if (tPrev != Clock::time_point())
+            hPeriod.add(ms(tPrev, t0));
+        tPrev = t0;
+    }
+
+    printReport(*cam, hFetch, hRender, hPeriod, timeouts);
+    return 0;
+}
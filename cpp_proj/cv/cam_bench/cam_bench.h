@@ -0,0 +1,75 @@
+/*
+ * cam_bench.h
+ * Capture backends for the capture benchmark
+ *
+ * A backend fetches frames in one of the camera modes into its own buffer &
+ * renders the last one with a text overlay. The benchmark loop times fetch()
+ * & render() the same way for every backend: OpenCV (GStreamer / V4L2 /
+ * file), synthetic frames & VisionWorks (NVXIO) when it is available.
+ * Space (pause/resume) & Esc (exit) are handled by the backend's window.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef CAM_BENCH_H
+#define CAM_BENCH_H
+
+#include <opencv2/opencv.hpp>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+typedef std::chrono::steady_clock Clock;
+
+// Camera modes of visionwork_cam
+const char* const cam_modes[] = { "3264x1848", "1920x1080", "1280x720", "640x480" };
+
+// Only accepts one of cam_modes
+bool parseResolution(const std::string& resolution, cv::Size& size);
+
+// Set by the window's key events
+struct Controls {
+    bool alive{ true };
+    bool pause{ false };
+
+    void key(int k)
+    {
+        if (k == 27) //Escape
+            alive = false;
+        else if (k == 32) //Space
+            pause = !pause;
+    }
+};
+
+class CaptureBackend {
+public:
+    enum Status { OK, TIMEOUT, CLOSED };
+
+    virtual ~CaptureBackend() {}
+    virtual bool open(const cv::Size& size) = 0;
+    // Next frame, into the backend's buffer
+    virtual Status fetch() = 0;
+    // Show the last frame with the overlay (one line per '\n'), false once the
+    // window is gone. Without display only the key events are polled.
+    virtual bool render(const std::string& overlay) = 0;
+    // Mode negotiated with the source, may differ from the requested one
+    virtual cv::Size size() const = 0;
+    virtual double fps() const { return 0.0; } //0: unknown / unthrottled
+    virtual std::string name() const = 0;
+
+    Controls& controls() { return controls_; }
+
+protected:
+    Controls controls_;
+};
+
+// Backend from cmd line: "cv" (source "csi" / "<N>" V4L2 device / pipeline / file),
+// "synth" (source: fps, 0 unthrottled) or "vx" (source: NVXIO uri). Null if unknown.
+std::unique_ptr<CaptureBackend> makeBackend(const std::string& backend, const std::string& source, bool display);
+
+#ifdef WITH_VISIONWORKS
+std::unique_ptr<CaptureBackend> makeVxBackend(const std::string& source, bool display);
+#endif
+
+#endif
@@ -1,6 +1,8 @@
 // #include <iostream>
 #include <opencv2/opencv.hpp>
 
+#include "stereo_canvas.h"
+
 using namespace cv;
 
 std::string gstreamer_pipeline(int cam_id, int capture_width, int capture_height, int display_width, int display_height, int framerate, int flip_method, std::string outputFormat) {
@@ -62,18 +64,16 @@ int main() {
 
   namedWindow("Cam", WINDOW_AUTOSIZE);
 
-  Mat imgL;
-  Mat imgR;
+  StereoCanvas canvas; //Both feeds are read straight into their half
 
 
   std::cout << "Hit ESC to exit" << "\n";
   while (true) {
-    if (!capL.read(imgL) || !capR.read(imgR)) {
+    if (!capL.read(canvas.left()) || !capR.read(canvas.right())) {
       std::cout << "Capture read error" << std::endl;
       break;
     }
-    hconcat(imgL, imgR, imgL); //Syntax-> hconcat(source1,source2,destination);
-    imshow("Cam", imgL);
+    imshow("Cam", canvas.compose()); //No copy once the canvas is allocated
 
     int keycode = waitKey(30) & 0xff;
     if (keycode == 27) break;
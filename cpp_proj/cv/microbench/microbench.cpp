@@ -0,0 +1,475 @@
+/*
+ * microbench.cpp
+ * Microbenchmarks of the hot kernels of the projects, with JSON results
+ *
+ * Inputs are synthetic & generated from a fixed seed at 640x480, 1280x720
+ * & 1920x1080, so every run sees the same pixels. Each case is warmed up,
+ * then repeated until MIN_TIME has passed (at least MIN_ITERS times); the
+ * per iteration latencies are summarised in the JSON (cv::FileStorage),
+ * along with the OpenCV version, threads & SIMD path of the build.
+ * --compare reports the p50 change of each case between 2 result files &
+ * fails if one got slower than TOLERANCE, to catch regressions after an
+ * OpenCV upgrade or a change of our own code.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/ccalib/omnidir.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/ximgproc.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "detector_session.h"
+#include "latency_histogram.h"
+#include "marker_renderer.h"
+#include "pyramid_cpu.h"
+
+// Runs
+#define SEED 0x5eed
+#define WARMUP_ITERS 2
+#define MIN_ITERS 5
+#define MAX_ITERS 2000
+#define MIN_TIME 0.5 //s per case, overridden from the command line
+#define TOLERANCE 10.0 //% p50 slowdown reported as a regression by --compare
+
+// Inputs
+#define OVERLAY_POINTS 500
+#define BOARD_SIZE cv::Size(9, 6) //Inner corners
+
+// Same settings as the tools
+#define FAST_EPSILON (30.0f) //vfast_img / vfast_vid
+#define FAST_MIN_ARC_LENGTH 10
+#define FAST_SCORE vilib::SUM_OF_ABS_DIFF_ON_ARC
+#define CELL_SIZE 32
+#define SGBM_NUM_DISPARITIES (16 * 15) //omni_rectify_stereo
+#define SGBM_WIN_SIZE 9
+#define HOUGH_MEDIAN_SIZE 31 //hough_circle
+#define HOUGH_THRESHOLD_BLOCK 191
+#define HOUGH_DILATE_SIZE 5
+
+typedef std::chrono::steady_clock Clock;
+
+const cv::Size sizes[] = { cv::Size(640, 480), cv::Size(1280, 720), cv::Size(1920, 1080) };
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+// === INPUTS ===
+
+struct Inputs {
+    cv::Mat bgr, gray, yuv; //Textured scene with shapes
+    cv::Mat left, right; //Rectified BGR stereo pair of the scene, 8 - 56 px disparity
+    cv::Mat board; //Chessboard under perspective, grayscale
+    std::vector<cv::Point2f> points; //Overlay marker positions
+};
+
+// Smooth random texture, random shapes (incl. large circles for Hough) & noise
+static void makeScene(const cv::Size& size, cv::RNG& rng, cv::Mat& bgr)
+{
+    cv::Mat low(size.height / 8, size.width / 8, CV_8UC3);
+    rng.fill(low, cv::RNG::UNIFORM, 0, 256);
+    cv::resize(low, bgr, size, 0, 0, cv::INTER_CUBIC);
+
+    const int minSide{ std::min(size.width, size.height) };
+    for (int i{ 0 }; i < 40; ++i) {
+        const cv::Scalar c(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        const cv::Point p(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        switch (i % 4) {
+        case 0:
+            cv::circle(bgr, p, rng.uniform(minSide / 8, minSide / 3), c, 6, cv::LINE_AA);
+            break;
+        case 1:
+            cv::circle(bgr, p, rng.uniform(5, minSide / 10), c, -1, cv::LINE_AA);
+            break;
+        case 2:
+            cv::rectangle(bgr, cv::Rect(p.x, p.y, rng.uniform(10, minSide / 4), rng.uniform(10, minSide / 4)), c, -1);
+            break;
+        default:
+            cv::line(bgr, p, cv::Point(rng.uniform(0, size.width), rng.uniform(0, size.height)), c, 3, cv::LINE_AA);
+        }
+    }
+    cv::Mat noise(size, CV_8UC3);
+    rng.fill(noise, cv::RNG::NORMAL, 0, 5);
+    cv::add(bgr, noise, bgr, cv::noArray(), CV_8UC3);
+}
+
+// right(x) = left(x + d), d smoothly varying over the image
+static void makeStereo(const cv::Mat& left, cv::Mat& right)
+{
+    cv::Mat mapX(left.size(), CV_32FC1), mapY(left.size(), CV_32FC1);
+    for (int y{ 0 }; y < left.rows; ++y) {
+        float* mx = mapX.ptr<float>(y);
+        float* my = mapY.ptr<float>(y);
+        for (int x{ 0 }; x < left.cols; ++x) {
+            const float d{ 8.0f + 24.0f * (1.0f + std::sin(3.0f * x / left.cols + 2.0f * y / left.rows)) };
+            mx[x] = x + d;
+            my[x] = (float)y;
+        }
+    }
+    cv::remap(left, right, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_REFLECT);
+}
+
+// Chessboard with BOARD_SIZE inner corners, slightly tilted, blurred & noisy
+static void makeBoard(const cv::Size& size, cv::RNG& rng, cv::Mat& board)
+{
+    const int sq{ std::min(size.width, size.height) / 12 };
+    const cv::Size cells(BOARD_SIZE.width + 1, BOARD_SIZE.height + 1);
+    cv::Mat flat(size, CV_8UC1, cv::Scalar(255));
+    const cv::Point o((size.width - cells.width * sq) / 2, (size.height - cells.height * sq) / 2);
+    for (int y{ 0 }; y < cells.height; ++y)
+        for (int x{ 0 }; x < cells.width; ++x)
+            if ((x + y) & 1)
+                flat(cv::Rect(o.x + x * sq, o.y + y * sq, sq, sq)).setTo(cv::Scalar(0));
+
+    const float w{ (float)size.width }, h{ (float)size.height };
+    const cv::Point2f src[4] = { { 0, 0 }, { w, 0 }, { w, h }, { 0, h } };
+    const cv::Point2f dst[4] = { { 0.05f * w, 0.02f * h }, { 0.93f * w, 0.08f * h }, { 0.97f * w, 0.95f * h }, { 0.02f * w, 0.9f * h } };
+    cv::warpPerspective(flat, board, cv::getPerspectiveTransform(src, dst), size, cv::INTER_LINEAR,
+        cv::BORDER_CONSTANT, cv::Scalar(200));
+    cv::GaussianBlur(board, board, cv::Size(3, 3), 0);
+    cv::Mat noise(size, CV_8UC1);
+    rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+    cv::add(board, noise, board, cv::noArray(), CV_8UC1);
+}
+
+static Inputs makeInputs(const cv::Size& size)
+{
+    cv::RNG rng(SEED);
+    Inputs in;
+    makeScene(size, rng, in.bgr);
+    cv::cvtColor(in.bgr, in.gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(in.bgr, in.yuv, cv::COLOR_BGR2YUV_I420);
+    in.left = in.bgr;
+    makeStereo(in.left, in.right);
+    makeBoard(size, rng, in.board);
+    for (int i{ 0 }; i < OVERLAY_POINTS; ++i)
+        in.points.push_back(cv::Point2f(rng.uniform(0.f, (float)size.width), rng.uniform(0.f, (float)size.height)));
+    return in;
+}
+
+// === RUNNER ===
+
+struct Result {
+    std::string name;
+    cv::Size size;
+    LatencyHistogram ms;
+};
+
+class Runner {
+public:
+    Runner(const std::string& filter, double min_time)
+        : filter_(filter)
+        , min_time_(min_time)
+    {
+    }
+
+    // Times fn, unless the case name doesn't contain the filter
+    void run(const std::string& name, const cv::Size& size, const std::function<void()>& fn)
+    {
+        if (!filter_.empty() && name.find(filter_) == std::string::npos)
+            return;
+        for (int i{ 0 }; i < WARMUP_ITERS; ++i)
+            fn();
+
+        Result r{ name, size, LatencyHistogram(0.001, 100000.0, 16) };
+        const Clock::time_point start{ Clock::now() };
+        double elapsed{ 0.0 };
+        while (r.ms.count() < MIN_ITERS || (elapsed < min_time_ && r.ms.count() < MAX_ITERS)) {
+            const Clock::time_point t0{ Clock::now() };
+            fn();
+            const Clock::time_point t1{ Clock::now() };
+            r.ms.add(std::chrono::duration<double, std::milli>(t1 - t0).count());
+            elapsed = std::chrono::duration<double>(t1 - start).count();
+        }
+        printf("%-28s %5dx%-5d %8zu %10.3f %10.3f %10.3f %10.3f\n", name.c_str(), size.width, size.height,
+            r.ms.count(), r.ms.min(), r.ms.percentile(50), r.ms.percentile(99), r.ms.mean());
+        fflush(stdout);
+        results_.push_back(r);
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+private:
+    std::string filter_;
+    double min_time_;
+    std::vector<Result> results_;
+};
+
+// === CASES ===
+
+static void benchColor(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    cv::Mat out;
+    r.run("cvt_bgr2gray", size, [&]() { cv::cvtColor(in.bgr, out, cv::COLOR_BGR2GRAY); });
+    r.run("cvt_yuv2bgr_i420", size, [&]() { cv::cvtColor(in.yuv, out, cv::COLOR_YUV2BGR_I420); });
+    r.run("cvt_yuv2gray_i420", size, [&]() { cv::cvtColor(in.yuv, out, cv::COLOR_YUV2GRAY_I420); });
+}
+
+// omni_rectify: perspective rectification of a Mei model camera
+static void benchOmnidir(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    const double f{ 0.3 * size.width };
+    const cv::Matx33d K(f, 0, size.width / 2.0, 0, f, size.height / 2.0, 0, 0, 1);
+    const cv::Matx14d D(-0.2, 0.05, 0.0, 0.0);
+    const cv::Mat xi = (cv::Mat_<double>(1, 1) << 1.0);
+    const double zoomOut{ 3.0 }, aspectRatio{ 1.7 };
+    const cv::Matx33d Knew(size.width / (aspectRatio * zoomOut), 0, size.width / 2.0,
+        0, size.height / zoomOut, size.height / 2.0, 0, 0, 1);
+    const int flags{ cv::omnidir::RECTIFY_PERSPECTIVE };
+
+    cv::Mat map1, map2, out;
+    r.run("omnidir_init_map", size, [&]() {
+        cv::omnidir::initUndistortRectifyMap(K, D, xi, cv::Matx33d::eye(), Knew, size, CV_16SC2, map1, map2, flags);
+    });
+    cv::omnidir::initUndistortRectifyMap(K, D, xi, cv::Matx33d::eye(), Knew, size, CV_16SC2, map1, map2, flags);
+    r.run("omnidir_remap", size, [&]() { cv::remap(in.bgr, out, map1, map2, cv::INTER_LINEAR); });
+    r.run("omnidir_undistort_image", size, [&]() {
+        cv::omnidir::undistortImage(in.bgr, out, K, D, xi, flags, Knew, size);
+    });
+}
+
+// omni_calib / omni_calib_stereo: corners found, & the no board path
+static void benchChessboard(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    std::vector<cv::Point2f> corners;
+    r.run("chessboard_find", size, [&]() { cv::findChessboardCorners(in.board, BOARD_SIZE, corners); });
+    r.run("chessboard_find_empty", size, [&]() { cv::findChessboardCorners(in.gray, BOARD_SIZE, corners); });
+
+    std::vector<cv::Point2f> found;
+    if (!cv::findChessboardCorners(in.board, BOARD_SIZE, found))
+        return;
+    const cv::TermCriteria crit(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.1);
+    r.run("chessboard_subpix", size, [&]() {
+        corners = found;
+        cv::cornerSubPix(in.board, corners, cv::Size(11, 11), cv::Size(-1, -1), crit);
+    });
+}
+
+// hough_circle stages, radius range scaled to the synthetic circles
+static void benchHough(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    cv::Mat blur, thr, dil;
+    const cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+        cv::Size(2 * HOUGH_DILATE_SIZE + 1, 2 * HOUGH_DILATE_SIZE + 1), cv::Point(HOUGH_DILATE_SIZE, HOUGH_DILATE_SIZE));
+    r.run("hough_median_blur", size, [&]() { cv::medianBlur(in.gray, blur, HOUGH_MEDIAN_SIZE); });
+    cv::medianBlur(in.gray, blur, HOUGH_MEDIAN_SIZE);
+    r.run("hough_adaptive_threshold", size, [&]() {
+        cv::adaptiveThreshold(blur, thr, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, HOUGH_THRESHOLD_BLOCK, 0);
+    });
+    cv::adaptiveThreshold(blur, thr, 255, cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, HOUGH_THRESHOLD_BLOCK, 0);
+    r.run("hough_dilate", size, [&]() { cv::dilate(thr, dil, element); });
+    cv::dilate(thr, dil, element);
+
+    std::vector<cv::Vec3f> circles;
+    r.run("hough_circles", size, [&]() {
+        cv::HoughCircles(dil, circles, cv::HOUGH_GRADIENT, 1, size.height / 20, 100, 30, size.height / 8, size.height / 3);
+    });
+}
+
+// omni_rectify_stereo: SGBM, right matcher & WLS filter
+static void benchStereo(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    const int cn{ in.left.channels() };
+    cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(0, SGBM_NUM_DISPARITIES, SGBM_WIN_SIZE);
+    sgbm->setMinDisparity(-10);
+    sgbm->setPreFilterCap(30);
+    sgbm->setP1(8 * cn * SGBM_WIN_SIZE * SGBM_WIN_SIZE);
+    sgbm->setP2(32 * cn * SGBM_WIN_SIZE * SGBM_WIN_SIZE);
+    sgbm->setMode(cv::StereoSGBM::MODE_SGBM);
+    cv::Ptr<cv::ximgproc::DisparityWLSFilter> wls = cv::ximgproc::createDisparityWLSFilter(sgbm);
+    cv::Ptr<cv::StereoMatcher> rightMatcher = cv::ximgproc::createRightMatcher(sgbm);
+
+    cv::Mat dispL, dispR, filtered;
+    r.run("sgbm_left", size, [&]() { sgbm->compute(in.left, in.right, dispL); });
+    r.run("sgbm_right_matcher", size, [&]() { rightMatcher->compute(in.right, in.left, dispR); });
+    sgbm->compute(in.left, in.right, dispL);
+    rightMatcher->compute(in.right, in.left, dispR);
+    r.run("wls_filter", size, [&]() { wls->filter(dispL, in.left, filtered, dispR); });
+}
+
+// vfast_img / vfast_vid detector, CPU backend (& GPU when built with vilib)
+static void benchFast(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    HalfSamplePyramid pyr;
+    r.run("pyramid_half_sample_3", size, [&]() { pyr.build(in.gray, 3); });
+
+    for (int levels : { 1, 3 }) {
+        DetectorParams p;
+        p.pyramid_levels = levels;
+        p.min_level = 0;
+        p.max_level = levels;
+        p.threshold = FAST_EPSILON;
+        p.min_arc_length = FAST_MIN_ARC_LENGTH;
+        p.score = FAST_SCORE;
+        p.horizontal_border = p.vertical_border = 0;
+        p.cell_size_width = p.cell_size_height = CELL_SIZE;
+        p.per_level_grid = true;
+        p.adaptive_threshold = false;
+        p.cell_target = 4.0f;
+        p.max_keypoints = 0;
+
+        KeypointBuffer kps;
+        std::vector<DetectorBackend> backends{ DetectorBackend::CPU };
+        if (DetectorSession::hasGPU())
+            backends.push_back(DetectorBackend::GPU);
+        for (DetectorBackend b : backends) {
+            DetectorSession session(b, p);
+            const std::string name{ std::string("fast_") + (b == DetectorBackend::GPU ? "gpu" : "cpu") + "_l" + std::to_string(levels) };
+            r.run(name, size, [&]() { session.detect(in.gray, kps); });
+        }
+    }
+}
+
+// Annotation overlays: per point circles vs batched sprites, & text
+static void benchOverlay(Runner& r, const Inputs& in, const cv::Size& size)
+{
+    cv::Mat canvas = in.bgr.clone();
+    r.run("overlay_circles", size, [&]() {
+        for (const cv::Point2f& p : in.points)
+            cv::circle(canvas, cv::Point(cvRound(p.x * 1024), cvRound(p.y * 1024)), 3 * 1024, cv::Scalar(0, 255, 0), 1, cv::LINE_AA, 10);
+    });
+    MarkerRenderer markers;
+    const int style{ markers.style(3, cv::Scalar(0, 255, 0)) };
+    r.run("overlay_markers", size, [&]() {
+        for (const cv::Point2f& p : in.points)
+            markers.add(p.x, p.y, style);
+        markers.render(canvas);
+    });
+    r.run("overlay_text", size, [&]() {
+        for (int i{ 0 }; i < 4; ++i)
+            cv::putText(canvas, "FPS: 30 Keypoints: 500", cv::Point(10, 30 + 20 * i), cv::FONT_HERSHEY_COMPLEX_SMALL,
+                0.8, cv::Scalar(0, 200, 250), 1, cv::LINE_AA);
+    });
+}
+
+// === RESULTS ===
+
+static std::string timestamp()
+{
+    char buf[32];
+    const std::time_t now{ std::time(nullptr) };
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    return buf;
+}
+
+static bool writeJson(const std::string& path, const std::vector<Result>& results, double min_time)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE | cv::FileStorage::FORMAT_JSON);
+    if (!fs.isOpened())
+        return false;
+    fs << "date" << timestamp() << "opencv_version" << CV_VERSION << "threads" << cv::getNumThreads()
+       << "simd" << HalfSamplePyramid::simd() << "gpu" << (int)DetectorSession::hasGPU()
+       << "seed" << SEED << "min_time" << min_time;
+    fs << "results"
+       << "[";
+    for (const Result& r : results) {
+        fs << "{"
+           << "name" << r.name << "width" << r.size.width << "height" << r.size.height
+           << "iterations" << (int)r.ms.count() << "min_ms" << r.ms.min() << "mean_ms" << r.ms.mean()
+           << "stddev_ms" << r.ms.stddev() << "p50_ms" << r.ms.percentile(50) << "p90_ms" << r.ms.percentile(90)
+           << "p99_ms" << r.ms.percentile(99) << "max_ms" << r.ms.max() << "}";
+    }
+    fs << "]";
+    return true;
+}
+
+// name@WxH -> p50 (ms)
+static bool readP50(const std::string& path, std::map<std::string, double>& p50, std::vector<std::string>& order)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened())
+        return false;
+    const cv::FileNode results = fs["results"];
+    if (results.type() != cv::FileNode::SEQ)
+        return false;
+    for (cv::FileNodeIterator it = results.begin(); it != results.end(); ++it) {
+        const std::string key{ (std::string)(*it)["name"] + "@" + std::to_string((int)(*it)["width"]) + "x" +
+            std::to_string((int)(*it)["height"]) };
+        p50[key] = (double)(*it)["p50_ms"];
+        order.push_back(key);
+    }
+    return true;
+}
+
+static int compare(const std::string& basePath, const std::string& newPath, double tolerance)
+{
+    std::map<std::string, double> base, cur;
+    std::vector<std::string> baseOrder, order;
+    if (!readP50(basePath, base, baseOrder))
+        return err("Could not read results: " + basePath, -1);
+    if (!readP50(newPath, cur, order))
+        return err("Could not read results: " + newPath, -1);
+
+    int regressions{ 0 };
+    printf("%-40s %12s %12s %9s\n", "case", "base_p50", "new_p50", "change");
+    for (const std::string& key : order) {
+        auto b = base.find(key);
+        if (b == base.end()) {
+            printf("%-40s %12s %12.3f %9s\n", key.c_str(), "-", cur[key], "new");
+            continue;
+        }
+        const double change{ b->second > 0 ? 100.0 * (cur[key] - b->second) / b->second : 0.0 };
+        const bool slower{ change > tolerance };
+        regressions += slower;
+        printf("%-40s %12.3f %12.3f %+8.1f%%%s\n", key.c_str(), b->second, cur[key], change, slower ? "  REGRESSION" : "");
+    }
+    for (const std::string& key : baseOrder)
+        if (!cur.count(key))
+            printf("%-40s %12.3f %12s %9s\n", key.c_str(), base[key], "-", "missing");
+
+    std::cout << "\n" << regressions << " case(s) slower than " << tolerance << "%" << std::endl;
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "--compare") {
+        if (argc < 4)
+            return err((std::string) "\nUsage: " + argv[0] + " --compare  [BASE_JSON]  [NEW_JSON]  [TOLERANCE (%, 10)]\n", 1);
+        return compare(argv[2], argv[3], argc > 4 ? atof(argv[4]) : TOLERANCE);
+    }
+    if (argc > 1 && argv[1][0] == '-')
+        return err((std::string) "\nUsage: " + argv[0] + "  [OUT_JSON (microbench.json)]  [FILTER (case name substring)]  [MIN_TIME (s, 0.5)]\n" +
+                "       " + argv[0] + " --compare  [BASE_JSON]  [NEW_JSON]  [TOLERANCE (%, 10)]\n",
+            1);
+
+    const std::string outPath{ argc > 1 ? argv[1] : "microbench.json" };
+    const std::string filter{ argc > 2 ? argv[2] : "" };
+    const double minTime{ argc > 3 ? atof(argv[3]) : MIN_TIME };
+
+    std::cout << "Running with OpenCV Version: " << CV_VERSION << "\nThreads: " << cv::getNumThreads()
+              << "\nFAST / pyramid SIMD: " << HalfSamplePyramid::simd() << "\n"
+              << std::endl;
+    printf("%-28s %11s %8s %10s %10s %10s %10s\n", "case", "size", "iters", "min_ms", "p50_ms", "p99_ms", "mean_ms");
+
+    Runner runner(filter, minTime);
+    for (const cv::Size& size : sizes) {
+        const Inputs in{ makeInputs(size) };
+        benchColor(runner, in, size);
+        benchOmnidir(runner, in, size);
+        benchChessboard(runner, in, size);
+        benchHough(runner, in, size);
+        benchStereo(runner, in, size);
+        benchFast(runner, in, size);
+        benchOverlay(runner, in, size);
+    }
+
+    if (!writeJson(outPath, runner.results(), minTime))
+        return err("Could not write results: " + outPath, -1);
+    std::cout << "\nResults written to " << outPath << std::endl;
+    return 0;
+}
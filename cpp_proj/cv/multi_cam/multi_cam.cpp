@@ -0,0 +1,209 @@
+#include "multi_cam.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// === SOURCES ===
+
+std::string gstreamer_pipeline(int cam_id, int s_mode, int display_width, int display_height,
+    int framerate, int flip_method, const std::string& outputFormat)
+{
+    return "nvarguscamerasrc sensor_id=" + std::to_string(cam_id) +
+        " sensor_mode=" + std::to_string(s_mode) +
+        " ! video/x-raw(memory:NVMM), format=(string)NV12, "
+        "framerate=(fraction)" +
+        std::to_string(framerate) + "/1 ! nvvidconv flip-method=" +
+        std::to_string(flip_method) + " ! video/x-raw, width=(int)" +
+        std::to_string(display_width) + ", height=(int)" +
+        std::to_string(display_height) +
+        ", format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)" +
+        outputFormat + " ! appsink drop=true max-buffers=1";
+}
+
+bool CaptureSource::open()
+{
+    return cap_.open(pipeline_, cv::CAP_GSTREAMER) || cap_.open(pipeline_);
+}
+
+bool SyntheticSource::open()
+{
+    // Gradient + grid, distinct per id so tiles are distinguishable
+    pattern_.create(size_.height * 2, size_.width * 2, CV_8UC3);
+    for (int y{ 0 }; y < pattern_.rows; ++y) {
+        cv::Vec3b* row = pattern_.ptr<cv::Vec3b>(y);
+        for (int x{ 0 }; x < pattern_.cols; ++x) {
+            uchar g = ((x / 32 + y / 32) & 1) ? 200 : 55;
+            row[x] = cv::Vec3b((uchar)(x + 40 * id_), g, (uchar)(y - 40 * id_));
+        }
+    }
+    next_ = Clock::now();
+    return true;
+}
+
+bool SyntheticSource::read(cv::Mat& img)
+{
+    if (fps_ > 0) {
+        next_ += std::chrono::microseconds((long)(1e6 / fps_));
+        std::this_thread::sleep_until(next_);
+    }
+    int ox = (int)(frame_ * 3 % size_.width);
+    int oy = (int)(frame_ * 2 % size_.height);
+    pattern_(cv::Rect(ox, oy, size_.width, size_.height)).copyTo(img); //In place after 1st frame
+    ++frame_;
+    return true;
+}
+
+std::unique_ptr<FrameSource> makeSource(const std::string& spec, int idx, cv::Size size, int framerate)
+{
+    char* end{ nullptr };
+    long sensor = std::strtol(spec.c_str(), &end, 10);
+    if (!spec.empty() && *end == '\0') {
+        return std::unique_ptr<FrameSource>(new CaptureSource(
+            gstreamer_pipeline((int)sensor, 3, size.width, size.height, framerate, 0, "BGR")));
+    }
+    if (spec == "synth")
+        return std::unique_ptr<FrameSource>(new SyntheticSource(idx, size, framerate));
+    return std::unique_ptr<FrameSource>(new CaptureSource(spec));
+}
+
+// === CAPTURE MANAGER ===
+
+MultiCam::MultiCam(std::vector<std::unique_ptr<FrameSource> > sources)
+{
+    for (auto& s : sources) {
+        std::unique_ptr<Cam> c(new Cam);
+        c->src = std::move(s);
+        cams_.push_back(std::move(c));
+    }
+}
+
+bool MultiCam::start()
+{
+    for (auto& c : cams_) {
+        if (!c->src->open()) {
+            std::cout << "Failed to open camera: " << c->src->name() << std::endl;
+            return false;
+        }
+    }
+    running_ = true;
+    for (auto& c : cams_) {
+        Cam* cp = c.get();
+        c->alive = true;
+        c->winStart = Clock::now();
+        c->th = std::thread([this, cp]() { captureLoop(*cp); });
+    }
+    return true;
+}
+
+void MultiCam::stop()
+{
+    running_ = false;
+    for (auto& c : cams_) {
+        if (c->th.joinable())
+            c->th.join();
+        c->src->release();
+    }
+}
+
+void MultiCam::captureLoop(Cam& c)
+{
+    int failures{ 0 }; //Consecutive, reset by a good read
+    while (running_) {
+        // back is only touched by this thread, read lands in place
+        if (!c.src->read(c.slot[c.back])) {
+            {
+                std::lock_guard<std::mutex> lk(c.m);
+                ++c.errors;
+                if (++failures > 30) { //Source gone
+                    c.alive = false;
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        failures = 0;
+
+        std::lock_guard<std::mutex> lk(c.m);
+        std::swap(c.back, c.middle);
+        if (c.fresh)
+            ++c.drops; //Previous frame never consumed
+        c.fresh = true;
+        ++c.frames;
+        ++c.winFrames;
+
+        auto now = Clock::now();
+        double dt = std::chrono::duration<double>(now - c.winStart).count();
+        if (dt >= 1.0) {
+            c.fps = c.winFrames / dt;
+            c.winFrames = 0;
+            c.winStart = now;
+        }
+    }
+}
+
+bool MultiCam::latest(size_t idx, cv::Mat& img)
+{
+    Cam& c = *cams_[idx];
+    bool got{ false };
+    {
+        std::lock_guard<std::mutex> lk(c.m);
+        if (c.fresh) {
+            std::swap(c.front, c.middle);
+            c.fresh = false;
+            got = true;
+        }
+    }
+    img = c.slot[c.front]; //Header only, front is owned by the consumer
+    return got;
+}
+
+void MultiCam::preview(cv::Mat& out, cv::Size tile, bool overlay)
+{
+    const int n{ (int)cams_.size() };
+    const int cols{ (int)std::ceil(std::sqrt((double)n)) };
+    const int rows{ (n + cols - 1) / cols };
+    out.create(rows * tile.height, cols * tile.width, CV_8UC3); //No-op unless the layout changed
+
+    std::vector<CamStats> st = stats();
+    cv::Mat img;
+    for (int i{ 0 }; i < n; ++i) {
+        cv::Mat dst = out(cv::Rect((i % cols) * tile.width, (i / cols) * tile.height, tile.width, tile.height));
+        latest(i, img);
+        if (img.empty() || img.type() != CV_8UC3)
+            dst.setTo(cv::Scalar::all(0));
+        else if (img.size() == tile)
+            img.copyTo(dst);
+        else
+            cv::resize(img, dst, tile, 0, 0, cv::INTER_NEAREST);
+
+        if (overlay) {
+            std::string txt = "#" + std::to_string(i) + " FPS: " + std::to_string((int)st[i].fps) +
+                " Drops: " + std::to_string(st[i].drops) + (st[i].alive ? "" : " (DEAD)");
+            cv::putText(dst, txt, cv::Point(10, 20), cv::FONT_HERSHEY_COMPLEX_SMALL, 0.8,
+                cv::Scalar(0, 200, 250), 1, cv::LINE_AA);
+        }
+    }
+    // Blank unused tiles
+    for (int i{ n }; i < rows * cols; ++i)
+        out(cv::Rect((i % cols) * tile.width, (i / cols) * tile.height, tile.width, tile.height)).setTo(cv::Scalar::all(0));
+}
+
+std::vector<CamStats> MultiCam::stats() const
+{
+    std::vector<CamStats> st;
+    st.reserve(cams_.size());
+    for (auto& c : cams_) {
+        std::lock_guard<std::mutex> lk(c->m);
+        CamStats s;
+        s.name = c->src->name();
+        s.fps = c->fps;
+        s.frames = c->frames;
+        s.drops = c->drops;
+        s.errors = c->errors;
+        s.alive = c->alive;
+        st.push_back(s);
+    }
+    return st;
+}
@@ -0,0 +1,131 @@
+/*
+ * multi_cam.h
+ * N-camera capture manager
+ *
+ * One capture thread per source, each writing into its own triple buffer
+ * (pool of 3 preallocated frames) so capture never waits on the consumer.
+ * The consumer grabs the latest frame of every camera & composes a tiled
+ * preview. Per-camera FPS & dropped (never consumed) frames are tracked.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef MULTI_CAM_H
+#define MULTI_CAM_H
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// === SOURCES ===
+
+// Frame source interface, read() should write into img in place when the
+// size/type already matches (VideoCapture does)
+class FrameSource {
+public:
+    virtual ~FrameSource() {}
+    virtual bool open() = 0;
+    virtual bool read(cv::Mat& img) = 0;
+    virtual void release() {}
+    virtual std::string name() const = 0;
+};
+
+// CSI camera (nvarguscamerasrc), GStreamer pipeline or video file
+class CaptureSource : public FrameSource {
+public:
+    explicit CaptureSource(const std::string& pipeline) : pipeline_(pipeline) {}
+    bool open() override;
+    bool read(cv::Mat& img) override { return cap_.read(img); }
+    void release() override { cap_.release(); }
+    std::string name() const override { return pipeline_; }
+
+private:
+    std::string pipeline_;
+    cv::VideoCapture cap_;
+};
+
+// Synthetic moving pattern, fps <= 0 runs unthrottled
+class SyntheticSource : public FrameSource {
+public:
+    SyntheticSource(int id, cv::Size size, double fps) : id_(id), size_(size), fps_(fps), frame_(0) {}
+    bool open() override;
+    bool read(cv::Mat& img) override;
+    std::string name() const override { return "synthetic:" + std::to_string(id_); }
+
+private:
+    int id_;
+    cv::Size size_;
+    double fps_;
+    long frame_;
+    cv::Mat pattern_; //2x wide/high, frames are shifted ROIs of it
+    Clock::time_point next_;
+};
+
+std::string gstreamer_pipeline(int cam_id, int s_mode, int display_width, int display_height,
+    int framerate, int flip_method, const std::string& outputFormat);
+
+// Source from cmd line spec: "<N>" CSI sensor_id N, "synth" synthetic, else pipeline/file
+std::unique_ptr<FrameSource> makeSource(const std::string& spec, int idx, cv::Size size, int framerate);
+
+// === CAPTURE MANAGER ===
+
+struct CamStats {
+    std::string name;
+    double fps; //Over the last second
+    uint64_t frames; //Total frames captured
+    uint64_t drops; //Captured but overwritten before being consumed
+    uint64_t errors; //Failed reads, the source is dropped after 30 in a row
+    bool alive;
+};
+
+class MultiCam {
+public:
+    explicit MultiCam(std::vector<std::unique_ptr<FrameSource> > sources);
+    ~MultiCam() { stop(); }
+
+    bool start(); //Open all sources & spawn 1 thread each
+    void stop();
+
+    size_t size() const { return cams_.size(); }
+
+    // Latest frame of camera idx (valid until the next latest(idx) call).
+    // Returns false if no new frame arrived since the last call.
+    bool latest(size_t idx, cv::Mat& img);
+
+    // Tiled preview of all cameras (tile = per camera size), with stats overlay.
+    // out is only reallocated if the layout changes.
+    void preview(cv::Mat& out, cv::Size tile, bool overlay = true);
+
+    std::vector<CamStats> stats() const;
+
+private:
+    struct Cam {
+        std::unique_ptr<FrameSource> src;
+        std::thread th;
+        cv::Mat slot[3]; //Triple buffer
+        int back{ 0 }, middle{ 1 }, front{ 2 };
+        bool fresh{ false };
+        mutable std::mutex m; //Guards the middle swap & stats
+        std::atomic<bool> alive{ false };
+        uint64_t frames{ 0 }, drops{ 0 }, errors{ 0 };
+        long winFrames{ 0 };
+        double fps{ 0.0 };
+        Clock::time_point winStart;
+    };
+
+    void captureLoop(Cam& c);
+
+    std::vector<std::unique_ptr<Cam> > cams_;
+    std::atomic<bool> running_{ false };
+};
+
+#endif
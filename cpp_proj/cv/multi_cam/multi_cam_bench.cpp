@@ -0,0 +1,84 @@
+/*
+ * multi_cam_bench.cpp
+ * Capture throughput vs number of cameras, using synthetic sources
+ *
+ * For 1..MAX_CAMS cameras, runs the capture manager for DURATION seconds with
+ * a consumer polling every camera (like the preview would) & reports the
+ * total / per-camera throughput, drops and scaling efficiency.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "multi_cam.h"
+
+#include <cstdio>
+#include <iostream>
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+        return err((std::string) "\nUsage: " + argv[0] + "  [MAX_CAMS]  [WIDTHxHEIGHT (1280x720)]  [SOURCE_FPS (0: unthrottled)]  [DURATION (s, 3)]\n", 1);
+
+    const int maxCams{ atoi(argv[1]) };
+    if (maxCams < 1)
+        return err("\n[MAX_CAMS] have to be > 0!\n", 2);
+
+    cv::Size size(1280, 720);
+    if (argc > 2 && sscanf(argv[2], "%dx%d", &size.width, &size.height) != 2)
+        return err("\nInvalid resolution, use WIDTHxHEIGHT!\n", 2);
+    const double srcFps{ argc > 3 ? atof(argv[3]) : 0.0 };
+    const double duration{ argc > 4 ? atof(argv[4]) : 3.0 };
+
+    std::cout << "\n[CONFIG]\nMAX_CAMS:\t" << maxCams << "\nResolution:\t" << size.width << "x" << size.height
+              << "\nSource FPS:\t" << (srcFps > 0 ? std::to_string(srcFps) : "unthrottled")
+              << "\nDuration (s):\t" << duration << "\n"
+              << std::endl;
+
+    printf("%6s %12s %12s %12s %10s %10s\n", "cams", "total_fps", "min_cam_fps", "max_cam_fps", "drops", "scaling");
+    double single{ 0.0 };
+    for (int n{ 1 }; n <= maxCams; ++n) {
+        std::vector<std::unique_ptr<FrameSource> > sources;
+        for (int i{ 0 }; i < n; ++i)
+            sources.push_back(std::unique_ptr<FrameSource>(new SyntheticSource(i, size, srcFps)));
+
+        MultiCam cams(std::move(sources));
+        if (!cams.start())
+            return err("Failed to start synthetic sources!", -1);
+
+        // Consumer: grab every camera as fast as possible
+        cv::Mat img;
+        auto t0 = Clock::now();
+        while (std::chrono::duration<double>(Clock::now() - t0).count() < duration) {
+            bool any{ false };
+            for (size_t i{ 0 }; i < cams.size(); ++i)
+                any |= cams.latest(i, img);
+            if (!any)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        std::vector<CamStats> st = cams.stats();
+        const double elapsed{ std::chrono::duration<double>(Clock::now() - t0).count() };
+        cams.stop();
+
+        double total{ 0.0 }, minFps{ 1e9 }, maxFps{ 0.0 };
+        uint64_t drops{ 0 };
+        for (const CamStats& s : st) {
+            double f = s.frames / elapsed;
+            total += f;
+            minFps = std::min(minFps, f);
+            maxFps = std::max(maxFps, f);
+            drops += s.drops;
+        }
+        if (n == 1)
+            single = total;
+        // 1.0: n cameras deliver n times the single camera throughput
+        printf("%6d %12.1f %12.1f %12.1f %10llu %10.2f\n", n, total, minFps, maxFps,
+            (unsigned long long)drops, single > 0 ? total / (n * single) : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * multi_cam_main.cpp
+ * Tiled preview of N cameras, one capture thread per camera
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "multi_cam.h"
+
+#include <cmath>
+#include <iostream>
+
+constexpr int16_t display_width{ 640 };
+constexpr int16_t display_height{ 360 };
+constexpr int8_t framerate{ 30 };
+
+int main(int argc, char** argv)
+{
+    // Default to the 2 CSI cameras
+    std::vector<std::string> specs;
+    for (int i{ 1 }; i < argc; ++i)
+        specs.push_back(argv[i]);
+    if (specs.empty())
+        specs = { "0", "1" };
+
+    std::cout << "Running with OpenCV Version: " << CV_VERSION << "\n";
+
+    const cv::Size camSize(display_width, display_height);
+    std::vector<std::unique_ptr<FrameSource> > sources;
+    for (size_t i{ 0 }; i < specs.size(); ++i)
+        sources.push_back(makeSource(specs[i], (int)i, camSize, framerate));
+
+    MultiCam cams(std::move(sources));
+    if (!cams.start())
+        return (-1);
+
+    // Shrink the tiles as more cameras are added
+    const int cols{ (int)std::ceil(std::sqrt((double)cams.size())) };
+    const cv::Size tile(camSize.width * 2 / (cols + 1), camSize.height * 2 / (cols + 1));
+
+    cv::namedWindow("Cams", cv::WINDOW_AUTOSIZE);
+    std::cout << "Hit ESC to exit" << "\n";
+
+    cv::Mat canvas;
+    auto tPrint = Clock::now();
+    while (true) {
+        cams.preview(canvas, tile);
+        cv::imshow("Cams", canvas);
+
+        if (Clock::now() - tPrint >= std::chrono::seconds(1)) {
+            tPrint = Clock::now();
+            std::vector<CamStats> st = cams.stats();
+            for (size_t i{ 0 }; i < st.size(); ++i)
+                std::cout << "#" << i << " FPS: " << (int)st[i].fps << " Drops: " << st[i].drops << "\t";
+            std::cout << std::endl;
+        }
+
+        int keycode = cv::waitKey(10) & 0xff;
+        if (keycode == 27)
+            break;
+    }
+
+    cams.stop();
+    cv::destroyAllWindows();
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "omni_atlas.h"
+
+#include "opencv2/ccalib/omnidir.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double deg{ CV_PI / 180.0 };
+
+cv::Matx33d yawPitch(double yaw, double pitch)
+{
+    const double cy{ std::cos(yaw * deg) }, sy{ std::sin(yaw * deg) };
+    const double cp{ std::cos(pitch * deg) }, sp{ std::sin(pitch * deg) };
+    const cv::Matx33d Ry(cy, 0, sy, 0, 1, 0, -sy, 0, cy); //+x (right) for a positive yaw
+    const cv::Matx33d Rx(1, 0, 0, 0, cp, -sp, 0, sp, cp); //-y (up) for a positive pitch
+    return Ry * Rx;
+}
+
+// Fills a range of atlas rows of the gather map
+class MapBody : public cv::ParallelLoopBody {
+public:
+    MapBody(const OmniIntrinsics& cam, const cv::Size& imageSize, const std::vector<UnwrapView>& views, cv::Mat& map)
+        : cam_(cam)
+        , imageSize_(imageSize)
+        , views_(views)
+        , map_(map)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int y{ range.start }; y < range.end; ++y) {
+            cv::Vec2f* m = map_.ptr<cv::Vec2f>(y);
+            std::fill(m, m + map_.cols, cv::Vec2f(-1.f, -1.f));
+            for (const UnwrapView& view : views_) {
+                if (y < view.roi.y || y >= view.roi.y + view.roi.height)
+                    continue;
+                for (int x{ 0 }; x < view.roi.width; ++x) {
+                    cv::Vec2d p;
+                    if (cam_.project(view.ray(x, y - view.roi.y), p) && p[0] >= 0 && p[1] >= 0 && p[0] <= imageSize_.width - 1
+                        && p[1] <= imageSize_.height - 1)
+                        m[view.roi.x + x] = cv::Vec2f((float)p[0], (float)p[1]);
+                }
+            }
+        }
+    }
+
+private:
+    const OmniIntrinsics& cam_;
+    const cv::Size imageSize_;
+    const std::vector<UnwrapView>& views_;
+    cv::Mat& map_;
+};
+
+} // namespace
+
+UnwrapView UnwrapView::perspective(const std::string& name, double yaw, double pitch, double hfov, const cv::Size& size)
+{
+    UnwrapView v;
+    v.kind = PERSPECTIVE;
+    v.R = yawPitch(yaw, pitch);
+    const double f{ 0.5 * size.width / std::tan(0.5 * hfov * deg) };
+    v.K = cv::Matx33d(f, 0, 0.5 * (size.width - 1), 0, f, 0.5 * (size.height - 1), 0, 0, 1);
+    v.size = size;
+    v.fov = cv::Vec2d(hfov, 2 * std::atan(0.5 * size.height / f) / deg);
+    v.name = name;
+    return v;
+}
+
+UnwrapView UnwrapView::pinhole(const std::string& name, const cv::Matx33d& Knew, const cv::Size& size)
+{
+    UnwrapView v;
+    v.kind = PERSPECTIVE;
+    v.K = Knew;
+    v.size = size;
+    v.fov = cv::Vec2d(2 * std::atan(0.5 * size.width / Knew(0, 0)) / deg, 2 * std::atan(0.5 * size.height / Knew(1, 1)) / deg);
+    v.name = name;
+    return v;
+}
+
+UnwrapView UnwrapView::longLati(const std::string& name, double hfov, double vfov, const cv::Size& size)
+{
+    UnwrapView v;
+    v.kind = LONGLATI;
+    v.size = size;
+    v.fov = cv::Vec2d(hfov, vfov);
+    v.name = name;
+    return v;
+}
+
+cv::Vec3d UnwrapView::ray(double u, double v) const
+{
+    if (kind == PERSPECTIVE) {
+        const double y{ (v - K(1, 2)) / K(1, 1) };
+        return R * cv::Vec3d((u - K(0, 2) - K(0, 1) * y) / K(0, 0), y, 1.0);
+    }
+    const double lon{ (u / std::max(1, size.width - 1) - 0.5) * fov[0] * deg };
+    const double lat{ (v / std::max(1, size.height - 1) - 0.5) * fov[1] * deg };
+    return R * cv::Vec3d(std::cos(lat) * std::sin(lon), std::sin(lat), std::cos(lat) * std::cos(lon));
+}
+
+void stereoViews(const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& size, UnwrapView& left, UnwrapView& right)
+{
+    cv::Mat R1, R2;
+    cv::omnidir::stereoRectify(rvec, tvec, R1, R2);
+    R1.convertTo(R1, CV_64F);
+    R2.convertTo(R2, CV_64F);
+    const cv::Matx33d Knew(size.width / 3.142, 0, size.width / 2, 0, size.height / 3.142, size.height / 2, 0, 0, 1);
+    left = UnwrapView::pinhole("left", Knew, size);
+    right = UnwrapView::pinhole("right", Knew, size);
+    left.R = cv::Matx33d(R1.ptr<double>()).t(); //Rectified -> camera
+    right.R = cv::Matx33d(R2.ptr<double>()).t();
+}
+
+UnwrapAtlas::UnwrapAtlas(const OmniIntrinsics& cam, const cv::Size& imageSize, const std::vector<UnwrapView>& views, int columns)
+    : views_(views)
+    , imageSize_(imageSize)
+{
+    // Shelf layout
+    int x{ 0 }, y{ 0 }, rowHeight{ 0 }, inRow{ 0 }, width{ 0 };
+    for (UnwrapView& v : views_) {
+        const bool ownRow{ v.kind == UnwrapView::LONGLATI };
+        if (inRow > 0 && (ownRow || (columns > 0 && inRow == columns))) {
+            y += rowHeight;
+            x = rowHeight = inRow = 0;
+        }
+        v.roi = cv::Rect(x, y, v.size.width, v.size.height);
+        x += v.size.width;
+        width = std::max(width, x);
+        rowHeight = std::max(rowHeight, v.size.height);
+        ++inRow;
+        if (ownRow) {
+            y += rowHeight;
+            x = rowHeight = inRow = 0;
+        }
+    }
+    size_ = cv::Size(width, y + rowHeight);
+
+    map_.create(size_, CV_32FC2);
+    cv::parallel_for_(cv::Range(0, size_.height), MapBody(cam, imageSize_, views_, map_));
+    cv::convertMaps(map_, cv::noArray(), xy_, frac_, CV_16SC2);
+}
+
+void UnwrapAtlas::unwrap(const cv::Mat& frame, cv::Mat& atlas, int interpolation, const cv::Scalar& border) const
+{
+    CV_Assert(frame.size() == imageSize_);
+    cv::remap(frame, atlas, xy_, frac_, interpolation, cv::BORDER_CONSTANT, border);
+}
@@ -0,0 +1,73 @@
+/*
+ * omni_atlas.h
+ * Several unwrapped views of a fisheye frame in a single pass
+ *
+ * cv::omnidir::undistortImage rebuilds its map on every call and gives one
+ * view per call. UnwrapAtlas lays out any number of virtual pinhole views
+ * (a direction & field of view each, e.g. front / left / right or a cube
+ * map) & equirectangular panoramas side by side in one output image, and
+ * builds a single gather map for all of them once, in parallel, stored in
+ * the fixed point format of cv::remap. A frame is then unwrapped into every
+ * view with one remap pass over the atlas.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_ATLAS_H
+#define OMNI_ATLAS_H
+
+#include "omni_refine.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include <string>
+#include <vector>
+
+struct UnwrapView {
+    enum Kind { PERSPECTIVE,
+        LONGLATI };
+
+    Kind kind{ PERSPECTIVE };
+    cv::Matx33d R{ cv::Matx33d::eye() }; //View -> camera rotation
+    cv::Matx33d K{ cv::Matx33d::eye() }; //Camera matrix of a perspective view
+    cv::Size size;
+    cv::Vec2d fov; //Horizontal & vertical, deg
+    std::string name;
+    cv::Rect roi; //Placement in the atlas, set by UnwrapAtlas
+
+    // Pinhole view looking yaw deg right & pitch deg up of the optical axis, hfov: horizontal field of view
+    static UnwrapView perspective(const std::string& name, double yaw, double pitch, double hfov, const cv::Size& size);
+    // Perspective view of camera matrix Knew along the optical axis, as cv::omnidir::RECTIFY_PERSPECTIVE
+    static UnwrapView pinhole(const std::string& name, const cv::Matx33d& Knew, const cv::Size& size);
+    // Longitude / latitude panorama centred on the optical axis
+    static UnwrapView longLati(const std::string& name, double hfov, double vfov, const cv::Size& size);
+
+    // Ray in the camera frame of view pixel (u, v)
+    cv::Vec3d ray(double u, double v) const;
+};
+
+// Row aligned views of a stereo pair (camera 1 -> 2 transform rvec, tvec) at size, camera matrix as omni_rectify_stereo
+void stereoViews(const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& size, UnwrapView& left, UnwrapView& right);
+
+class UnwrapAtlas {
+public:
+    // Views are laid out left to right, columns per row (0: one row), a panorama on a row of its own
+    UnwrapAtlas(const OmniIntrinsics& cam, const cv::Size& imageSize, const std::vector<UnwrapView>& views, int columns = 0);
+
+    // All the views of one frame (the calibration's size) into atlas, uncovered pixels in border
+    void unwrap(const cv::Mat& frame, cv::Mat& atlas, int interpolation = cv::INTER_LINEAR, const cv::Scalar& border = cv::Scalar()) const;
+    // View i of an unwrapped atlas, no copy
+    cv::Mat view(const cv::Mat& atlas, int i) const { return atlas(views_[i].roi); }
+
+    const std::vector<UnwrapView>& views() const { return views_; }
+    cv::Size size() const { return size_; }
+    // Source position (CV_32FC2) of every atlas pixel, -1 where the view sees nothing
+    const cv::Mat& map() const { return map_; }
+
+private:
+    std::vector<UnwrapView> views_;
+    cv::Size imageSize_, size_;
+    cv::Mat map_; //CV_32FC2
+    cv::Mat xy_, frac_; //Fixed point CV_16SC2 & CV_16UC1, what remap uses
+};
+
+#endif
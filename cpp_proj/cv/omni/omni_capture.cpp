@@ -0,0 +1,339 @@
+/*
+ * omni_capture.cpp
+ * Live assisted capture of calibration images
+ *
+ * Reads the camera (pair) and shows a live preview while a background
+ * worker looks for the chessboard in a downscaled copy of the latest
+ * frame(s). The preview loop only hands a frame over when the worker is
+ * idle, so a slow detection never stalls it. A detection is accepted on
+ * its own when the board is held still (corners barely moved since the
+ * previous detection) and its pose / image coverage is new enough against
+ * the views accepted so far (ViewSelector::novelty), then the full
+ * resolution frame(s) are saved & the image list(s) rewritten, ready for
+ * omni_calib / omni_calib_stereo.
+ *
+ * Output in OUT_DIR:
+ *   img_XXX.png with imagelist.xml, or left_XXX.png & right_XXX.png with
+ *   imagelist_left.xml & imagelist_right.xml (absolute paths)
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/core.hpp"
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+#include "omni_source.h"
+#include "view_selection.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TARGET_VIEWS 30 //Default, overridden from the command line
+#define IMG_EXT ".png"
+
+// Detection & acceptance
+#define DETECT_WIDTH 640 //Frames are downscaled to it for the board detection
+#define STILL_MAX_MOTION 0.004 //Mean corner motion between 2 detections, fraction of the image width
+#define NOVELTY_MIN 0.25 //ViewSelector::novelty() of a view to accept it
+
+#define PREVIEW_WIDTH 1280 //Preview is downscaled to it
+#define COVERAGE_ALPHA 0.35 //Coverage heatmap blended over the preview
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+struct Detection {
+    std::vector<cv::Mat> frames; //Full resolution, one per camera
+    std::vector<cv::Mat> corners; //Full resolution inner corners (CV_32FC2) per camera, if found
+    bool found{ false }; //In every camera
+};
+
+// Board detection on a background thread, one frame (set) at a time
+class Detector {
+public:
+    explicit Detector(const cv::Size& boardSize)
+        : boardSize_(boardSize)
+        , worker_(&Detector::run, this)
+    {
+    }
+
+    ~Detector()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        worker_.join();
+    }
+
+    bool idle()
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        return !busy_;
+    }
+
+    // Only when idle(), frames must not be written to afterwards
+    void submit(std::vector<cv::Mat>&& frames)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            pending_ = std::move(frames);
+            busy_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    // Latest finished detection, once
+    bool poll(Detection& out)
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (!ready_)
+            return false;
+        out = std::move(result_);
+        ready_ = false;
+        return true;
+    }
+
+private:
+    void run()
+    {
+        for (;;) {
+            Detection d;
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+                if (stop_)
+                    return;
+                d.frames.swap(pending_);
+            }
+            d.found = true;
+            for (const cv::Mat& frame : d.frames) {
+                cv::Mat corners;
+                if (!detect(frame, corners)) {
+                    d.found = false;
+                    d.corners.clear();
+                    break;
+                }
+                d.corners.push_back(corners);
+            }
+            std::lock_guard<std::mutex> lock(m_);
+            result_ = std::move(d);
+            ready_ = true;
+            busy_ = false;
+        }
+    }
+
+    bool detect(const cv::Mat& frame, cv::Mat& corners) const
+    {
+        const double scale{ std::min(1.0, (double)DETECT_WIDTH / frame.cols) };
+        cv::Mat small, gray;
+        if (scale < 1.0)
+            cv::resize(frame, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        else
+            small = frame;
+        if (small.channels() == 3)
+            cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+        else
+            gray = small;
+        if (!cv::findChessboardCorners(gray, boardSize_, corners,
+                cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK))
+            return false;
+        corners.convertTo(corners, CV_32FC2, 1.0 / scale); //Good enough to score the view, omni_calib detects again at full resolution
+        return true;
+    }
+
+    const cv::Size boardSize_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::vector<cv::Mat> pending_;
+    Detection result_;
+    bool busy_{ false }, ready_{ false }, stop_{ false };
+    std::thread worker_; //Last, started once the rest is initialised
+};
+
+// Mean displacement of the corners of 2 detections of the same board
+static double cornerMotion(const cv::Mat& a, const cv::Mat& b)
+{
+    if (a.total() != b.total())
+        return std::numeric_limits<double>::max();
+    const cv::Point2f* p = a.ptr<cv::Point2f>();
+    const cv::Point2f* q = b.ptr<cv::Point2f>();
+    double sum{ 0.0 };
+    for (size_t i{ 0 }; i < a.total(); ++i)
+        sum += cv::norm(p[i] - q[i]);
+    return sum / a.total();
+}
+
+static std::vector<int> allViews(const ViewSelector& selector)
+{
+    std::vector<int> all(selector.size());
+    std::iota(all.begin(), all.end(), 0);
+    return all;
+}
+
+static bool writeImageList(const std::string& path, const std::vector<std::string>& images)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "images"
+       << "[";
+    for (const std::string& img : images)
+        fs << img;
+    fs << "]";
+    return true;
+}
+
+static std::string fileName(const std::string& prefix, int i)
+{
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "_%03d", i);
+    return prefix + buf + IMG_EXT;
+}
+
+int main(int argc, char** argv)
+{
+    const std::string usage{ (std::string) "\nUsage: " + argv[0] + "  [OUT_DIR]  [CHECKBOARD_HORIZONTAL_POINTS]  [CHECKBOARD_VERTICAL_POINTS]  [TARGET_VIEWS]  [SOURCE]  [SOURCE_RIGHT]\n" };
+    if (argc < 4)
+        return err(usage, 1);
+    char absDir[PATH_MAX];
+    if (!realpath(argv[1], absDir))
+        return err(std::string("Output directory not found: ") + argv[1], -1);
+    const std::string outDir{ absDir };
+    cv::Size boardSize;
+    if (!parseInt(argv[2], boardSize.width) || !parseInt(argv[3], boardSize.height))
+        return err("Checkerboard points must be numbers" + usage, 1);
+    if (boardSize.width < 3 || boardSize.height < 3)
+        return err("Checkerboard horizontal & vertical points must be more than 2", -1);
+    int target{ TARGET_VIEWS };
+    if (argc > 4 && (!parseInt(argv[4], target) || target <= 0))
+        return err("Invalid TARGET_VIEWS, expected a number of views > 0" + usage, 1);
+
+    std::vector<std::string> sources{ argc > 5 ? argv[5] : "0" };
+    if (argc > 6)
+        sources.push_back(argv[6]);
+    const bool stereo{ sources.size() == 2 };
+    const std::vector<std::string> prefixes{ stereo ? std::vector<std::string>{ "left", "right" } : std::vector<std::string>{ "img" } };
+    const std::vector<std::string> lists{ stereo ? std::vector<std::string>{ outDir + "/imagelist_left.xml", outDir + "/imagelist_right.xml" }
+                                                 : std::vector<std::string>{ outDir + "/imagelist.xml" } };
+
+    std::vector<cv::VideoCapture> caps(sources.size());
+    for (size_t c{ 0 }; c < caps.size(); ++c)
+        if (!openSource(sources[c], caps[c]))
+            return err("Failed to open source: " + sources[c], -1);
+
+    std::vector<cv::Mat> frames(caps.size());
+    for (size_t c{ 0 }; c < caps.size(); ++c)
+        if (!caps[c].read(frames[c]) || frames[c].empty())
+            return err("Capture read error: " + sources[c], -1);
+    const cv::Size imageSize{ frames[0].size() };
+    if (stereo && frames[1].size() != imageSize)
+        return err("Left & right resolutions differ", -1);
+
+    std::vector<ViewSelector> selectors(caps.size(), ViewSelector(imageSize, boardSize));
+    std::vector<std::vector<std::string> > saved(caps.size());
+    std::vector<cv::Mat> heatmaps(caps.size(), cv::Mat::zeros(imageSize, CV_8UC3));
+    Detector detector(boardSize);
+    Detection last;
+    double novelty{ 0.0 };
+    bool still{ false }, paused{ false }, consumed{ false }; //consumed: last already saved
+
+    auto accept = [&](const Detection& d) {
+        const int n{ (int)saved[0].size() };
+        for (size_t c{ 0 }; c < caps.size(); ++c) {
+            const std::string path{ outDir + "/" + fileName(prefixes[c], n) };
+            if (!cv::imwrite(path, d.frames[c]))
+                return false;
+            saved[c].push_back(path);
+            selectors[c].add(d.corners[c]);
+            heatmaps[c] = selectors[c].heatmap(allViews(selectors[c]), imageSize);
+        }
+        for (size_t c{ 0 }; c < caps.size(); ++c)
+            if (!writeImageList(lists[c], saved[c]))
+                return false;
+        consumed = true;
+        std::cout << "[ \x1B[32m✔\033[0m ] " << saved[0].size() << "/" << target << "  novelty: " << novelty
+                  << "  coverage: " << 100.0 * selectors[0].coveredFraction(allViews(selectors[0])) << "%" << std::endl;
+        return true;
+    };
+
+    std::cout << "Hold the board still in new poses, covering the whole image. Space: pause auto-accept, a: accept, Esc: exit" << std::endl;
+    cv::namedWindow("Capture", cv::WINDOW_AUTOSIZE);
+    while ((int)saved[0].size() < target) {
+        if (detector.idle()) {
+            std::vector<cv::Mat> copies(frames.size());
+            for (size_t c{ 0 }; c < frames.size(); ++c)
+                copies[c] = frames[c].clone();
+            detector.submit(std::move(copies));
+        }
+
+        Detection d;
+        if (detector.poll(d)) {
+            still = false;
+            novelty = 0.0;
+            if (d.found) {
+                still = last.found;
+                novelty = std::numeric_limits<double>::max();
+                for (size_t c{ 0 }; c < caps.size(); ++c) {
+                    still = still && cornerMotion(d.corners[c], last.corners[c]) < STILL_MAX_MOTION * imageSize.width;
+                    novelty = std::min(novelty, selectors[c].novelty(d.corners[c])); //New in every camera
+                }
+            }
+            last = std::move(d);
+            consumed = false;
+            if (!paused && still && novelty >= NOVELTY_MIN && !accept(last))
+                return err("Could not write to " + outDir, -1);
+        }
+
+        std::vector<cv::Mat> views(frames.size());
+        for (size_t c{ 0 }; c < frames.size(); ++c) {
+            cv::addWeighted(frames[c], 1.0 - COVERAGE_ALPHA, heatmaps[c], COVERAGE_ALPHA, 0.0, views[c]);
+            if (last.found)
+                cv::drawChessboardCorners(views[c], boardSize, last.corners[c], true);
+        }
+        cv::Mat preview;
+        if (stereo)
+            cv::hconcat(views, preview);
+        else
+            preview = views[0];
+        if (preview.cols > PREVIEW_WIDTH)
+            cv::resize(preview, preview, cv::Size(), (double)PREVIEW_WIDTH / preview.cols, (double)PREVIEW_WIDTH / preview.cols, cv::INTER_AREA);
+        const std::string status{ std::to_string(saved[0].size()) + "/" + std::to_string(target) + (paused ? "  paused" : "") +
+            (!last.found ? "  no board" : !still ? "  hold still" : novelty < NOVELTY_MIN ? "  move to a new pose" : "") };
+        cv::putText(preview, status, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(0, 0, 0), 4);
+        cv::putText(preview, status, cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 0.8, cv::Scalar(255, 255, 255), 2);
+        cv::imshow("Capture", preview);
+
+        const int key{ cv::waitKey(1) & 0xff };
+        if (key == 27)
+            break;
+        if (key == ' ')
+            paused = !paused;
+        if (key == 'a' && last.found && !consumed && !accept(last))
+            return err("Could not write to " + outDir, -1);
+
+        for (size_t c{ 0 }; c < caps.size(); ++c)
+            if (!caps[c].read(frames[c]) || frames[c].empty())
+                return err("Capture read error: " + sources[c], saved[0].empty() ? -1 : 0);
+    }
+
+    std::cout << "\nImages saved: " << saved[0].size() << ", image list(s) in " << outDir << std::endl;
+    return 0;
+}
@@ -0,0 +1,336 @@
+#include "omni_disparity.h"
+
+#include "opencv2/imgproc.hpp"
+#include "opencv2/ximgproc.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+const double min_valid{ 0.3 }; //Fraction of valid disparities of a tile in the previous frame to narrow its range
+const double max_motion{ 12.0 }; //Mean absolute grey level change of a tile since the previous frame
+const int margin_min{ 8 }; //Disparities searched beyond the previous range, at least
+const double margin_fraction{ 0.25 }; //Of the previous range
+const int row_margin{ 16 }; //Rows matched above & below a tile, for the block & path aggregation
+const double guide_eps{ 100.0 }; //Guided filter regularisation, squared grey levels: edges weaker than ~10 levels are smoothed over
+const double max_lr_diff{ 1.0 }; //Left / right disagreement of a kept disparity, px
+
+// Full resolution params scaled down
+DisparityParams lowParams(const DisparityParams& params, int scale)
+{
+    DisparityParams p = params;
+    p.minDisparity = (int)std::floor((double)params.minDisparity / scale);
+    p.numDisparities = std::max(16, (params.numDisparities / scale + 15) / 16 * 16);
+    p.blockSize = std::max(3, (params.blockSize / scale) | 1);
+    return p;
+}
+
+// What a tile with its range is matched on: the columns its right matches fall in (x - d) & the ones SGBM leaves
+// invalid at the left, rows with a margin
+cv::Rect cropOf(const cv::Rect& tile, int minDisparity, int numDisparities, int blockSize, const cv::Size& size)
+{
+    const int half{ blockSize / 2 };
+    const int x0{ std::max(0, tile.x - std::max(0, minDisparity + numDisparities) - half) };
+    const int x1{ std::min(size.width, tile.x + tile.width + std::max(0, -minDisparity) + half) };
+    const int y0{ std::max(0, tile.y - row_margin) };
+    const int y1{ std::min(size.height, tile.y + tile.height + row_margin) };
+    return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+// Disparities of one tile with its own range
+class TileBody : public cv::ParallelLoopBody {
+public:
+    struct Job {
+        cv::Rect tile;
+        int minDisparity, numDisparities;
+    };
+
+    TileBody(const DisparityParams& params, const cv::Mat& left, const cv::Mat& right, const std::vector<Job>& jobs, cv::Mat& disparity)
+        : params_(params)
+        , left_(left)
+        , right_(right)
+        , jobs_(jobs)
+        , disparity_(disparity)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        const short invalid{ (short)((params_.minDisparity - 1) * 16) };
+        for (int j{ range.start }; j < range.end; ++j) {
+            const Job& job = jobs_[j];
+            const cv::Rect crop{ cropOf(job.tile, job.minDisparity, job.numDisparities, params_.blockSize, left_.size()) };
+
+            cv::Mat d;
+            createSGBM(params_, left_.channels(), job.minDisparity, job.numDisparities)->compute(left_(crop), right_(crop), d);
+            const cv::Mat src{ d(job.tile - crop.tl()) };
+            cv::Mat dst{ disparity_(job.tile) };
+            const short lowest{ (short)(job.minDisparity * 16) };
+            for (int y{ 0 }; y < src.rows; ++y) {
+                const short* s = src.ptr<short>(y);
+                short* o = dst.ptr<short>(y);
+                for (int x{ 0 }; x < src.cols; ++x)
+                    o[x] = s[x] < lowest ? invalid : s[x];
+            }
+        }
+    }
+
+private:
+    const DisparityParams& params_;
+    const cv::Mat& left_;
+    const cv::Mat& right_;
+    const std::vector<Job>& jobs_;
+    cv::Mat& disparity_;
+};
+
+// Left / right check & confidence of a range of rows
+class ConsistencyBody : public cv::ParallelLoopBody {
+public:
+    ConsistencyBody(cv::Mat& disparity, const cv::Mat& rightDisparity, int minDisparity, int rightMinDisparity, double maxDiff, cv::Mat& confidence)
+        : disparity_(disparity)
+        , right_(rightDisparity)
+        , lowest_((short)(minDisparity * 16))
+        , invalid_((short)((minDisparity - 1) * 16))
+        , rightLowest_((short)(rightMinDisparity * 16))
+        , maxDiff_(std::max(1, cvRound(maxDiff * 16)))
+        , confidence_(confidence)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        const int cols{ disparity_.cols };
+        for (int y{ range.start }; y < range.end; ++y) {
+            short* d = disparity_.ptr<short>(y);
+            const short* r = right_.ptr<short>(y);
+            uchar* c = confidence_.ptr<uchar>(y);
+            for (int x{ 0 }; x < cols; ++x) {
+                c[x] = 0;
+                if (d[x] < lowest_)
+                    continue;
+                const int xr{ x - cvRound(d[x] / 16.f) };
+                const int diff{ xr >= 0 && xr < cols && r[xr] >= rightLowest_ ? std::abs(d[x] + r[xr]) : maxDiff_ + 1 };
+                if (diff > maxDiff_)
+                    d[x] = invalid_;
+                else
+                    c[x] = (uchar)(255 * (maxDiff_ - diff) / maxDiff_);
+            }
+        }
+    }
+
+private:
+    cv::Mat& disparity_;
+    const cv::Mat& right_;
+    const short lowest_, invalid_, rightLowest_;
+    const int maxDiff_; //1/16 px
+    cv::Mat& confidence_;
+};
+
+} // namespace
+
+void consistencyCheck(cv::Mat& disparity, const cv::Mat& rightDisparity, int minDisparity, int rightMinDisparity, double maxDiff, cv::Mat& confidence)
+{
+    CV_Assert(disparity.type() == CV_16S && rightDisparity.type() == CV_16S && disparity.size() == rightDisparity.size());
+    confidence.create(disparity.size(), CV_8U);
+    cv::parallel_for_(cv::Range(0, disparity.rows), ConsistencyBody(disparity, rightDisparity, minDisparity, rightMinDisparity, maxDiff, confidence));
+}
+
+cv::Ptr<cv::StereoSGBM> createSGBM(const DisparityParams& params, int channels, int minDisparity, int numDisparities)
+{
+    const int win{ params.blockSize };
+    cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(minDisparity, numDisparities, win);
+    sgbm->setPreFilterCap(params.preFilterCap);
+    sgbm->setP1(8 * channels * win * win);
+    sgbm->setP2(32 * channels * win * win);
+    sgbm->setMode(params.mode);
+    return sgbm;
+}
+
+TemporalDisparity::TemporalDisparity(const DisparityParams& params, bool temporal, int tileSize, int refreshInterval)
+    : params_(params)
+    , temporal_(temporal)
+    , tileSize_(std::max(32, tileSize))
+    , refreshInterval_(std::max(1, refreshInterval))
+{
+}
+
+void TemporalDisparity::reset()
+{
+    prevDisparity_.release();
+    prevGray_.release();
+    frame_ = 0;
+}
+
+TemporalDisparity::Range TemporalDisparity::tileRange(const cv::Rect& tile, const cv::Mat& gray) const
+{
+    const Range full{ params_.minDisparity, params_.numDisparities };
+    cv::Mat diff;
+    cv::absdiff(gray(tile), prevGray_(tile), diff);
+    if (cv::mean(diff)[0] > max_motion)
+        return full;
+
+    const cv::Mat prev{ prevDisparity_(tile) };
+    const short lowest{ (short)(params_.minDisparity * 16) };
+    std::vector<short> valid;
+    valid.reserve(tile.area());
+    for (int y{ 0 }; y < prev.rows; ++y) {
+        const short* p = prev.ptr<short>(y);
+        for (int x{ 0 }; x < prev.cols; ++x)
+            if (p[x] >= lowest)
+                valid.push_back(p[x]);
+    }
+    if (valid.size() < min_valid * tile.area())
+        return full;
+
+    const size_t lo{ valid.size() / 50 }, hi{ valid.size() - 1 - valid.size() / 50 };
+    std::nth_element(valid.begin(), valid.begin() + lo, valid.end());
+    const double dLo{ valid[lo] / 16.0 };
+    std::nth_element(valid.begin(), valid.begin() + hi, valid.end());
+    const double dHi{ valid[hi] / 16.0 };
+    const double margin{ std::max((double)margin_min, margin_fraction * (dHi - dLo)) };
+
+    const int fullMax{ params_.minDisparity + params_.numDisparities };
+    Range r;
+    r.minDisparity = std::max(params_.minDisparity, (int)std::floor(dLo - margin));
+    const int maxD{ std::min(fullMax, (int)std::ceil(dHi + margin)) };
+    r.numDisparities = std::max(16, (maxD - r.minDisparity + 15) / 16 * 16);
+    if (r.numDisparities >= params_.numDisparities)
+        return full;
+    r.minDisparity = std::min(r.minDisparity, fullMax - r.numDisparities);
+    return r;
+}
+
+void TemporalDisparity::compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity)
+{
+    CV_Assert(left.size() == right.size() && left.type() == right.type());
+    cv::Mat gray;
+    if (left.channels() == 3)
+        cv::cvtColor(left, gray, cv::COLOR_BGR2GRAY);
+    else
+        gray = left.clone();
+
+    const bool narrow{ temporal_ && !prevDisparity_.empty() && prevDisparity_.size() == left.size() && frame_ % refreshInterval_ != 0 };
+    std::vector<TileBody::Job> jobs;
+    double searched{ 0.0 }, cost{ 0.0 }; //Disparities x pixels of the tiles, without / with their crop
+    const double fullCost{ (double)params_.numDisparities * left.size().area() };
+    if (narrow) {
+        for (int y{ 0 }; y < left.rows; y += tileSize_)
+            for (int x{ 0 }; x < left.cols; x += tileSize_) {
+                const cv::Rect tile{ cv::Rect(x, y, tileSize_, tileSize_) & cv::Rect(cv::Point(), left.size()) };
+                const Range r{ tileRange(tile, gray) };
+                jobs.push_back(TileBody::Job{ tile, r.minDisparity, r.numDisparities });
+                searched += (double)r.numDisparities * tile.area();
+                cost += (double)r.numDisparities * cropOf(tile, r.minDisparity, r.numDisparities, params_.blockSize, left.size()).area();
+            }
+    }
+
+    if (!narrow || cost >= fullCost) { //Whole image at once when the tiles wouldn't be cheaper
+        createSGBM(params_, left.channels(), params_.minDisparity, params_.numDisparities)->compute(left, right, disparity);
+        searched_ = 1.0;
+    }
+    else {
+        disparity.create(left.size(), CV_16S);
+        cv::parallel_for_(cv::Range(0, (int)jobs.size()), TileBody(params_, left, right, jobs, disparity));
+        searched_ = searched / fullCost;
+    }
+
+    disparity.copyTo(prevDisparity_);
+    prevGray_ = gray;
+    ++frame_;
+}
+
+MultiResDisparity::MultiResDisparity(const DisparityParams& params, int scale, bool temporal)
+    : params_(params)
+    , scale_(scale)
+    , low_(scale > 1 ? lowParams(params, scale) : params, temporal)
+{
+    CV_Assert(scale == 1 || scale == 2 || scale == 4);
+}
+
+void MultiResDisparity::compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity)
+{
+    run(left, right, disparity, nullptr);
+}
+
+void MultiResDisparity::compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat& confidence)
+{
+    run(left, right, disparity, &confidence);
+}
+
+// The right image matched over the mirror of the range the left disparity found (as createRightMatcher does with the
+// full range), then checked against it. A left disparity outside that range can't pass the check, so narrowing it
+// loses nothing, and keeps the extra match about as cheap as the temporally narrowed left one when the scene spans
+// little of the full range.
+void MultiResDisparity::check(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat& confidence)
+{
+    const DisparityParams& p = low_.params();
+    const int fullMin{ 1 - p.minDisparity - p.numDisparities }; //Mirrored full range
+    cv::Mat valid;
+    cv::compare(disparity, p.minDisparity * 16, valid, cv::CMP_GE);
+    double dLo, dHi;
+    cv::minMaxLoc(disparity, &dLo, &dHi, nullptr, nullptr, valid);
+    int rightMin{ fullMin }, rightNum{ p.numDisparities };
+    if (cv::countNonZero(valid) > 0) {
+        rightMin = std::max(fullMin, (int)std::floor(-dHi / 16.0) - margin_min);
+        const int rightMax{ std::min(fullMin + p.numDisparities, (int)std::ceil(-dLo / 16.0) + margin_min + 1) };
+        rightNum = std::min(p.numDisparities, std::max(16, (rightMax - rightMin + 15) / 16 * 16));
+        rightMin = std::min(rightMin, fullMin + p.numDisparities - rightNum);
+    }
+    createSGBM(p, left.channels(), rightMin, rightNum)->compute(right, left, rightDisparity_);
+    consistencyCheck(disparity, rightDisparity_, p.minDisparity, rightMin, max_lr_diff, confidence);
+}
+
+void MultiResDisparity::run(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat* confidence)
+{
+    if (scale_ == 1) {
+        low_.compute(left, right, disparity);
+        if (confidence)
+            check(left, right, disparity, *confidence);
+        return;
+    }
+    const double f{ 1.0 / scale_ };
+    cv::resize(left, smallL_, cv::Size(), f, f, cv::INTER_AREA);
+    cv::resize(right, smallR_, cv::Size(), f, f, cv::INTER_AREA);
+    low_.compute(smallL_, smallR_, lowDisparity_);
+    if (confidence)
+        check(smallL_, smallR_, lowDisparity_, lowConfidence_);
+
+    // Disparity (full resolution px) & validity, upsampled then filtered along the full resolution edges
+    const short lowest{ (short)(low_.params().minDisparity * 16) };
+    cv::Mat valid, d;
+    cv::compare(lowDisparity_, lowest, valid, cv::CMP_GE);
+    valid.convertTo(valid, CV_32F, 1.0 / 255);
+    lowDisparity_.convertTo(d, CV_32F, scale_ / 16.0);
+    d = d.mul(valid);
+    cv::resize(d, d, left.size(), 0, 0, cv::INTER_LINEAR);
+    cv::resize(valid, valid, left.size(), 0, 0, cv::INTER_LINEAR);
+
+    cv::Mat guide;
+    if (left.channels() == 3)
+        cv::cvtColor(left, guide, cv::COLOR_BGR2GRAY);
+    else
+        guide = left;
+    const int radius{ 2 * scale_ };
+    cv::Mat num, den;
+    cv::ximgproc::guidedFilter(guide, d, num, radius, guide_eps);
+    cv::ximgproc::guidedFilter(guide, valid, den, radius, guide_eps);
+
+    disparity.create(left.size(), CV_16S);
+    if (confidence)
+        cv::resize(lowConfidence_, *confidence, left.size(), 0, 0, cv::INTER_LINEAR);
+    const short invalid{ (short)((params_.minDisparity - 1) * 16) };
+    for (int y{ 0 }; y < disparity.rows; ++y) {
+        const float* dp = num.ptr<float>(y);
+        const float* vp = den.ptr<float>(y);
+        short* o = disparity.ptr<short>(y);
+        uchar* c = confidence ? confidence->ptr<uchar>(y) : nullptr;
+        for (int x{ 0 }; x < disparity.cols; ++x) {
+            const bool valid{ vp[x] >= 0.5f };
+            o[x] = valid ? cv::saturate_cast<short>(16.f * dp[x] / vp[x]) : invalid;
+            if (c && !valid)
+                c[x] = 0;
+        }
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * omni_disparity.h
+ * Disparity of a rectified stream with temporally narrowed search ranges
+ *
+ * The SGBM cost volume (& time) grows with the number of disparities
+ * searched, while consecutive frames of a stream mostly see the same
+ * depths. In temporal mode the image is split into tiles & each tile is
+ * searched only around the disparities the previous frame found there
+ * (its 2 - 98 % range plus a margin, rounded up to 16). A tile goes back
+ * to the full range when the previous frame had too few valid disparities
+ * in it, when the image changed too much there (motion), and on every
+ * refreshInterval-th frame so new nearer objects are picked up.
+ *
+ * Tiles are matched in parallel, each with the columns its range needs
+ * & a margin of rows, and written into one disparity map in the format of
+ * cv::StereoSGBM (CV_16S, 16 x disparity, (minDisparity - 1) * 16 where
+ * invalid).
+ *
+ * MultiResDisparity matches a half / quarter resolution copy of the pair
+ * instead (scale^2 fewer pixels, range / scale disparities) and upsamples
+ * the result to the full resolution with a guided filter on the full
+ * resolution left image, so disparity edges follow the image edges. The
+ * filter is applied as a normalised convolution (disparity x validity,
+ * divided by the filtered validity), invalid pixels don't bleed into their
+ * neighbours.
+ *
+ * With a confidence output, the right image is matched to the left one as
+ * well (as cv::ximgproc::createRightMatcher does) & both are checked
+ * against each other in one row parallel pass: a left disparity is kept
+ * when the right disparity at its match agrees within max 1 px, with a
+ * confidence falling from 255 at an exact (1/16 px) agreement to 0 at
+ * 1 px. MultiResDisparity checks at the reduced resolution, so rejected
+ * pixels are left out of the upsampling as well. The right image is
+ * searched over the span of the frame's left disparities as a whole, not
+ * per tile: with a confidence output a temporal frame costs up to one
+ * extra match over that span.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_DISPARITY_H
+#define OMNI_DISPARITY_H
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/core.hpp"
+#include <vector>
+
+struct DisparityParams {
+    int minDisparity{ 0 };
+    int numDisparities{ 16 * 15 }; //Full range, multiple of 16
+    int blockSize{ 9 }; //Odd, 3 - 11
+    int preFilterCap{ 30 };
+    int mode{ cv::StereoSGBM::MODE_SGBM };
+};
+
+// SGBM of params, searching numDisparities from minDisparity, P1 & P2 as in omni_rectify_stereo
+cv::Ptr<cv::StereoSGBM> createSGBM(const DisparityParams& params, int channels, int minDisparity, int numDisparities);
+
+// Left / right consistency: disparity is made invalid in place where the disparity of the right image at its match
+// (negative, searched from rightMinDisparity, as from cv::ximgproc::createRightMatcher) differs by more than maxDiff px.
+// confidence: CV_8U, 255 at an exact agreement down to 0 at maxDiff, 0 where invalid
+void consistencyCheck(cv::Mat& disparity, const cv::Mat& rightDisparity, int minDisparity, int rightMinDisparity, double maxDiff, cv::Mat& confidence);
+
+class TemporalDisparity {
+public:
+    TemporalDisparity(const DisparityParams& params, bool temporal = true, int tileSize = 128, int refreshInterval = 30);
+
+    // Rectified pair, same size & type, frames of one stream
+    void compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity);
+    // Forget the previous frame, the next one is searched over the full range
+    void reset();
+
+    // Disparities searched in the last frame, fraction of the full range everywhere
+    double searchedFraction() const { return searched_; }
+    const DisparityParams& params() const { return params_; }
+
+private:
+    struct Range {
+        int minDisparity, numDisparities;
+    };
+
+    Range tileRange(const cv::Rect& tile, const cv::Mat& gray) const;
+
+    DisparityParams params_;
+    bool temporal_;
+    int tileSize_, refreshInterval_;
+    cv::Mat prevDisparity_, prevGray_;
+    long frame_{ 0 };
+    double searched_{ 1.0 };
+};
+
+class MultiResDisparity {
+public:
+    // scale: 1 (full resolution), 2 or 4, params of the full resolution
+    MultiResDisparity(const DisparityParams& params, int scale, bool temporal = false);
+
+    // Full resolution disparity of a rectified pair, same format as TemporalDisparity
+    void compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity);
+    // Same, left / right checked, with its confidence (see consistencyCheck)
+    void compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat& confidence);
+    void reset() { low_.reset(); }
+
+    double searchedFraction() const { return low_.searchedFraction(); }
+    int scale() const { return scale_; }
+
+private:
+    void run(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat* confidence);
+    void check(const cv::Mat& left, const cv::Mat& right, cv::Mat& disparity, cv::Mat& confidence);
+
+    DisparityParams params_;
+    int scale_;
+    TemporalDisparity low_;
+    cv::Mat smallL_, smallR_, lowDisparity_, rightDisparity_, lowConfidence_;
+};
+
+#endif
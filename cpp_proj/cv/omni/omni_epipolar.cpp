@@ -0,0 +1,184 @@
+#include "omni_epipolar.h"
+
+#include "opencv2/features2d.hpp"
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int min_matches{ 20 }; //For a check to count
+const double max_row_gate{ 0.1 }; //Matches further apart in rows (fraction of the height) are mismatches
+
+// N x 3 homogeneous points
+cv::Mat homogeneous(const std::vector<cv::Point2f>& pts)
+{
+    cv::Mat x((int)pts.size(), 3, CV_64F);
+    for (int i{ 0 }; i < x.rows; ++i) {
+        double* r = x.ptr<double>(i);
+        r[0] = pts[i].x;
+        r[1] = pts[i].y;
+        r[2] = 1.0;
+    }
+    return x;
+}
+
+double percentile(std::vector<double>& v, double q)
+{
+    const size_t k{ std::min(v.size() - 1, (size_t)(q * v.size())) };
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+} // namespace
+
+cv::Mat sampsonDistances(const cv::Matx33d& F, const std::vector<cv::Point2f>& pts1, const std::vector<cv::Point2f>& pts2)
+{
+    CV_Assert(pts1.size() == pts2.size());
+    if (pts1.empty())
+        return cv::Mat(0, 1, CV_64F);
+    const cv::Mat x1{ homogeneous(pts1) }, x2{ homogeneous(pts2) }, Fm(F);
+    const cv::Mat l2{ x1 * Fm.t() }; //Row i: F x1_i, epipolar line in image 2
+    const cv::Mat l1{ x2 * Fm }; //Row i: F^T x2_i, in image 1
+    cv::Mat num, den;
+    cv::reduce(x2.mul(l2), num, 1, cv::REDUCE_SUM); //x2^T F x1
+    den = l2.col(0).mul(l2.col(0)) + l2.col(1).mul(l2.col(1)) + l1.col(0).mul(l1.col(0)) + l1.col(1).mul(l1.col(1));
+    cv::sqrt(den, den);
+    cv::Mat d;
+    cv::divide(cv::abs(num), den, d);
+    return d;
+}
+
+cv::Mat rowOffsets(const std::vector<cv::Point2f>& pts1, const std::vector<cv::Point2f>& pts2)
+{
+    CV_Assert(pts1.size() == pts2.size());
+    if (pts1.empty())
+        return cv::Mat(0, 1, CV_64F);
+    cv::Mat y1, y2;
+    cv::Mat(pts1).reshape(1).col(1).convertTo(y1, CV_64F);
+    cv::Mat(pts2).reshape(1).col(1).convertTo(y2, CV_64F);
+    return y2 - y1;
+}
+
+EpipolarStats epipolarStats(const cv::Mat& errors)
+{
+    EpipolarStats s;
+    s.matches = (int)errors.total();
+    if (!s.matches)
+        return s;
+    std::vector<double> e, a;
+    errors.reshape(1, 1).copyTo(e);
+    for (double v : e)
+        a.push_back(std::abs(v));
+    s.median = percentile(a, 0.5);
+    s.p90 = percentile(a, 0.9);
+    s.bias = percentile(e, 0.5);
+    return s;
+}
+
+void matchFeatures(const cv::Mat& img1, const cv::Mat& img2, std::vector<cv::Point2f>& pts1, std::vector<cv::Point2f>& pts2, int maxFeatures, float ratio)
+{
+    pts1.clear();
+    pts2.clear();
+    cv::Ptr<cv::ORB> orb = cv::ORB::create(maxFeatures);
+    std::vector<cv::KeyPoint> kp1, kp2;
+    cv::Mat desc1, desc2;
+    orb->detectAndCompute(img1, cv::noArray(), kp1, desc1);
+    orb->detectAndCompute(img2, cv::noArray(), kp2, desc2);
+    if (desc1.empty() || desc2.empty())
+        return;
+    cv::BFMatcher matcher(cv::NORM_HAMMING);
+    std::vector<std::vector<cv::DMatch> > knn;
+    matcher.knnMatch(desc1, desc2, knn, 2);
+    for (const std::vector<cv::DMatch>& m : knn)
+        if (m.size() == 2 && m[0].distance < ratio * m[1].distance) {
+            pts1.push_back(kp1[m[0].queryIdx].pt);
+            pts2.push_back(kp2[m[0].trainIdx].pt);
+        }
+}
+
+EpipolarMonitor::EpipolarMonitor(double alpha, double maxDrift, int maxFeatures)
+    : alpha_(alpha)
+    , maxDrift_(maxDrift)
+    , maxFeatures_(maxFeatures)
+    , worker_(&EpipolarMonitor::run, this)
+{
+}
+
+EpipolarMonitor::~EpipolarMonitor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+}
+
+bool EpipolarMonitor::idle()
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return !busy_;
+}
+
+void EpipolarMonitor::submit(const cv::Mat& left, const cv::Mat& right)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        left_ = left;
+        right_ = right;
+        busy_ = true;
+    }
+    cv_.notify_one();
+}
+
+bool EpipolarMonitor::poll(EpipolarStats& stats)
+{
+    std::lock_guard<std::mutex> lock(m_);
+    if (!ready_)
+        return false;
+    stats = stats_;
+    ready_ = false;
+    return true;
+}
+
+double EpipolarMonitor::drift()
+{
+    std::lock_guard<std::mutex> lock(m_);
+    return drift_;
+}
+
+void EpipolarMonitor::run()
+{
+    for (;;) {
+        cv::Mat left, right;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            cv_.wait(lock, [this] { return stop_ || busy_; });
+            if (stop_)
+                return;
+            left = left_;
+            right = right_;
+            left_.release();
+            right_.release();
+        }
+
+        std::vector<cv::Point2f> pts1, pts2, in1, in2;
+        matchFeatures(left, right, pts1, pts2, maxFeatures_);
+        const double gate{ max_row_gate * left.rows };
+        for (size_t i{ 0 }; i < pts1.size(); ++i)
+            if (std::abs(pts2[i].y - pts1[i].y) < gate) {
+                in1.push_back(pts1[i]);
+                in2.push_back(pts2[i]);
+            }
+        const EpipolarStats stats{ epipolarStats(rowOffsets(in1, in2)) };
+
+        std::lock_guard<std::mutex> lock(m_);
+        stats_ = stats;
+        if (stats.matches >= min_matches)
+            drift_ = drift_ < 0 ? stats.median : (1 - alpha_) * drift_ + alpha_ * stats.median;
+        ready_ = true;
+        busy_ = false;
+    }
+}
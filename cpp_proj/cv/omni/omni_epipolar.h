@@ -0,0 +1,76 @@
+/*
+ * omni_epipolar.h
+ * Epipolar consistency of stereo matches & drift monitoring
+ *
+ * The errors of all the matches are computed at once with matrix
+ * operations: the Sampson distance against a fundamental matrix (1 product
+ * per image for all the epipolar lines), or the row offset of a rectified
+ * pair, where matches should lie on the same row.
+ *
+ * EpipolarMonitor checks a live rectified pair in the background: frames
+ * are only handed over when the previous check is done, features are
+ * matched (ORB, ratio test) & the median row offset of the matches is
+ * smoothed over the checks into a drift metric. A calibrated rig stays
+ * well under a pixel; a rig whose extrinsics moved (knock, temperature,
+ * loose mount) drifts up long before the depth output is visibly wrong.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_EPIPOLAR_H
+#define OMNI_EPIPOLAR_H
+
+#include "opencv2/core.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct EpipolarStats {
+    int matches{ 0 };
+    double median{ 0.0 }; //|error|, px
+    double p90{ 0.0 }; //90th percentile of |error|, px
+    double bias{ 0.0 }; //Median signed error, px
+};
+
+// Sampson distance (px) of each match x2^T F x1 = 0, N x 1 CV_64F
+cv::Mat sampsonDistances(const cv::Matx33d& F, const std::vector<cv::Point2f>& pts1, const std::vector<cv::Point2f>& pts2);
+// y2 - y1 of each match of a rectified pair, N x 1 CV_64F
+cv::Mat rowOffsets(const std::vector<cv::Point2f>& pts1, const std::vector<cv::Point2f>& pts2);
+EpipolarStats epipolarStats(const cv::Mat& errors);
+
+// Matched points of 2 images (ORB, Lowe's ratio test)
+void matchFeatures(const cv::Mat& img1, const cv::Mat& img2, std::vector<cv::Point2f>& pts1, std::vector<cv::Point2f>& pts2,
+    int maxFeatures = 1000, float ratio = 0.75f);
+
+class EpipolarMonitor {
+public:
+    // alpha: smoothing of the drift over the checks, maxDrift: median row offset (px) for degraded()
+    explicit EpipolarMonitor(double alpha = 0.2, double maxDrift = 1.0, int maxFeatures = 1000);
+    ~EpipolarMonitor();
+
+    bool idle();
+    // Rectified pair, only when idle(), the images must not be written to afterwards
+    void submit(const cv::Mat& left, const cv::Mat& right);
+    // Stats of the latest finished check, once
+    bool poll(EpipolarStats& stats);
+
+    // Smoothed median row offset, px (-1 before the first check with enough matches)
+    double drift();
+    bool degraded() { return drift() > maxDrift_; }
+
+private:
+    void run();
+
+    const double alpha_, maxDrift_;
+    const int maxFeatures_;
+    std::mutex m_;
+    std::condition_variable cv_;
+    cv::Mat left_, right_;
+    EpipolarStats stats_;
+    double drift_{ -1.0 };
+    bool busy_{ false }, ready_{ false }, stop_{ false };
+    std::thread worker_; //Last, started once the rest is initialised
+};
+
+#endif
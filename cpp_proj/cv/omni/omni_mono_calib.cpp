@@ -21,9 +21,21 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/ccalib/omnidir.hpp"
 #include "opencv2/calib3d.hpp"
+#include "omni_refine.h"
+#include "omni_residuals.h"
+#include "view_selection.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <string>
 #include <vector>
 
+#define MAX_VIEWS 40 //Views kept for the solve by default, 0: all
+#define REJECT_SIGMA 3.0 //Outlier views: RMS above median + REJECT_SIGMA * robust stddev of the views' RMS
+#define REJECT_MIN_RMS 0.5 //px, views under it are always kept
+#define REJECT_MAX_FRACTION 0.1 //Of the views dropped per round
+#define REJECT_ROUNDS 5
+
 static int err(const std::string& msg, const int& rval)
 {
     std::cerr << msg << std::endl;
@@ -106,7 +118,9 @@ static void saveCameraParams(const std::string& filename, int flags,
     std::vector<std::string> detec_list,
     const cv::Mat& idx,
     const double rms,
-    const std::vector<cv::Mat>& imagePoints)
+    const std::vector<cv::Mat>& imagePoints,
+    const std::vector<ViewError>& errors,
+    const std::vector<std::string>& rejected)
 {
     cv::FileStorage fs(filename, cv::FileStorage::WRITE);
     time_t tt;
@@ -145,22 +159,116 @@ static void saveCameraParams(const std::string& filename, int flags,
 
     fs << "rms" << rms;
 
-    if (!imagePoints.empty()) {
-        cv::Mat imageMat((int)imagePoints.size(), (int)imagePoints[0].total(), CV_64FC2);
-        for (int i{ 0 }; i < (int)imagePoints.size(); ++i) {
+    if (!imagePoints.empty() && !idx.empty()) {
+        cv::Mat imageMat((int)idx.total(), (int)imagePoints[0].total(), CV_64FC2);
+        for (int i{ 0 }; i < imageMat.rows; ++i) {
             cv::Mat r = imageMat.row(i).reshape(2, imageMat.cols);
-            cv::Mat imagei{ imagePoints[i] };
+            cv::Mat imagei{ imagePoints[idx.at<int>(i)] };
             imagei.copyTo(r);
         }
-        fs << "image_points" << imageMat;
+        fs << "image_points" << imageMat; //Of the used images, same order as used_imgs & extrinsic_parameters
     }
+
+    writeViewErrors(fs, "", errors);
+    fs << "rejected_imgs" //Images dropped as outliers
+       << "[";
+    for (const std::string& name : rejected)
+        fs << name;
+    fs << "]";
     std::cout << "\n=== Calibration Done! ===\n" << std::endl;
 }
 
+// Intrinsics of a previous calibration, with its used images, their corners & board poses if it has them
+static bool readPriorCalibration(const std::string& filename, const cv::Size& boardSize, OmniIntrinsics& cam,
+    std::vector<std::string>& list, std::vector<cv::Mat>& imagePoints, std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs)
+{
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened() || !cam.read(fs))
+        return false;
+    cv::Mat ext, points;
+    fs["extrinsic_parameters"] >> ext;
+    fs["image_points"] >> points;
+    const cv::FileNode used = fs["used_imgs"];
+    // Older files have the corners of every detected image, which don't match the used ones
+    if (used.type() != cv::FileNode::SEQ || (int)used.size() != ext.rows || ext.cols != 6 || points.rows != ext.rows || points.cols != boardSize.area()) {
+        std::cout << "\nPrior views not reusable, only the intrinsics are" << std::endl;
+        return true;
+    }
+    ext.convertTo(ext, CV_64F);
+    points.convertTo(points, CV_64FC2);
+    for (int i{ 0 }; i < ext.rows; ++i) {
+        list.push_back((std::string)used[i]);
+        imagePoints.push_back(points.row(i).reshape(2, points.cols).clone());
+        rvecs.push_back(cv::Vec3d(ext.ptr<double>(i)));
+        tvecs.push_back(cv::Vec3d(ext.ptr<double>(i) + 3));
+    }
+    return true;
+}
+
+// Drops the outlier views & re-solves from the current solution until none stands out, returns the errors of the kept views
+static std::vector<ViewError> rejectOutliers(const int flags, const cv::TermCriteria& criteria, OmniIntrinsics& cam, double& rms,
+    std::vector<cv::Mat>& objectPoints, std::vector<cv::Mat>& imagePoints, std::vector<std::string>& detec_list,
+    std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, std::vector<std::string>& rejected)
+{
+    std::vector<ViewError> errors;
+    for (int round{ 0 };; ++round) {
+        errors = viewErrors(objectPoints, imagePoints, cam, rvecs, tvecs);
+        if (round == REJECT_ROUNDS)
+            break;
+        std::vector<double> viewRms;
+        for (const ViewError& e : errors)
+            viewRms.push_back(e.rms);
+        const int maxDrop{ std::min((int)std::ceil(REJECT_MAX_FRACTION * viewRms.size()), (int)viewRms.size() - 3) };
+        std::vector<int> out{ outlierViews(viewRms, REJECT_SIGMA, REJECT_MIN_RMS, maxDrop) };
+        if (out.empty())
+            break;
+
+        std::sort(out.rbegin(), out.rend()); //Erase from the back
+        for (int i : out) {
+            std::cout << "[ \x1B[31m✘\033[0m ] " << viewRms[i] << " px: " << detec_list[i] << std::endl;
+            rejected.push_back(detec_list[i]);
+            objectPoints.erase(objectPoints.begin() + i);
+            imagePoints.erase(imagePoints.begin() + i);
+            detec_list.erase(detec_list.begin() + i);
+            rvecs.erase(rvecs.begin() + i);
+            tvecs.erase(tvecs.begin() + i);
+        }
+        rms = refineMono(objectPoints, imagePoints, cam, rvecs, tvecs, flags, criteria);
+        std::cout << "Re-solved without " << out.size() << " outlier view(s), RMS: " << rms << std::endl;
+    }
+    return errors;
+}
+
+// Keeps a bounded, pose-diverse subset of the detected views & writes the coverage heatmap of the kept ones
+static void selectViews(const int maxViews, const cv::Size& boardSize, const cv::Size& imageSize, const char* heatmapFilename,
+    std::vector<std::string>& detec_list, std::vector<cv::Mat>& imagePoints)
+{
+    ViewSelector selector(imageSize, boardSize);
+    for (const cv::Mat& points : imagePoints)
+        selector.add(points);
+    std::vector<int> all(imagePoints.size());
+    for (int i{ 0 }; i < (int)all.size(); ++i)
+        all[i] = i;
+    const std::vector<int> picked{ selector.select(maxViews) };
+
+    std::vector<std::string> list;
+    std::vector<cv::Mat> points;
+    for (int i : picked) {
+        list.push_back(detec_list[i]);
+        points.push_back(imagePoints[i]);
+    }
+    detec_list.swap(list);
+    imagePoints.swap(points);
+
+    cv::imwrite(heatmapFilename, selector.heatmap(picked, imageSize));
+    std::cout << "\nViews selected: " << picked.size() << " / " << all.size() << "\nImage coverage:\t" << 100 * selector.coveredFraction(picked)
+              << "% (all views: " << 100 * selector.coveredFraction(all) << "%), heatmap: " << heatmapFilename << std::endl;
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 5)
-        return err((std::string) "\nUsage: " + argv[0] + "  [IMG_LIST]  [CHECKBOARD_HORIZONTAL_POINTS]   [CHECKBOARD_VERTICAL_POINTS]  [SQUARE_WIDTH (mm)]\n", 1);
+        return err((std::string) "\nUsage: " + argv[0] + "  [IMG_LIST]  [CHECKBOARD_HORIZONTAL_POINTS]   [CHECKBOARD_VERTICAL_POINTS]  [SQUARE_WIDTH (mm)]  [MAX_VIEWS (" + std::to_string(MAX_VIEWS) + ", 0: all)]  [PRIOR_CAMERA_PARAMS]\n", 1);
 
     if (atoi(argv[2]) <= 2 || atoi(argv[3]) <= 2)
         return err("\n[CHECKBOARD_HORIZONTAL_POINTS] & [CHECKBOARD_VERTICAL_POINTS] have to be > 2!\n", 2);
@@ -171,8 +279,11 @@ int main(int argc, char** argv)
     cv::Size boardSize(atoi(argv[2]), atoi(argv[3])); //8 x 5
     cv::Size imageSize; //Img width & height
 
-    constexpr int flags = cv::omnidir::CALIB_FIX_SKEW + cv::omnidir::CALIB_FIX_CENTER;
+    const char* priorFilename{ argc > 6 ? argv[6] : nullptr }; //Incremental recalibration from it
+    const int flags{ cv::omnidir::CALIB_FIX_SKEW + cv::omnidir::CALIB_FIX_CENTER + (priorFilename ? cv::omnidir::CALIB_USE_GUESS : 0) };
     const char* outputFilename = "./out_camera_params.xml"; //Save in current working directory
+    const char* heatmapFilename = "./coverage.png";
+    const int maxViews{ argc > 5 ? atoi(argv[5]) : MAX_VIEWS };
 
     const double square_width{ atof(argv[4]) }; //0.03;
 
@@ -190,7 +301,7 @@ int main(int argc, char** argv)
             flags & cv::omnidir::CALIB_FIX_CENTER ? "fix_center " : "");
     }
 
-    std::cout << "\n[CONFIG]\nIMG_LIST Path:\t\t\t" << argv[1] << "\nCHECKBOARD_HORIZONTAL_POINTS:\t" << argv[2] << "\nCHECKBOARD_VERTICAL_POINTS:\t" << argv[3] << "\nSQUARE_WIDTH (mm):\t\t" << argv[4] << "\nFLAGS:\t\t\t\t" << buf << "\nOutput path:\t\t\t" << outputFilename << std::endl;
+    std::cout << "\n[CONFIG]\nIMG_LIST Path:\t\t\t" << argv[1] << "\nCHECKBOARD_HORIZONTAL_POINTS:\t" << argv[2] << "\nCHECKBOARD_VERTICAL_POINTS:\t" << argv[3] << "\nSQUARE_WIDTH (mm):\t\t" << argv[4] << "\nMAX_VIEWS:\t\t\t" << maxViews << "\nPRIOR:\t\t\t\t" << (priorFilename ? priorFilename : "None") << "\nFLAGS:\t\t\t\t" << buf << "\nOutput path:\t\t\t" << outputFilename << std::endl;
 
     std::vector<cv::Mat> objectPoints, imagePoints;
     std::vector<std::string> image_list, detec_list; // get image name list
@@ -198,11 +309,30 @@ int main(int argc, char** argv)
     if (!readStringList(argv[1], image_list))
         return err("Failed to read image list!\n", -1);
 
+    // incremental: the images the prior calibration used are not detected again
+    OmniIntrinsics prior;
+    std::vector<std::string> prior_list;
+    std::vector<cv::Mat> prior_points;
+    std::vector<cv::Vec3d> prior_rvecs, prior_tvecs;
+    if (priorFilename) {
+        if (!readPriorCalibration(priorFilename, boardSize, prior, prior_list, prior_points, prior_rvecs, prior_tvecs))
+            return err("Failed to read prior camera params!\n", -1);
+        image_list.erase(std::remove_if(image_list.begin(), image_list.end(), [&prior_list](const std::string& s) {
+            return std::find(prior_list.begin(), prior_list.end(), s) != prior_list.end();
+        }),
+            image_list.end());
+        std::cout << "Prior views: " << prior_list.size() << ", new images: " << image_list.size() << std::endl;
+    }
+
     // find corners in images
     // some images may fail automatic corner detection, images detected are in detec_list
-    if (!detecChessboardCorners(image_list, detec_list, imagePoints, boardSize, imageSize))
+    if (!detecChessboardCorners(image_list, detec_list, imagePoints, boardSize, imageSize) && prior_list.size() + detec_list.size() < 3)
         return err("Not enough corner detected images!\n", -1);
 
+    // the solve time grows with the views, most of a capture session is near duplicates
+    if (!detec_list.empty())
+        selectViews(maxViews, boardSize, imageSize, heatmapFilename, detec_list, imagePoints);
+
     // calculate object coordinates
     cv::Mat object;
     calcChessboardCorners(boardSize, square_width, object);
@@ -219,10 +349,65 @@ int main(int argc, char** argv)
       //  Mat newK;
       //  fisheye::estimateNewCameraMatrixForUndistortRectify(K, D, imageSize, Matx33d::eye(), newK, 1);
 
-    rms = cv::omnidir::calibrate(objectPoints, imagePoints, imageSize, K, xi, D, rvecs, tvecs, flags, criteria, idx);
-    _xi = xi.at<double>(0);
+    if (priorFilename) {
+        // warm start: new views posed with the prior intrinsics, then resume the optimisation from the prior solution
+        std::vector<std::string> list{ prior_list };
+        std::vector<cv::Mat> points{ prior_points };
+        rvecs = prior_rvecs;
+        tvecs = prior_tvecs;
+        for (int i{ 0 }; i < (int)detec_list.size(); ++i) {
+            cv::Vec3d r, t;
+            if (!estimateBoardPose(prior, object, imagePoints[i], r, t)) {
+                std::cout << "[ \x1B[31m✘\033[0m ] No pose: " << detec_list[i] << std::endl;
+                continue;
+            }
+            list.push_back(detec_list[i]);
+            points.push_back(imagePoints[i]);
+            rvecs.push_back(r);
+            tvecs.push_back(t);
+        }
+        detec_list.swap(list);
+        imagePoints.swap(points);
+        objectPoints.assign(detec_list.size(), object);
+
+        rms = refineMono(objectPoints, imagePoints, prior, rvecs, tvecs, flags, criteria);
+        K = cv::Mat(prior.K);
+        D = cv::Mat(prior.D).reshape(1, 1);
+        xi = cv::Mat(1, 1, CV_64F, cv::Scalar(prior.xi));
+        idx.create(1, (int)detec_list.size(), CV_32S);
+        for (int i{ 0 }; i < (int)idx.total(); ++i)
+            idx.at<int>(i) = i; //All views kept
+    }
+    else
+        rms = cv::omnidir::calibrate(objectPoints, imagePoints, imageSize, K, xi, D, rvecs, tvecs, flags, criteria, idx);
+
+    // only the views the solver kept, in its order
+    std::vector<std::string> used_list;
+    std::vector<cv::Mat> used_points;
+    for (int i{ 0 }; i < (int)idx.total(); ++i) {
+        used_list.push_back(detec_list[idx.at<int>(i)]);
+        used_points.push_back(imagePoints[idx.at<int>(i)]);
+    }
+    detec_list.swap(used_list);
+    imagePoints.swap(used_points);
+    objectPoints.assign(detec_list.size(), object);
+
+    // per view errors, one blurry frame shouldn't need a manual rerun
+    OmniIntrinsics cam;
+    cam.K = cv::Matx33d(K.ptr<double>());
+    cam.D = cv::Vec4d(D.ptr<double>());
+    cam.xi = xi.at<double>(0);
+    std::vector<std::string> rejected;
+    const std::vector<ViewError> errors{ rejectOutliers(flags, criteria, cam, rms, objectPoints, imagePoints, detec_list, rvecs, tvecs, rejected) };
+
+    K = cv::Mat(cam.K);
+    D = cv::Mat(cam.D).reshape(1, 1);
+    _xi = cam.xi;
+    idx.create(1, (int)detec_list.size(), CV_32S);
+    for (int i{ 0 }; i < (int)idx.total(); ++i)
+        idx.at<int>(i) = i;
     saveCameraParams(outputFilename, flags, K, D, _xi,
-        rvecs, tvecs, detec_list, idx, rms, imagePoints);
+        rvecs, tvecs, detec_list, idx, rms, imagePoints, errors, rejected);
 
     return 0;
 }
@@ -19,7 +19,11 @@
 #include "opencv2/core.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/ccalib/omnidir.hpp"
+#include "omni_tiles.h"
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include <vector>
 
 static cv::Mat node2array(const cv::FileNode& param, const std::string& sheader, const int& aWidth, const int& aHeight)
 {
@@ -53,7 +57,7 @@ int err(const std::string& msg, const int& rval)
 int main(int argc, char** argv)
 {
     if (argc < 4) // Check the number of parameters
-        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [IMG_TO_DISTORT]  [ZOOM_OUT_LEVEL]\n", 1);
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [IMG_TO_DISTORT]  [ZOOM_OUT_LEVEL]  [ROI x,y,w,h ...]\n", 1);
 
     const float zoomOut = atof(argv[3]); //Best around 2-6, negative would flip image horizontal + vertical
     if (zoomOut < 1.0 || zoomOut > 7.0)
@@ -100,7 +104,29 @@ int main(int argc, char** argv)
         0, 0, 1);
 
     std::cout << "\nRectifying IMG..." << std::endl;
+    int64 t = cv::getTickCount();
     cv::omnidir::undistortImage(distorted, undistorted, kMat, dMat, xiMat, flags_out, Knew, new_size);
+    std::cout << "Full image: " << (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency() << " ms" << std::endl;
+
+    //Only the given regions of the rectified image, tile by tile
+    std::vector<cv::Mat> crops;
+    if (argc > 4) {
+        OmniIntrinsics cam;
+        cam.K = cv::Matx33d(kMat.ptr<double>());
+        cam.D = cv::Vec4d(dMat.ptr<double>());
+        cam.xi = xiMat.at<double>(0);
+        TileRectifier tiles(cam, distorted.size(), UnwrapView::pinhole("rectified", cv::Matx33d(Knew), new_size));
+        t = cv::getTickCount();
+        tiles.setFrame(distorted);
+        for (int i{ 4 }; i < argc; ++i) {
+            cv::Rect roi;
+            if (std::sscanf(argv[i], "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) != 4)
+                return err((std::string) "\nInvalid ROI: " + argv[i] + ", expected x,y,w,h\n", 1);
+            crops.push_back(cv::Mat());
+            tiles.rectify(roi, crops.back());
+        }
+        std::cout << "ROIs: " << (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency() << " ms, " << tiles.mappedTiles() << " tile maps built" << std::endl;
+    }
 
     kMat.release();
     dMat.release();
@@ -111,6 +137,9 @@ int main(int argc, char** argv)
 
     cv::imshow("Original", distorted);
     cv::imshow("Undistort", undistorted);
+    for (size_t i{ 0 }; i < crops.size(); ++i)
+        if (!crops[i].empty())
+            cv::imshow("ROI " + std::to_string(i), crops[i]);
     cv::waitKey(0);
 
     cv::destroyWindow("Original");
@@ -21,12 +21,17 @@
 #include "opencv2/highgui.hpp"
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp> // drawing shapes
-#include <opencv2/ximgproc.hpp>
-#include "opencv2/ccalib/omnidir.hpp"
    #include "opencv2/xfeatures2d.hpp"
 #include <opencv2/features2d.hpp>
 #include <iostream>
 
+#include "marker_renderer.h"
+#include "omni_disparity.h"
+#include "omni_epipolar.h"
+#include "omni_refine.h"
+#include "omni_stereo.h"
+#include "stereo_canvas.h"
+
 static cv::Mat node2array(const cv::FileNode& param, const std::string& sheader, const int& aWidth, const int& aHeight)
 {
     int x{ 0 }, y{ 0 };
@@ -96,12 +101,16 @@ for(int k=start;k<stop+1;++k)
 int main(int argc, char** argv)
 {
     if (argc < 5) // Check the number of parameters
-        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [IMG_TO_DISTORT_LEFT]  [IMG_TO_DISTORT_RIGHT]  [ZOOM_OUT_LEVEL]\n", 1);
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [IMG_TO_DISTORT_LEFT]  [IMG_TO_DISTORT_RIGHT]  [ZOOM_OUT_LEVEL]  [DISPARITY_SCALE (1|2|4)]\n", 1);
 
     const float zoomOut = atof(argv[4]); //Best around 2-6, negative would flip image horizontal + vertical
     if (zoomOut < 1.0 || zoomOut > 7.0)
         return err((std::string) "\nZOOM_OUT_LEVEL invalid:" + std::to_string(zoomOut) + "\nPlease enter range between 1.0 <-> 7.0\n", 1);
 
+    const int disparityScale = argc > 5 ? atoi(argv[5]) : 1; //Disparity matched at 1 / scale resolution, then upsampled
+    if (disparityScale != 1 && disparityScale != 2 && disparityScale != 4)
+        return err("\nDISPARITY_SCALE invalid, please enter 1, 2 or 4\n", 1);
+
     std::string filename{ argv[1] }; //1st arg
     std::cout << "Reading calibration file: " << filename << "\nTarget Left: " << argv[2] << "\nTarget Right: " << argv[3] << "\nZOOM_OUT_LEVEL: " << zoomOut << std::endl;
     cv::FileStorage fs(filename, cv::FileStorage::READ);
@@ -151,35 +160,30 @@ int main(int argc, char** argv)
         return err("Could not read img...", -1);
 
 
-    cv::Size new_size(distorted_l.cols, distorted_l.rows);
-
-    const int centerX{ new_size.width / 2 };
-    const int centerY{ new_size.height / 2 };
-
-    //   constexpr int flags_out = cv::omnidir::RECTIFY_PERSPECTIVE, RECTIFY_LONGLATI;
-    constexpr int flags_out = cv::omnidir::RECTIFY_PERSPECTIVE;
-    constexpr float aspectRatio{ 1.7 };
-
-    /*
-    cv::Matx33f Knew = cv::Matx33f(new_size.width / (aspectRatio * zoomOut), 0, centerX,
-        0, new_size.height / zoomOut, centerY,
-        0, 0, 1);
-*/
-    cv::Matx33f Knew = cv::Matx33f(new_size.width / 3.142, 0, flags_out == cv::omnidir::RECTIFY_PERSPECTIVE ? centerX : 0,
-        0, new_size.height / 3.142, flags_out == cv::omnidir::RECTIFY_PERSPECTIVE ? centerY : 0,
-        0, 0, 1);
-
     std::cout << "\nRectifying IMG..." << std::endl;
 
     cv::Size imgSize = distorted_l.size();
-    int numDisparities = 16 * 15;
-    int SADWindowSize = 9;
-    cv::Mat disMap;
-    int pointType = cv::omnidir::XYZRGB; //cv::omnidir::XYZrgb
-    // the range of theta is (0, pi) and the range of phi is (0, pi)
 
-    cv::Mat imageRec1, imageRec2, pointCloud;
-    cv::omnidir::stereoReconstruct(distorted_l, distorted_r, kMat_l, dMat_l, xiMat_l, kMat_r, dMat_r, xiMat_r, rMat, tMat, flags_out, numDisparities, SADWindowSize, disMap, imageRec1, imageRec2, imgSize, Knew, pointCloud);
+    OmniIntrinsics cam1, cam2;
+    if (!cam1.read(fs, "_1") || !cam2.read(fs, "_2"))
+        return err("Invalid stereo calibration file!", -1);
+    DisparityParams params;
+    params.minDisparity = -10;
+    params.numDisparities = 16 * 15;
+    params.blockSize = 9; //Range: 3 - 11, odd num
+    OmniStereo stereo(cam1, cam2, rMat, tMat, imgSize, params, disparityScale);
+
+    //Rectified pair is written straight into the halves of the display canvas, only what is shown below is computed
+    StereoCanvas recCanvas(imgSize, distorted_l.type());
+    OmniStereo::Result rec;
+    rec.left = recCanvas.left();
+    rec.right = recCanvas.right();
+    int64 t = cv::getTickCount();
+    stereo.compute(distorted_l, distorted_r, OmniStereo::RECTIFIED | OmniStereo::DISPARITY | OmniStereo::POINT_CLOUD | OmniStereo::CONFIDENCE, rec);
+    std::cout << "Stereo (disparity at 1/" << disparityScale << " resolution): " << (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency() << " ms" << std::endl;
+    cv::Mat& imageRec1 = recCanvas.left();
+    cv::Mat& imageRec2 = recCanvas.right();
+    cv::Mat pointCloud = rec.pointCloud;
 
 
 //Sift
@@ -189,13 +193,20 @@ int main(int argc, char** argv)
   f2d->detect( imageRec1, keypoints_1 );
   f2d->detect( imageRec2, keypoints_2 );
 
-cv::Mat output1,output2;
-    cv::drawKeypoints(imageRec1, keypoints_1, output1);
-    cv::drawKeypoints(imageRec2, keypoints_2, output2);
+    //Keypoints stamped on a copy of the rectified pair, all markers in one pass
+    StereoCanvas kpCanvas(imgSize, distorted_l.type());
+    imageRec1.copyTo(kpCanvas.left());
+    imageRec2.copyTo(kpCanvas.right());
+    cv::Mat kpView = kpCanvas.compose();
+    MarkerRenderer markers;
+    const int kpStyle = markers.style(3, cv::Scalar(0, 255, 0));
+    markers.add(keypoints_1, kpStyle);
+    for (size_t i = 0; i < keypoints_2.size(); i++) //Right half of the canvas
+        markers.add(keypoints_2[i].pt.x + imgSize.width, keypoints_2[i].pt.y, kpStyle);
+    markers.render(kpView);
 
  cv::namedWindow("uu", cv::WINDOW_NORMAL);
-    hconcat(output1, output2, output1);
-    cv::imshow("uu", output1);
+    cv::imshow("uu", kpView);
     cv::waitKey(0);
 
  cv::Mat descriptors_1, descriptors_2;    
@@ -215,11 +226,11 @@ std::vector<cv::Point2f> pts2;
 
     for (size_t i = 0; i < knn_matches.size(); i++)
     {
-        if (knn_matches[i][0].distance < ratio_thresh * knn_matches[i][1].distance)
+        if (knn_matches[i].size() == 2 && knn_matches[i][0].distance < ratio_thresh * knn_matches[i][1].distance)
         {
             good_matches.push_back(knn_matches[i][0]);
-	pts1.push_back(keypoints_1[i].pt);
-	pts2.push_back(keypoints_2[i].pt);
+	pts1.push_back(keypoints_1[knn_matches[i][0].queryIdx].pt);
+	pts2.push_back(keypoints_2[knn_matches[i][0].trainIdx].pt);
         }
     }
 
@@ -237,46 +248,31 @@ cv::namedWindow("lll", cv::WINDOW_NORMAL);
     cv::imshow("lll", outout);
     cv::waitKey(0);
 
+if (pts1.size() < 8)
+    return err("Not enough matches for the fundamental matrix...", -1);
+
 cv::Mat maskF;
 //Find fundamental matrix
 cv::Mat fundamentalMatrix = cv::findFundamentalMat(pts1,pts2,cv::FM_RANSAC,3,0.8, maskF);
+if (fundamentalMatrix.rows != 3)
+    return err("Could not estimate the fundamental matrix...", -1);
 std::cout<<fundamentalMatrix<<std::endl;
 
-std::cout<<pts1<<std::endl;
+//Epipolar errors of all the matches at once, against F & as row offsets of the rectified pair
+const EpipolarStats sampson = epipolarStats(sampsonDistances(cv::Matx33d((double*)fundamentalMatrix.ptr<double>()), pts1, pts2));
+const EpipolarStats rows = epipolarStats(rowOffsets(pts1, pts2));
+std::cout << "Matches: " << sampson.matches << "\nSampson distance (px) median: " << sampson.median << ", 90%: " << sampson.p90
+          << "\nRow offset (px) median: " << rows.median << ", 90%: " << rows.p90 << ", bias: " << rows.bias << std::endl;
+
 //Compute epilines
-    std::vector<cv::Vec3d> leftLines, rightLines;
+    std::vector<cv::Vec3d> rightLines;
     cv::computeCorrespondEpilines(pts1, 1, fundamentalMatrix, rightLines);
-    cv::computeCorrespondEpilines(pts2, 2, fundamentalMatrix, leftLines);
-
-    cv::Mat imagePointLeftCameraMatrix=cv::Mat_<double>(3,1);
 
 for(std::size_t i=0;i<rightLines.size();i=i+1)
     {
-        cv::Vec3d l=rightLines.at(i);
-	double a=l.val[0];
-        double b=l.val[1];
-        double c=l.val[2];
-        std::cout<<"------------------------a,b,c Using OpenCV (ax+by+c=0)------------------------------"<<std::endl;
-        std::cout<< a <<", "<<b <<", "<<c <<std::endl;
-        std::cout<<"------------------------calculating a,b,c (ax+by+c=0) ------------------------------"<<std::endl;
-        
-        imagePointLeftCameraMatrix.at<double>(0,0)=pts1[i].x;
-        imagePointLeftCameraMatrix.at<double>(1,0)=pts1[i].y;
-        imagePointLeftCameraMatrix.at<double>(2,0)=1;
-        cv::Mat rightLineMatrix=fundamentalMatrix*imagePointLeftCameraMatrix;
-        
-        std::cout<< rightLineMatrix.at<double>(0,0) <<", "<<rightLineMatrix.at<double>(0,1) <<", "<<rightLineMatrix.at<double>(0,2) <<std::endl;
-
-        /////////////////////////////////drawing the line on the image/////////////////////////////////
         /*ax+by+c=0*/
-        double x0,y0,x1,y1;
-        x0=0;
-        y0=(-c-a*x0)/b;
-	x1=imageRec2.cols;
-        y1=(-c-a*x1)/b;
-
-	std::cout<<"error: "<< a*pts2.at(i).x+ b*pts2.at(i).y +c<<std::endl;
-	cv::line(imageRec2, cv::Point(x0,y0), cv::Point(x1,y1), cvScalar(0,255,0), 1);
+        const cv::Vec3d& l=rightLines[i];
+	cv::line(imageRec2, cv::Point(0, -l[2] / l[1]), cv::Point(imageRec2.cols, (-l[2] - l[0] * imageRec2.cols) / l[1]), cv::Scalar(0,255,0), 1);
     }
 cv::namedWindow("kkk", cv::WINDOW_NORMAL);
     cv::imshow("kkk", imageRec1);
@@ -343,37 +339,12 @@ pts2.erase(it2);
         viewer.spinOnce(1, true);
     }
 
-    //sgbm
-    cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(0, numDisparities, SADWindowSize);
-
-    // param
-    int sgbmWinSize = 9; //5	Range: 3 - 11, odd num
-    int numberOfDisparities = 16 * 15;
-    int cn = 3;
-
-    // filter
-    cv::Ptr<cv::ximgproc::DisparityWLSFilter> wls_filter;
-    wls_filter = cv::ximgproc::createDisparityWLSFilter(sgbm);
-    cv::Ptr<cv::StereoMatcher> sm = cv::ximgproc::createRightMatcher(sgbm);
-
-    // init
-        sgbm->setMinDisparity(-10);
-    sgbm->setPreFilterCap(30); //30,100
-    sgbm->setBlockSize(sgbmWinSize);
-    sgbm->setP1(8 * cn * sgbmWinSize * sgbmWinSize);
-    sgbm->setP2(32 * cn * sgbmWinSize * sgbmWinSize);
-    sgbm->setMode(cv::StereoSGBM::MODE_SGBM); //MODE_SGBM_3WAY, MODE_HH (8Ways)
-
-    cv::Mat disparity16S, img16Sr;
-
-    sgbm->compute(imageRec1, imageRec2, disparity16S);
-    sm->compute(imageRec2, imageRec1, img16Sr);
-
+    //Disparity of the rectified pair, left / right checked, minDisparity -> 0
     cv::Mat showDisparity;
-    disparity16S.convertTo(showDisparity, CV_8UC1, 255 / (numberOfDisparities * 16.));
+    rec.disparity.convertTo(showDisparity, CV_8U, 255.0 / (params.numDisparities * 16.0), -255.0 * params.minDisparity / params.numDisparities);
 
     cv::imshow("disparity", showDisparity);
-    // cv::omnidir::undistortImage(distorted, undistorted, kMat, dMat, xiMat, flags_out, Knew, new_size);
+    cv::imshow("confidence", rec.confidence);
 
     kMat_l.release();
     dMat_l.release();
@@ -393,23 +364,22 @@ viewer.showWidget( "Cloud", cloud_widget );
 
     cv::namedWindow("Original", cv::WINDOW_NORMAL);
     cv::namedWindow("Undistort", cv::WINDOW_NORMAL);
-    cv::namedWindow("pcl", cv::WINDOW_NORMAL);
 
     //Original
-    hconcat(distorted_l, distorted_r, distorted_l);
-    draw_epipolar(distorted_l, 15);
-    cv::imshow("Original", distorted_l);
+    StereoCanvas origCanvas(distorted_l.size(), distorted_l.type());
+    distorted_l.copyTo(origCanvas.left());
+    distorted_r.copyTo(origCanvas.right());
+    draw_epipolar(origCanvas.compose(), 15);
+    cv::imshow("Original", origCanvas.compose());
     //Undistort
-    hconcat(imageRec1, imageRec2, imageRec1);
-    draw_epipolar(imageRec1, 15);
-    cv::imshow("Undistort", imageRec1);
+    draw_epipolar(recCanvas.compose(), 15);
+    cv::imshow("Undistort", recCanvas.compose());
 
-    cv::imshow("pcl", disMap);
     cv::waitKey(0);
 
     cv::destroyWindow("Original");
     cv::destroyWindow("Undistort");
-    cv::destroyWindow("pcl");
     cv::destroyWindow("disparity");
+    cv::destroyWindow("confidence");
     return 0;
 }
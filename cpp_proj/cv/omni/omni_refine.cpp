@@ -0,0 +1,407 @@
+#include "omni_refine.h"
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/ccalib/omnidir.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int n_intrinsics{ 10 }; //fx, fy, cx, cy, s, k1, k2, p1, p2, xi
+const int n_pose{ 6 }; //rvec, tvec
+
+void encode(const OmniIntrinsics& c, double* p)
+{
+    p[0] = c.K(0, 0);
+    p[1] = c.K(1, 1);
+    p[2] = c.K(0, 2);
+    p[3] = c.K(1, 2);
+    p[4] = c.K(0, 1);
+    for (int i{ 0 }; i < 4; ++i)
+        p[5 + i] = c.D[i];
+    p[9] = c.xi;
+}
+
+OmniIntrinsics decode(const double* p)
+{
+    OmniIntrinsics c;
+    c.K = cv::Matx33d(p[0], p[4], p[2], 0, p[1], p[3], 0, 0, 1);
+    c.D = cv::Vec4d(p[5], p[6], p[7], p[8]);
+    c.xi = p[9];
+    return c;
+}
+
+// Intrinsics left free by the cv::omnidir CALIB_FIX_* flags
+void freeIntrinsics(int flags, uchar* free)
+{
+    const bool fixed[n_intrinsics]{ (flags & cv::omnidir::CALIB_FIX_GAMMA) != 0, (flags & cv::omnidir::CALIB_FIX_GAMMA) != 0,
+        (flags & cv::omnidir::CALIB_FIX_CENTER) != 0, (flags & cv::omnidir::CALIB_FIX_CENTER) != 0,
+        (flags & cv::omnidir::CALIB_FIX_SKEW) != 0, (flags & cv::omnidir::CALIB_FIX_K1) != 0, (flags & cv::omnidir::CALIB_FIX_K2) != 0,
+        (flags & cv::omnidir::CALIB_FIX_P1) != 0, (flags & cv::omnidir::CALIB_FIX_P2) != 0, (flags & cv::omnidir::CALIB_FIX_XI) != 0 };
+    for (int i{ 0 }; i < n_intrinsics; ++i)
+        free[i] = !fixed[i];
+}
+
+// Appends the reprojection residuals of one view (x, y per corner)
+void appendResiduals(const cv::Mat& objectPoints, const cv::Mat& imagePoints, const double* intrinsics,
+    const cv::Vec3d& rvec, const cv::Vec3d& tvec, std::vector<double>& r)
+{
+    const OmniIntrinsics c{ decode(intrinsics) };
+    cv::Mat proj;
+    cv::omnidir::projectPoints(objectPoints, proj, rvec, tvec, cv::Mat(c.K), c.xi, cv::Mat(c.D));
+    const cv::Vec2d* p = proj.ptr<cv::Vec2d>();
+    const cv::Vec2d* m = imagePoints.ptr<cv::Vec2d>();
+    for (int i{ 0 }; i < (int)imagePoints.total(); ++i) {
+        r.push_back(p[i][0] - m[i][0]);
+        r.push_back(p[i][1] - m[i][1]);
+    }
+}
+
+// Least squares problem made of independent views sharing some parameters
+class Problem {
+public:
+    virtual ~Problem() {}
+    virtual int views() const = 0;
+    // Global indexes of the parameters view v depends on
+    virtual const std::vector<int>& params(int v) const = 0;
+    virtual void residuals(int v, const std::vector<double>& p, std::vector<double>& r) const = 0;
+
+    std::vector<double> p;
+    std::vector<uchar> free;
+};
+
+class MonoProblem : public Problem {
+public:
+    MonoProblem(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints)
+        : obj_(objectPoints)
+        , img_(imagePoints)
+    {
+        for (int v{ 0 }; v < (int)img_.size(); ++v) {
+            std::vector<int> idx;
+            for (int i{ 0 }; i < n_intrinsics; ++i)
+                idx.push_back(i);
+            for (int i{ 0 }; i < n_pose; ++i)
+                idx.push_back(n_intrinsics + v * n_pose + i);
+            params_.push_back(idx);
+        }
+    }
+
+    int views() const { return (int)img_.size(); }
+    const std::vector<int>& params(int v) const { return params_[v]; }
+
+    void residuals(int v, const std::vector<double>& p, std::vector<double>& r) const
+    {
+        const double* pose = &p[n_intrinsics + v * n_pose];
+        r.clear();
+        appendResiduals(obj_[v], img_[v], &p[0], cv::Vec3d(pose), cv::Vec3d(pose + 3), r);
+    }
+
+private:
+    const std::vector<cv::Mat>& obj_;
+    const std::vector<cv::Mat>& img_;
+    std::vector<std::vector<int> > params_;
+};
+
+// Layout: intrinsics 1, intrinsics 2, camera 1 -> 2 transform, board poses in camera 1
+class StereoProblem : public Problem {
+public:
+    StereoProblem(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2)
+        : obj_(objectPoints)
+        , img1_(imagePoints1)
+        , img2_(imagePoints2)
+    {
+        for (int v{ 0 }; v < (int)img1_.size(); ++v) {
+            std::vector<int> idx;
+            for (int i{ 0 }; i < 2 * n_intrinsics + n_pose; ++i)
+                idx.push_back(i);
+            for (int i{ 0 }; i < n_pose; ++i)
+                idx.push_back(2 * n_intrinsics + (v + 1) * n_pose + i);
+            params_.push_back(idx);
+        }
+    }
+
+    int views() const { return (int)img1_.size(); }
+    const std::vector<int>& params(int v) const { return params_[v]; }
+
+    void residuals(int v, const std::vector<double>& p, std::vector<double>& r) const
+    {
+        const double* stereo = &p[2 * n_intrinsics];
+        const double* pose = &p[2 * n_intrinsics + (v + 1) * n_pose];
+        const cv::Vec3d rvec(pose), tvec(pose + 3);
+        r.clear();
+        appendResiduals(obj_[v], img1_[v], &p[0], rvec, tvec, r);
+
+        // Board -> camera 2
+        cv::Matx33d Rs, R;
+        cv::Rodrigues(cv::Vec3d(stereo), Rs);
+        cv::Rodrigues(rvec, R);
+        cv::Vec3d rvec2;
+        cv::Rodrigues(Rs * R, rvec2);
+        appendResiduals(obj_[v], img2_[v], &p[n_intrinsics], rvec2, Rs * tvec + cv::Vec3d(stereo + 3), r);
+    }
+
+private:
+    const std::vector<cv::Mat>& obj_;
+    const std::vector<cv::Mat>& img1_;
+    const std::vector<cv::Mat>& img2_;
+    std::vector<std::vector<int> > params_;
+};
+
+double cost(const Problem& pb, const std::vector<double>& p, int& n)
+{
+    double sum{ 0.0 };
+    n = 0;
+    std::vector<double> r;
+    for (int v{ 0 }; v < pb.views(); ++v) {
+        pb.residuals(v, p, r);
+        for (double e : r)
+            sum += e * e;
+        n += (int)r.size() / 2;
+    }
+    return sum;
+}
+
+// Levenberg-Marquardt with central difference Jacobians, one block of columns per view.
+// Returns the RMS reprojection error (px)
+double solve(Problem& pb, const cv::TermCriteria& criteria)
+{
+    std::vector<int> col(pb.p.size(), -1); //Global index -> free index
+    int nf{ 0 };
+    for (size_t i{ 0 }; i < pb.p.size(); ++i)
+        if (pb.free[i])
+            col[i] = nf++;
+
+    const int maxIter{ criteria.type & cv::TermCriteria::COUNT ? criteria.maxCount : 100 };
+    const double eps{ criteria.type & cv::TermCriteria::EPS ? criteria.epsilon : 1e-8 };
+    int n;
+    double e{ cost(pb, pb.p, n) }, lambda{ 1e-3 };
+    std::vector<double> r0, rp, rm, q;
+
+    for (int it{ 0 }; it < maxIter; ++it) {
+        cv::Mat JtJ = cv::Mat::zeros(nf, nf, CV_64F), Jte = cv::Mat::zeros(nf, 1, CV_64F);
+        q = pb.p;
+        for (int v{ 0 }; v < pb.views(); ++v) {
+            pb.residuals(v, q, r0);
+            std::vector<int> cols;
+            for (int j : pb.params(v))
+                if (col[j] >= 0)
+                    cols.push_back(j);
+            cv::Mat J((int)r0.size(), (int)cols.size(), CV_64F);
+            for (int k{ 0 }; k < (int)cols.size(); ++k) {
+                const int j{ cols[k] };
+                const double h{ 1e-6 * std::max(1.0, std::abs(q[j])) };
+                q[j] = pb.p[j] + h;
+                pb.residuals(v, q, rp);
+                q[j] = pb.p[j] - h;
+                pb.residuals(v, q, rm);
+                q[j] = pb.p[j];
+                for (int i{ 0 }; i < J.rows; ++i)
+                    J.at<double>(i, k) = (rp[i] - rm[i]) / (2 * h);
+            }
+            const cv::Mat JtJv{ J.t() * J }, Jtev{ J.t() * cv::Mat(r0) };
+            for (int a{ 0 }; a < (int)cols.size(); ++a) {
+                Jte.at<double>(col[cols[a]]) += Jtev.at<double>(a);
+                for (int b{ 0 }; b < (int)cols.size(); ++b)
+                    JtJ.at<double>(col[cols[a]], col[cols[b]]) += JtJv.at<double>(a, b);
+            }
+        }
+
+        // Raise the damping until the step lowers the error
+        bool improved{ false };
+        double step{ 0.0 };
+        while (!improved && lambda < 1e10) {
+            cv::Mat A = JtJ.clone(), delta;
+            for (int i{ 0 }; i < nf; ++i)
+                A.at<double>(i, i) += lambda * std::max(JtJ.at<double>(i, i), 1e-12);
+            if (cv::solve(A, -Jte, delta, cv::DECOMP_CHOLESKY)) {
+                q = pb.p;
+                for (size_t i{ 0 }; i < q.size(); ++i)
+                    if (col[i] >= 0)
+                        q[i] += delta.at<double>(col[i]);
+                const double eNew{ cost(pb, q, n) };
+                if (eNew < e) {
+                    improved = true;
+                    step = (e - eNew) / e;
+                    e = eNew;
+                    pb.p.swap(q);
+                    lambda = std::max(lambda / 10, 1e-9);
+                    break;
+                }
+            }
+            lambda *= 10;
+        }
+        if (!improved || step < eps)
+            break;
+    }
+    return n ? std::sqrt(e / n) : 0.0;
+}
+
+} // namespace
+
+bool OmniIntrinsics::read(const cv::FileStorage& fs, const std::string& suffix)
+{
+    cv::Mat k, d;
+    fs["camera_matrix" + suffix] >> k;
+    fs["distortion_coefficients" + suffix] >> d;
+    const cv::FileNode nxi = fs["xi" + suffix];
+    if (k.size() != cv::Size(3, 3) || d.total() != 4 || nxi.empty())
+        return false;
+    k.convertTo(k, CV_64F);
+    d.convertTo(d, CV_64F);
+    K = cv::Matx33d(k.ptr<double>());
+    D = cv::Vec4d(d.ptr<double>());
+    if (nxi.isReal())
+        xi = (double)nxi;
+    else {
+        cv::Mat m;
+        nxi >> m;
+        xi = m.at<double>(0);
+    }
+    return true;
+}
+
+bool OmniIntrinsics::lift(const cv::Vec2d& p, cv::Vec3d& ray) const
+{
+    const double yd{ (p[1] - K(1, 2)) / K(1, 1) };
+    const double xd{ (p[0] - K(0, 2) - K(0, 1) * yd) / K(0, 0) };
+    double x{ xd }, y{ yd };
+    for (int i{ 0 }; i < 20; ++i) { //Same fixed point iteration as cv::omnidir::undistortPoints
+        const double r2{ x * x + y * y }, radial{ 1 + D[0] * r2 + D[1] * r2 * r2 };
+        const double dx{ 2 * D[2] * x * y + D[3] * (r2 + 2 * x * x) };
+        const double dy{ D[2] * (r2 + 2 * y * y) + 2 * D[3] * x * y };
+        x = (xd - dx) / radial;
+        y = (yd - dy) / radial;
+    }
+    const double r2{ x * x + y * y }, a{ r2 + 1 }, b{ 2 * xi * r2 }, c{ r2 * xi * xi - 1 };
+    const double disc{ b * b - 4 * a * c };
+    if (disc < 0)
+        return false;
+    const double zs{ (-b + std::sqrt(disc)) / (2 * a) };
+    ray = cv::normalize(cv::Vec3d(x * (zs + xi), y * (zs + xi), zs));
+    return true;
+}
+
+bool OmniIntrinsics::project(const cv::Vec3d& X, cv::Vec2d& p) const
+{
+    const double n{ cv::norm(X) };
+    if (n < 1e-12)
+        return false;
+    const double den{ X[2] / n + xi };
+    if (den < 1e-6)
+        return false;
+    const double x{ X[0] / n / den }, y{ X[1] / n / den };
+    const double r2{ x * x + y * y }, radial{ 1 + D[0] * r2 + D[1] * r2 * r2 };
+    const double xd{ x * radial + 2 * D[2] * x * y + D[3] * (r2 + 2 * x * x) };
+    const double yd{ y * radial + D[2] * (r2 + 2 * y * y) + 2 * D[3] * x * y };
+    p[0] = K(0, 0) * xd + K(0, 1) * yd + K(0, 2);
+    p[1] = K(1, 1) * yd + K(1, 2);
+    return true;
+}
+
+bool estimateBoardPose(const OmniIntrinsics& cam, const cv::Mat& objectPoints, const cv::Mat& imagePoints, cv::Vec3d& rvec, cv::Vec3d& tvec)
+{
+    // Corners in front of the camera, on the normalised perspective plane
+    std::vector<cv::Point3d> obj;
+    std::vector<cv::Point2d> norm;
+    const cv::Vec3d* o = objectPoints.ptr<cv::Vec3d>();
+    const cv::Vec2d* p = imagePoints.ptr<cv::Vec2d>();
+    for (int i{ 0 }; i < (int)imagePoints.total(); ++i) {
+        cv::Vec3d ray;
+        if (!cam.lift(p[i], ray) || ray[2] < 0.2) //Beyond ~78 deg the perspective plane is too stretched
+            continue;
+        obj.push_back(cv::Point3d(o[i][0], o[i][1], o[i][2]));
+        norm.push_back(cv::Point2d(ray[0] / ray[2], ray[1] / ray[2]));
+    }
+    if (norm.size() < 6)
+        return false;
+    cv::Mat r, t;
+    if (!cv::solvePnP(obj, norm, cv::Mat::eye(3, 3, CV_64F), cv::noArray(), r, t))
+        return false;
+    rvec = cv::Vec3d(r.ptr<double>());
+    tvec = cv::Vec3d(t.ptr<double>());
+    return true;
+}
+
+void estimateStereoExtrinsics(const std::vector<cv::Vec3d>& rvecs1, const std::vector<cv::Vec3d>& tvecs1,
+    const std::vector<cv::Vec3d>& rvecs2, const std::vector<cv::Vec3d>& tvecs2, cv::Vec3d& rvec, cv::Vec3d& tvec)
+{
+    std::vector<double> comp[6];
+    for (size_t i{ 0 }; i < rvecs1.size(); ++i) {
+        cv::Matx33d R1, R2;
+        cv::Rodrigues(rvecs1[i], R1);
+        cv::Rodrigues(rvecs2[i], R2);
+        const cv::Matx33d R{ R2 * R1.t() };
+        const cv::Vec3d T{ tvecs2[i] - R * tvecs1[i] };
+        cv::Vec3d r;
+        cv::Rodrigues(R, r);
+        for (int k{ 0 }; k < 3; ++k) {
+            comp[k].push_back(r[k]);
+            comp[3 + k].push_back(T[k]);
+        }
+    }
+    double m[6]{};
+    for (int k{ 0 }; k < 6 && !comp[k].empty(); ++k) {
+        std::nth_element(comp[k].begin(), comp[k].begin() + comp[k].size() / 2, comp[k].end());
+        m[k] = comp[k][comp[k].size() / 2];
+    }
+    rvec = cv::Vec3d(m[0], m[1], m[2]);
+    tvec = cv::Vec3d(m[3], m[4], m[5]);
+}
+
+double refineMono(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints, OmniIntrinsics& cam,
+    std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, int flags, const cv::TermCriteria& criteria)
+{
+    MonoProblem pb(objectPoints, imagePoints);
+    pb.p.assign(n_intrinsics + n_pose * rvecs.size(), 0.0);
+    pb.free.assign(pb.p.size(), 1);
+    encode(cam, &pb.p[0]);
+    freeIntrinsics(flags, &pb.free[0]);
+    for (size_t v{ 0 }; v < rvecs.size(); ++v)
+        for (int k{ 0 }; k < 3; ++k) {
+            pb.p[n_intrinsics + v * n_pose + k] = rvecs[v][k];
+            pb.p[n_intrinsics + v * n_pose + 3 + k] = tvecs[v][k];
+        }
+
+    const double rms{ solve(pb, criteria) };
+    cam = decode(&pb.p[0]);
+    for (size_t v{ 0 }; v < rvecs.size(); ++v) {
+        rvecs[v] = cv::Vec3d(&pb.p[n_intrinsics + v * n_pose]);
+        tvecs[v] = cv::Vec3d(&pb.p[n_intrinsics + v * n_pose + 3]);
+    }
+    return rms;
+}
+
+double refineStereo(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2,
+    OmniIntrinsics& cam1, OmniIntrinsics& cam2, cv::Vec3d& rvec, cv::Vec3d& tvec,
+    std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, int flags, const cv::TermCriteria& criteria)
+{
+    StereoProblem pb(objectPoints, imagePoints1, imagePoints2);
+    const int first{ 2 * n_intrinsics + n_pose }; //First board pose
+    pb.p.assign(first + n_pose * rvecs.size(), 0.0);
+    pb.free.assign(pb.p.size(), 1);
+    encode(cam1, &pb.p[0]);
+    encode(cam2, &pb.p[n_intrinsics]);
+    freeIntrinsics(flags, &pb.free[0]);
+    freeIntrinsics(flags, &pb.free[n_intrinsics]);
+    for (int k{ 0 }; k < 3; ++k) {
+        pb.p[2 * n_intrinsics + k] = rvec[k];
+        pb.p[2 * n_intrinsics + 3 + k] = tvec[k];
+    }
+    for (size_t v{ 0 }; v < rvecs.size(); ++v)
+        for (int k{ 0 }; k < 3; ++k) {
+            pb.p[first + v * n_pose + k] = rvecs[v][k];
+            pb.p[first + v * n_pose + 3 + k] = tvecs[v][k];
+        }
+
+    const double rms{ solve(pb, criteria) };
+    cam1 = decode(&pb.p[0]);
+    cam2 = decode(&pb.p[n_intrinsics]);
+    rvec = cv::Vec3d(&pb.p[2 * n_intrinsics]);
+    tvec = cv::Vec3d(&pb.p[2 * n_intrinsics + 3]);
+    for (size_t v{ 0 }; v < rvecs.size(); ++v) {
+        rvecs[v] = cv::Vec3d(&pb.p[first + v * n_pose]);
+        tvecs[v] = cv::Vec3d(&pb.p[first + v * n_pose + 3]);
+    }
+    return rms;
+}
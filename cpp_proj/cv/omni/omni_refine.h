@@ -0,0 +1,53 @@
+/*
+ * omni_refine.h
+ * Warm-started Mei model calibration
+ *
+ * cv::omnidir::calibrate & stereoCalibrate always initialise from scratch.
+ * These resume from known parameters instead: the board pose of a view is
+ * estimated from its corners with the known intrinsics (corners lifted to
+ * the unit sphere, then PnP), and intrinsics & poses (& the stereo
+ * extrinsics) are refined jointly with Levenberg-Marquardt from there. The
+ * CALIB_FIX_* flags of cv::omnidir are honoured, so the result has the same
+ * parameterisation as a full calibration with the same flags.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_REFINE_H
+#define OMNI_REFINE_H
+
+#include "opencv2/core.hpp"
+#include <string>
+#include <vector>
+
+// Camera matrix, distortion (k1, k2, p1, p2) & xi, as stored by the calibration tools
+struct OmniIntrinsics {
+    cv::Matx33d K;
+    cv::Vec4d D;
+    double xi{ 1.0 };
+
+    // camera_matrix<suffix>, distortion_coefficients<suffix> & xi<suffix>
+    bool read(const cv::FileStorage& fs, const std::string& suffix = "");
+    // Unit ray of a pixel, false where the distortion cannot be inverted
+    bool lift(const cv::Vec2d& p, cv::Vec3d& ray) const;
+    // Pixel of a point / ray in the camera frame, false behind the model's field of view
+    bool project(const cv::Vec3d& X, cv::Vec2d& p) const;
+};
+
+// Board pose (board -> camera) of one view from its corners (CV_64FC3 / CV_64FC2)
+bool estimateBoardPose(const OmniIntrinsics& cam, const cv::Mat& objectPoints, const cv::Mat& imagePoints, cv::Vec3d& rvec, cv::Vec3d& tvec);
+
+// Camera 1 -> camera 2 transform, the per-component median over views of both board poses
+void estimateStereoExtrinsics(const std::vector<cv::Vec3d>& rvecs1, const std::vector<cv::Vec3d>& tvecs1,
+    const std::vector<cv::Vec3d>& rvecs2, const std::vector<cv::Vec3d>& tvecs2, cv::Vec3d& rvec, cv::Vec3d& tvec);
+
+// Refine from the given intrinsics & board poses, returns the RMS reprojection error (px)
+double refineMono(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints, OmniIntrinsics& cam,
+    std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, int flags, const cv::TermCriteria& criteria);
+
+// Same, with the board poses in camera 1 & the camera 1 -> camera 2 transform (rvec, tvec)
+double refineStereo(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2,
+    OmniIntrinsics& cam1, OmniIntrinsics& cam2, cv::Vec3d& rvec, cv::Vec3d& tvec,
+    std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs, int flags, const cv::TermCriteria& criteria);
+
+#endif
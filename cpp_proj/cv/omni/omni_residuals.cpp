@@ -0,0 +1,135 @@
+#include "omni_residuals.h"
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/ccalib/omnidir.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Projects a range of views, each with its own board -> camera pose
+class ErrorBody : public cv::ParallelLoopBody {
+public:
+    ErrorBody(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints, const OmniIntrinsics& cam,
+        const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs, std::vector<ViewError>& errors)
+        : obj_(objectPoints)
+        , img_(imagePoints)
+        , K_(cam.K)
+        , D_(cam.D)
+        , xi_(cam.xi)
+        , rvecs_(rvecs)
+        , tvecs_(tvecs)
+        , errors_(errors)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int v{ range.start }; v < range.end; ++v) {
+            cv::Mat proj;
+            cv::omnidir::projectPoints(obj_[v], proj, rvecs_[v], tvecs_[v], K_, xi_, D_);
+            ViewError& e = errors_[v];
+            const int n{ (int)img_[v].total() };
+            e.residuals.create(1, n, CV_64FC2);
+            const cv::Vec2d* p = proj.ptr<cv::Vec2d>();
+            const cv::Vec2d* m = img_[v].ptr<cv::Vec2d>();
+            cv::Vec2d* r = e.residuals.ptr<cv::Vec2d>();
+            double sum{ 0.0 };
+            e.max = 0.0;
+            for (int i{ 0 }; i < n; ++i) {
+                r[i] = p[i] - m[i];
+                const double d2{ r[i].dot(r[i]) };
+                sum += d2;
+                e.max = std::max(e.max, std::sqrt(d2));
+            }
+            e.rms = n ? std::sqrt(sum / n) : 0.0;
+        }
+    }
+
+private:
+    const std::vector<cv::Mat>& obj_;
+    const std::vector<cv::Mat>& img_;
+    const cv::Mat K_, D_;
+    const double xi_;
+    const std::vector<cv::Vec3d>& rvecs_;
+    const std::vector<cv::Vec3d>& tvecs_;
+    std::vector<ViewError>& errors_;
+};
+
+double median(std::vector<double> v)
+{
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+} // namespace
+
+std::vector<ViewError> viewErrors(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints,
+    const OmniIntrinsics& cam, const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs)
+{
+    std::vector<ViewError> errors(imagePoints.size());
+    cv::parallel_for_(cv::Range(0, (int)errors.size()), ErrorBody(objectPoints, imagePoints, cam, rvecs, tvecs, errors));
+    return errors;
+}
+
+void stereoViewErrors(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2,
+    const OmniIntrinsics& cam1, const OmniIntrinsics& cam2, const cv::Vec3d& rvec, const cv::Vec3d& tvec,
+    const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs, std::vector<ViewError>& errors1, std::vector<ViewError>& errors2)
+{
+    cv::Matx33d Rs;
+    cv::Rodrigues(rvec, Rs);
+    std::vector<cv::Vec3d> rvecs2(rvecs.size()), tvecs2(tvecs.size());
+    for (size_t v{ 0 }; v < rvecs.size(); ++v) {
+        cv::Matx33d R;
+        cv::Rodrigues(rvecs[v], R);
+        cv::Rodrigues(Rs * R, rvecs2[v]);
+        tvecs2[v] = Rs * tvecs[v] + tvec;
+    }
+    errors1 = viewErrors(objectPoints, imagePoints1, cam1, rvecs, tvecs);
+    errors2 = viewErrors(objectPoints, imagePoints2, cam2, rvecs2, tvecs2);
+}
+
+std::vector<double> combinedRms(const std::vector<ViewError>& errors1, const std::vector<ViewError>& errors2)
+{
+    std::vector<double> rms(errors1.size());
+    for (size_t v{ 0 }; v < rms.size(); ++v)
+        rms[v] = std::sqrt((errors1[v].rms * errors1[v].rms + errors2[v].rms * errors2[v].rms) / 2);
+    return rms;
+}
+
+std::vector<int> outlierViews(const std::vector<double>& rms, double sigma, double minRms, int maxDrop)
+{
+    std::vector<int> out;
+    if (rms.empty() || maxDrop <= 0)
+        return out;
+    const double med{ median(rms) };
+    std::vector<double> dev(rms.size());
+    for (size_t i{ 0 }; i < rms.size(); ++i)
+        dev[i] = std::abs(rms[i] - med);
+    const double threshold{ std::max(minRms, med + sigma * 1.4826 * median(dev)) }; //1.4826 * MAD ~ stddev for normal errors
+
+    for (int i{ 0 }; i < (int)rms.size(); ++i)
+        if (rms[i] > threshold)
+            out.push_back(i);
+    std::sort(out.begin(), out.end(), [&rms](int a, int b) { return rms[a] > rms[b]; });
+    if ((int)out.size() > maxDrop)
+        out.resize(maxDrop);
+    return out;
+}
+
+void writeViewErrors(cv::FileStorage& fs, const std::string& suffix, const std::vector<ViewError>& errors)
+{
+    if (errors.empty())
+        return;
+    cv::Mat perView((int)errors.size(), 2, CV_64F), residuals((int)errors.size(), (int)errors[0].residuals.total(), CV_64FC2);
+    for (int v{ 0 }; v < perView.rows; ++v) {
+        perView.at<double>(v, 0) = errors[v].rms;
+        perView.at<double>(v, 1) = errors[v].max;
+        errors[v].residuals.copyTo(residuals.row(v));
+    }
+    //rms & max reprojection error (px) of each used view
+    fs << "per_view_errors" + suffix << perView;
+    //projected - detected position of each corner
+    fs << "reprojection_errors" + suffix << residuals;
+}
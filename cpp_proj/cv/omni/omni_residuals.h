@@ -0,0 +1,46 @@
+/*
+ * omni_residuals.h
+ * Per-view reprojection errors & outlier views of a calibration
+ *
+ * The views are projected in parallel with the solved parameters, giving
+ * the residual of every corner & the RMS / max error of every view. A view
+ * is an outlier when its RMS is far above the others' (median + sigma *
+ * the scaled median absolute deviation, & above an absolute floor so a
+ * uniformly good calibration keeps all its views), e.g. a blurry frame or
+ * a mis-ordered detection.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_RESIDUALS_H
+#define OMNI_RESIDUALS_H
+
+#include "omni_refine.h"
+#include "opencv2/core.hpp"
+#include <string>
+#include <vector>
+
+struct ViewError {
+    double rms{ 0.0 }; //px
+    double max{ 0.0 }; //px
+    cv::Mat residuals; //Projected - detected per corner, CV_64FC2 1 x corners
+};
+
+std::vector<ViewError> viewErrors(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints,
+    const OmniIntrinsics& cam, const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs);
+
+// Board poses in camera 1, camera 2 through the camera 1 -> 2 transform (rvec, tvec)
+void stereoViewErrors(const std::vector<cv::Mat>& objectPoints, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2,
+    const OmniIntrinsics& cam1, const OmniIntrinsics& cam2, const cv::Vec3d& rvec, const cv::Vec3d& tvec,
+    const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs, std::vector<ViewError>& errors1, std::vector<ViewError>& errors2);
+
+// RMS over both cameras of each view
+std::vector<double> combinedRms(const std::vector<ViewError>& errors1, const std::vector<ViewError>& errors2);
+
+// Indexes of at most maxDrop outlier views, worst first
+std::vector<int> outlierViews(const std::vector<double>& rms, double sigma, double minRms, int maxDrop);
+
+// per_view_errors<suffix> (N x 2: rms, max) & reprojection_errors<suffix> (N x corners CV_64FC2)
+void writeViewErrors(cv::FileStorage& fs, const std::string& suffix, const std::vector<ViewError>& errors);
+
+#endif
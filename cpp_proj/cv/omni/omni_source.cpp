@@ -0,0 +1,58 @@
+#include "omni_source.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+const int csi_width{ 1280 };
+const int csi_height{ 720 };
+const int csi_framerate{ 30 };
+const int csi_flip_method{ 0 };
+
+} // namespace
+
+std::string csiPipeline(int sensorId)
+{
+    return "nvarguscamerasrc sensor_id=" + std::to_string(sensorId) + " sensor_mode=3 ! video/x-raw(memory:NVMM), format=(string)NV12, framerate=(fraction)" +
+        std::to_string(csi_framerate) + "/1 ! nvvidconv flip-method=" + std::to_string(csi_flip_method) + " ! video/x-raw, width=(int)" + std::to_string(csi_width) +
+        ", height=(int)" + std::to_string(csi_height) + ", format=(string)BGRx ! videoconvert ! video/x-raw, format=(string)BGR ! appsink";
+}
+
+bool openSource(const std::string& spec, cv::VideoCapture& cap)
+{
+    int id{ 0 };
+    if (!spec.empty() && std::all_of(spec.begin(), spec.end(), [](char c) { return std::isdigit((unsigned char)c) != 0; }))
+        return parseInt(spec, id) && cap.open(csiPipeline(id), cv::CAP_GSTREAMER);
+    if (spec.compare(0, 4, "v4l:") == 0)
+        return parseInt(spec.substr(4), id) && id >= 0 && cap.open(id);
+    if (spec.find('!') != std::string::npos)
+        return cap.open(spec, cv::CAP_GSTREAMER);
+    return cap.open(spec);
+}
+
+bool parseInt(const std::string& arg, int& v)
+{
+    char* end{ nullptr };
+    errno = 0;
+    const long l{ std::strtol(arg.c_str(), &end, 10) };
+    if (arg.empty() || *end != '\0' || errno == ERANGE || l < INT_MIN || l > INT_MAX)
+        return false;
+    v = (int)l;
+    return true;
+}
+
+bool parseDouble(const std::string& arg, double& v)
+{
+    char* end{ nullptr };
+    errno = 0;
+    const double d{ std::strtod(arg.c_str(), &end) };
+    if (arg.empty() || *end != '\0' || errno == ERANGE || !std::isfinite(d))
+        return false;
+    v = d;
+    return true;
+}
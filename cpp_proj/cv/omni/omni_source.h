@@ -0,0 +1,29 @@
+/*
+ * omni_source.h
+ * Camera / video sources of the live tools
+ *
+ * A source is given on the command line as a CSI sensor id (same
+ * nvarguscamerasrc pipeline as load_cam_dual), v4l:N for a V4L2 device, a
+ * GStreamer pipeline ending in appsink, or a video file.
+ *
+ * Numeric arguments of the tools are parsed whole & without exceptions,
+ * so bad input is reported as a usage error instead of aborting.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_SOURCE_H
+#define OMNI_SOURCE_H
+
+#include "opencv2/videoio.hpp"
+#include <string>
+
+std::string csiPipeline(int sensorId);
+// False on a malformed spec (e.g. v4l: without a device number) or if the source can't be opened
+bool openSource(const std::string& spec, cv::VideoCapture& cap);
+
+// Whole argument as a number, false (v untouched) if it isn't one or is out of range
+bool parseInt(const std::string& arg, int& v);
+bool parseDouble(const std::string& arg, double& v);
+
+#endif
@@ -0,0 +1,112 @@
+#include "omni_stereo.h"
+
+#include "opencv2/imgproc.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+UnwrapAtlas rectifier(const OmniIntrinsics& cam, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& size, bool first)
+{
+    UnwrapView view1, view2;
+    stereoViews(rvec, tvec, size, view1, view2);
+    return UnwrapAtlas(cam, size, std::vector<UnwrapView>(1, first ? view1 : view2));
+}
+
+// Depth & (optionally) point cloud of a range of rows
+class DepthBody : public cv::ParallelLoopBody {
+public:
+    DepthBody(const cv::Mat& disparity, int minDisparity, const cv::Mat& left, const cv::Matx33d& K, double baseline, cv::Mat& depth, cv::Mat* cloud)
+        : disparity_(disparity)
+        , lowest_((short)std::max(1, minDisparity * 16))
+        , left_(left)
+        , K_(K)
+        , fb_((float)(K(0, 0) * baseline))
+        , depth_(depth)
+        , cloud_(cloud)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        const float nan{ std::numeric_limits<float>::quiet_NaN() };
+        const int cn{ left_.channels() };
+        for (int y{ range.start }; y < range.end; ++y) {
+            const short* d = disparity_.ptr<short>(y);
+            float* z = depth_.ptr<float>(y);
+            for (int x{ 0 }; x < depth_.cols; ++x)
+                z[x] = d[x] >= lowest_ ? 16.f * fb_ / d[x] : 0.f;
+            if (!cloud_)
+                continue;
+
+            const uchar* c = left_.ptr<uchar>(y);
+            float* p = cloud_->ptr<float>(y);
+            const double v{ (y - K_(1, 2)) / K_(1, 1) };
+            for (int x{ 0 }; x < depth_.cols; ++x, p += 6, c += cn) {
+                if (z[x] <= 0.f) {
+                    std::fill(p, p + 6, nan);
+                    continue;
+                }
+                const double u{ (x - K_(0, 2) - K_(0, 1) * v) / K_(0, 0) };
+                p[0] = (float)(u * z[x]);
+                p[1] = (float)(v * z[x]);
+                p[2] = z[x];
+                p[3] = c[0];
+                p[4] = c[cn > 1 ? 1 : 0];
+                p[5] = c[cn > 2 ? 2 : 0];
+            }
+        }
+    }
+
+private:
+    const cv::Mat& disparity_;
+    const short lowest_; //Valid & in front of the pair
+    const cv::Mat& left_;
+    const cv::Matx33d K_;
+    const float fb_;
+    cv::Mat& depth_;
+    cv::Mat* cloud_;
+};
+
+} // namespace
+
+OmniStereo::OmniStereo(const OmniIntrinsics& cam1, const OmniIntrinsics& cam2, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& imageSize,
+    const DisparityParams& params, int scale, bool temporal)
+    : rect1_(rectifier(cam1, rvec, tvec, imageSize, true))
+    , rect2_(rectifier(cam2, rvec, tvec, imageSize, false))
+    , matcher_(params, scale, temporal)
+    , K_(rect1_.views()[0].K)
+    , baseline_(cv::norm(tvec))
+    , minDisparity_(params.minDisparity)
+{
+}
+
+void OmniStereo::compute(const cv::Mat& img1, const cv::Mat& img2, int outputs, Result& result)
+{
+    cv::Mat& left = (outputs & RECTIFIED) ? result.left : left_;
+    cv::Mat& right = (outputs & RECTIFIED) ? result.right : right_;
+    rect1_.unwrap(img1, left);
+    rect2_.unwrap(img2, right);
+    if (!(outputs & (DISPARITY | DEPTH | POINT_CLOUD | CONFIDENCE)))
+        return;
+
+    cv::Mat& disparity = (outputs & DISPARITY) ? result.disparity : disparity_;
+    if (outputs & CONFIDENCE)
+        matcher_.compute(left, right, disparity, result.confidence);
+    else
+        matcher_.compute(left, right, disparity);
+    if (!(outputs & (DEPTH | POINT_CLOUD)))
+        return;
+
+    cv::Mat& depth = (outputs & DEPTH) ? result.depth : depth_;
+    depth.create(disparity.size(), CV_32F);
+    cv::Mat* cloud{ nullptr };
+    if (outputs & POINT_CLOUD) {
+        CV_Assert(left.depth() == CV_8U);
+        result.pointCloud.create(disparity.size(), CV_32FC(6));
+        cloud = &result.pointCloud;
+    }
+    cv::parallel_for_(cv::Range(0, depth.rows), DepthBody(disparity, minDisparity_, left, K_, baseline_, depth, cloud));
+}
@@ -0,0 +1,62 @@
+/*
+ * omni_stereo.h
+ * Stereo reconstruction computing only the requested products
+ *
+ * cv::omnidir::stereoReconstruct rebuilds its rectification maps on every
+ * call & always returns the rectified pair, the disparity and a full
+ * XYZRGB float point cloud. OmniStereo builds the maps once (see
+ * omni_atlas.h) and the caller passes the products it needs per frame:
+ * nothing else is computed or allocated, e.g. no disparity for
+ * RECTIFIED alone, no point cloud (24 bytes per pixel) for DISPARITY.
+ * Products a requested one depends on (rectified pair -> disparity ->
+ * depth -> point cloud) are computed into internal buffers.
+ *
+ * Result buffers that already have the right size & type are written in
+ * place, e.g. the halves of a StereoCanvas for the rectified pair.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_STEREO_H
+#define OMNI_STEREO_H
+
+#include "omni_atlas.h"
+#include "omni_disparity.h"
+#include "omni_refine.h"
+#include "opencv2/core.hpp"
+
+class OmniStereo {
+public:
+    enum Output {
+        RECTIFIED = 1, //Row aligned pair, type of the input
+        DISPARITY = 2, //CV_16S, 16 x disparity, see omni_disparity.h
+        DEPTH = 4, //CV_32F, along the rectified optical axis, in tvec units, 0 where invalid
+        POINT_CLOUD = 8, //CV_32FC(6) X, Y, Z (rectified left camera frame, tvec units), B, G, R per pixel, NaN where invalid
+        CONFIDENCE = 16 //CV_8U, left / right agreement, 0 where invalid; the other products are left / right checked too
+    };
+
+    struct Result {
+        cv::Mat left, right, disparity, depth, pointCloud, confidence;
+    };
+
+    // cam1 -> cam2 transform rvec, tvec (omni_calib_stereo output), images of imageSize
+    OmniStereo(const OmniIntrinsics& cam1, const OmniIntrinsics& cam2, const cv::Mat& rvec, const cv::Mat& tvec, const cv::Size& imageSize,
+        const DisparityParams& params = DisparityParams(), int scale = 1, bool temporal = false);
+
+    // outputs: Output flags, the other members of result are left untouched
+    void compute(const cv::Mat& img1, const cv::Mat& img2, int outputs, Result& result);
+
+    // Camera matrix of the rectified pair & baseline (tvec units)
+    const cv::Matx33d& K() const { return K_; }
+    double baseline() const { return baseline_; }
+
+private:
+    UnwrapAtlas rect1_, rect2_;
+    MultiResDisparity matcher_;
+    cv::Matx33d K_;
+    double baseline_;
+    int minDisparity_;
+    cv::Mat left_, right_, disparity_, depth_; //When not requested
+};
+
+#endif
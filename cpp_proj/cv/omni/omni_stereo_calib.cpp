@@ -21,9 +21,18 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/ccalib/omnidir.hpp"
 #include "opencv2/calib3d.hpp"
+#include "omni_refine.h"
+#include "omni_residuals.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
+#define REJECT_SIGMA 3.0 //Outlier pairs: RMS above median + REJECT_SIGMA * robust stddev of the pairs' RMS
+#define REJECT_MIN_RMS 0.5 //px, pairs under it are always kept
+#define REJECT_MAX_FRACTION 0.1 //Of the pairs dropped per round
+#define REJECT_ROUNDS 5
+
 static int err(const std::string& msg, const int& rval)
 {
     std::cerr << msg << std::endl;
@@ -110,7 +119,8 @@ static bool detectChessboardCorners(const std::vector<std::string>& list_l, std:
 static void saveCameraParams(const std::string& filename, const int flags, const cv::Mat& cameraMatrix1, const cv::Mat& cameraMatrix2, const cv::Mat& distCoeffs1,
     const cv::Mat& disCoeffs2, const double xi1, const double xi2, const cv::Vec3d rvec, const cv::Vec3d tvec,
     const std::vector<cv::Vec3d>& rvecs, const std::vector<cv::Vec3d>& tvecs, std::vector<std::string> detec_list_1, std::vector<std::string> detec_list_2,
-    const cv::Mat& idx, const double rms, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2)
+    const cv::Mat& idx, const double rms, const std::vector<cv::Mat>& imagePoints1, const std::vector<cv::Mat>& imagePoints2,
+    const std::vector<ViewError>& errors1, const std::vector<ViewError>& errors2, const std::vector<std::string>& rejected_1, const std::vector<std::string>& rejected_2)
 {
     cv::FileStorage fs(filename, cv::FileStorage::WRITE);
     time_t tt;
@@ -175,33 +185,116 @@ std::cout<<R<<"\t"<<T<<std::endl;
     }
     fs << "]";
 
-    if (!imagePoints1.empty()) {
-        cv::Mat imageMat((int)imagePoints1.size(), (int)imagePoints1[0].total(), CV_64FC2);
-        for (int i = 0; i < (int)imagePoints1.size(); ++i) {
+    if (!imagePoints1.empty() && !idx.empty()) {
+        cv::Mat imageMat((int)idx.total(), (int)imagePoints1[0].total(), CV_64FC2);
+        for (int i = 0; i < imageMat.rows; ++i) {
             cv::Mat r = imageMat.row(i).reshape(2, imageMat.cols);
-            cv::Mat imagei(imagePoints1[i]);
+            cv::Mat imagei(imagePoints1[idx.at<int>(i)]); //Used images only, in used_imgs order
             imagei.copyTo(r);
         }
         fs << "image_points_1" << imageMat;
     }
 
-    if (!imagePoints2.empty()) {
-        cv::Mat imageMat((int)imagePoints2.size(), (int)imagePoints2[0].total(), CV_64FC2);
-        for (int i = 0; i < (int)imagePoints2.size(); ++i) {
+    if (!imagePoints2.empty() && !idx.empty()) {
+        cv::Mat imageMat((int)idx.total(), (int)imagePoints2[0].total(), CV_64FC2);
+        for (int i = 0; i < imageMat.rows; ++i) {
             cv::Mat r = imageMat.row(i).reshape(2, imageMat.cols);
-            cv::Mat imagei(imagePoints2[i]);
+            cv::Mat imagei(imagePoints2[idx.at<int>(i)]); //Used images only, in used_imgs order
             imagei.copyTo(r);
         }
         fs << "image_points_2" << imageMat;
     }
 
+    writeViewErrors(fs, "_1", errors1);
+    writeViewErrors(fs, "_2", errors2);
+    //Image pairs dropped as outliers
+    fs << "rejected_imgs_1"
+       << "[";
+    for (const std::string& name : rejected_1)
+        fs << name;
+    fs << "]";
+    fs << "rejected_imgs_2"
+       << "[";
+    for (const std::string& name : rejected_2)
+        fs << name;
+    fs << "]";
+
     std::cout << "\n=== Calibration Done! ===\n" << std::endl;
 }
 
+// Intrinsics & extrinsics of a previous stereo calibration, with its used images, their corners & board poses if it has them
+static bool readPriorCalibration(const std::string& filename, const cv::Size& boardSize, OmniIntrinsics& cam1, OmniIntrinsics& cam2,
+    cv::Vec3d& rvec, cv::Vec3d& tvec, std::vector<std::string>& list1, std::vector<std::string>& list2,
+    std::vector<cv::Mat>& imagePoints1, std::vector<cv::Mat>& imagePoints2, std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs)
+{
+    cv::FileStorage fs(filename, cv::FileStorage::READ);
+    if (!fs.isOpened() || !cam1.read(fs, "_1") || !cam2.read(fs, "_2") || fs["rvec"].empty() || fs["tvec"].empty())
+        return false;
+    fs["rvec"] >> rvec;
+    fs["tvec"] >> tvec;
+    cv::Mat ext, points1, points2;
+    fs["extrinsic_parameters_1"] >> ext;
+    fs["image_points_1"] >> points1;
+    fs["image_points_2"] >> points2;
+    const cv::FileNode used1 = fs["used_imgs_1"], used2 = fs["used_imgs_2"];
+    // Older files have the corners of every detected image, which don't match the used ones
+    if (used1.type() != cv::FileNode::SEQ || (int)used1.size() != ext.rows || (int)used2.size() != ext.rows || ext.cols != 6
+        || points1.rows != ext.rows || points2.rows != ext.rows || points1.cols != boardSize.area() || points2.cols != boardSize.area()) {
+        std::cout << "\nPrior views not reusable, only the intrinsics & extrinsics are" << std::endl;
+        return true;
+    }
+    ext.convertTo(ext, CV_64F);
+    points1.convertTo(points1, CV_64FC2);
+    points2.convertTo(points2, CV_64FC2);
+    for (int i{ 0 }; i < ext.rows; ++i) {
+        list1.push_back((std::string)used1[i]);
+        list2.push_back((std::string)used2[i]);
+        imagePoints1.push_back(points1.row(i).reshape(2, points1.cols).clone());
+        imagePoints2.push_back(points2.row(i).reshape(2, points2.cols).clone());
+        rvecs.push_back(cv::Vec3d(ext.ptr<double>(i)));
+        tvecs.push_back(cv::Vec3d(ext.ptr<double>(i) + 3));
+    }
+    return true;
+}
+
+// Drops the outlier pairs & re-solves from the current solution until none stands out, errors of the kept pairs in errors1/2
+static void rejectOutliers(const int flags, const cv::TermCriteria& criteria, OmniIntrinsics& cam1, OmniIntrinsics& cam2, cv::Vec3d& rvec, cv::Vec3d& tvec,
+    double& rms, std::vector<cv::Mat>& objectPoints, std::vector<cv::Mat>& imagePoints_L, std::vector<cv::Mat>& imagePoints_R,
+    std::vector<std::string>& list_L, std::vector<std::string>& list_R, std::vector<cv::Vec3d>& rvecs, std::vector<cv::Vec3d>& tvecs,
+    std::vector<ViewError>& errors1, std::vector<ViewError>& errors2, std::vector<std::string>& rejected_L, std::vector<std::string>& rejected_R)
+{
+    for (int round{ 0 };; ++round) {
+        stereoViewErrors(objectPoints, imagePoints_L, imagePoints_R, cam1, cam2, rvec, tvec, rvecs, tvecs, errors1, errors2);
+        if (round == REJECT_ROUNDS)
+            break;
+        const std::vector<double> viewRms{ combinedRms(errors1, errors2) };
+        const int maxDrop{ std::min((int)std::ceil(REJECT_MAX_FRACTION * viewRms.size()), (int)viewRms.size() - 3) };
+        std::vector<int> out{ outlierViews(viewRms, REJECT_SIGMA, REJECT_MIN_RMS, maxDrop) };
+        if (out.empty())
+            break;
+
+        std::sort(out.rbegin(), out.rend()); //Erase from the back
+        for (int i : out) {
+            std::cout << "[ \x1B[31m✘\033[0m ] " << viewRms[i] << " px: " << list_L[i] << std::endl;
+            rejected_L.push_back(list_L[i]);
+            rejected_R.push_back(list_R[i]);
+            objectPoints.erase(objectPoints.begin() + i);
+            imagePoints_L.erase(imagePoints_L.begin() + i);
+            imagePoints_R.erase(imagePoints_R.begin() + i);
+            list_L.erase(list_L.begin() + i);
+            list_R.erase(list_R.begin() + i);
+            rvecs.erase(rvecs.begin() + i);
+            tvecs.erase(tvecs.begin() + i);
+        }
+        rms = refineStereo(objectPoints, imagePoints_L, imagePoints_R, cam1, cam2, rvec, tvec, rvecs, tvecs, flags, criteria);
+        std::cout << "Re-solved without " << out.size() << " outlier pair(s), RMS: " << rms << std::endl;
+    }
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 6)
-        return err((std::string) "\nUsage: " + argv[0] + "  [IMG_LIST_LEFT]  [IMG_LIST_RIGHT] [CHECKBOARD_HORIZONTAL_POINTS]   [CHECKBOARD_VERTICAL_POINTS]  [SQUARE_WIDTH (mm)]\n", 1);
+        return err((std::string) "\nUsage: " + argv[0] + "  [IMG_LIST_LEFT]  [IMG_LIST_RIGHT] [CHECKBOARD_HORIZONTAL_POINTS]   [CHECKBOARD_VERTICAL_POINTS]  [SQUARE_WIDTH (mm)]  [PRIOR_CAMERA_PARAMS_STEREO | CAMERA_PARAMS_LEFT CAMERA_PARAMS_RIGHT]\n", 1);
 
     if (atoi(argv[3]) <= 2 || atoi(argv[4]) <= 2)
         return err("\n[CHECKBOARD_HORIZONTAL_POINTS] & [CHECKBOARD_VERTICAL_POINTS] have to be > 2!\n", 2);
@@ -212,10 +305,15 @@ int main(int argc, char** argv)
     cv::Size boardSize(atoi(argv[3]), atoi(argv[4])); //8 x 5
     cv::Size imageSize; //Img width & height
 
-    constexpr int flags = cv::omnidir::CALIB_FIX_GAMMA;	//cv::omnidir::CALIB_FIX_SKEW 
+    // Warm start from a previous stereo calibration (incremental) or from the 2 mono calibrations
+    const char* priorFilename{ argc == 7 ? argv[6] : nullptr };
+    const char* monoFilename1{ argc > 7 ? argv[6] : nullptr };
+    const char* monoFilename2{ argc > 7 ? argv[7] : nullptr };
+    const bool warm{ priorFilename || monoFilename1 };
+    const int flags{ cv::omnidir::CALIB_FIX_GAMMA + (warm ? cv::omnidir::CALIB_USE_GUESS : 0) }; //cv::omnidir::CALIB_FIX_SKEW
     const char* outputFilename = "./out_camera_params_stereo.xml"; //Save in current working directory
 
-    const double square_width{ atof(argv[4]) }; //0.03;
+    const double square_width{ atof(argv[5]) }; //0.03;
 
     char buf[512]{ "None" };
     if (flags != 0) {
@@ -231,17 +329,48 @@ int main(int argc, char** argv)
             flags & cv::omnidir::CALIB_FIX_CENTER ? "fix_center " : "");
     }
 
-    std::cout << "\n[CONFIG]\nIMG_LIST Left Path:\t\t" << argv[1] << "\nIMG_LIST Right Path:\t\t" << argv[2] << "\nCHECKBOARD_HORIZONTAL_POINTS:\t" << argv[3] << "\nCHECKBOARD_VERTICAL_POINTS:\t" << argv[4] << "\nSQUARE_WIDTH (mm):\t\t" << argv[5] << "\nFLAGS:\t\t\t\t" << buf << "\nOutput path:\t\t\t" << outputFilename << std::endl;
+    std::cout << "\n[CONFIG]\nIMG_LIST Left Path:\t\t" << argv[1] << "\nIMG_LIST Right Path:\t\t" << argv[2] << "\nCHECKBOARD_HORIZONTAL_POINTS:\t" << argv[3] << "\nCHECKBOARD_VERTICAL_POINTS:\t" << argv[4] << "\nSQUARE_WIDTH (mm):\t\t" << argv[5]
+              << "\nPRIOR:\t\t\t\t" << (priorFilename ? priorFilename : monoFilename1 ? std::string(monoFilename1) + " & " + monoFilename2 : "None") << "\nFLAGS:\t\t\t\t" << buf << "\nOutput path:\t\t\t" << outputFilename << std::endl;
 
     std::vector<cv::Mat> objectPoints, imagePoints_L, imagePoints_R;
     std::vector<std::string> image_list_L, detect_list_L, image_list_R, detect_list_R; // get image name list
 
     if (!readStringList(argv[1], image_list_L) || !readStringList(argv[2], image_list_R))
         return err("Failed to read image list!\n", -1);
+    if (image_list_L.size() != image_list_R.size())
+        return err("Left & right image lists differ in length!\n", -1);
+
+    OmniIntrinsics cam1, cam2;
+    cv::Vec3d prior_rvec, prior_tvec;
+    std::vector<std::string> prior_list_L, prior_list_R;
+    std::vector<cv::Mat> prior_points_L, prior_points_R;
+    std::vector<cv::Vec3d> prior_rvecs, prior_tvecs;
+    if (priorFilename) {
+        if (!readPriorCalibration(priorFilename, boardSize, cam1, cam2, prior_rvec, prior_tvec, prior_list_L, prior_list_R,
+                prior_points_L, prior_points_R, prior_rvecs, prior_tvecs))
+            return err("Failed to read prior camera params!\n", -1);
+
+        // incremental: the pairs the prior calibration used are not detected again
+        std::vector<std::string> new_L, new_R;
+        for (int i{ 0 }; i < (int)image_list_L.size(); ++i)
+            if (std::find(prior_list_L.begin(), prior_list_L.end(), image_list_L[i]) == prior_list_L.end()) {
+                new_L.push_back(image_list_L[i]);
+                new_R.push_back(image_list_R[i]);
+            }
+        image_list_L.swap(new_L);
+        image_list_R.swap(new_R);
+        std::cout << "Prior views: " << prior_list_L.size() << ", new image pairs: " << image_list_L.size() << std::endl;
+    }
+    else if (monoFilename1) {
+        cv::FileStorage fs1(monoFilename1, cv::FileStorage::READ), fs2(monoFilename2, cv::FileStorage::READ);
+        if (!fs1.isOpened() || !fs2.isOpened() || !cam1.read(fs1) || !cam2.read(fs2))
+            return err("Failed to read mono camera params!\n", -1);
+    }
 
     // find corners in images
     // some images may fail automatic corner detection, images detected are in detec_list
-    if (!detectChessboardCorners(image_list_L, detect_list_L, imagePoints_L, image_list_R, detect_list_R, imagePoints_R, boardSize, imageSize))
+    if (!detectChessboardCorners(image_list_L, detect_list_L, imagePoints_L, image_list_R, detect_list_R, imagePoints_R, boardSize, imageSize)
+        && prior_list_L.size() + detect_list_L.size() < 3)
         return err("Not enough corner detected images!\n", -1);
 
     // calculate object coordinates
@@ -262,13 +391,93 @@ int main(int argc, char** argv)
     //  Mat newK;
     //  fisheye::estimateNewCameraMatrixForUndistortRectify(K, D, imageSize, Matx33d::eye(), newK, 1);
 
-    rms = cv::omnidir::stereoCalibrate(objectPoints, imagePoints_L, imagePoints_R, imageSize, imageSize, K1, xi1, D1, K2, xi2, D2, rvec, tvec, rvecs, tvecs, flags, criteria, idx);
-
+    if (warm) {
+        // new views posed in both cameras with the known intrinsics, the camera 1 -> 2 transform from the prior
+        // calibration or the median over the views, then the optimisation resumes from there
+        std::vector<std::string> list_L{ prior_list_L }, list_R{ prior_list_R };
+        std::vector<cv::Mat> points_L{ prior_points_L }, points_R{ prior_points_R };
+        std::vector<cv::Vec3d> rvecs_R, tvecs_R;
+        rvecs = prior_rvecs;
+        tvecs = prior_tvecs;
+        for (int i{ 0 }; i < (int)detect_list_L.size(); ++i) {
+            cv::Vec3d r1, t1, r2, t2;
+            if (!estimateBoardPose(cam1, object, imagePoints_L[i], r1, t1) || !estimateBoardPose(cam2, object, imagePoints_R[i], r2, t2)) {
+                std::cout << "[ \x1B[31m✘\033[0m ] No pose: " << detect_list_L[i] << std::endl;
+                continue;
+            }
+            list_L.push_back(detect_list_L[i]);
+            list_R.push_back(detect_list_R[i]);
+            points_L.push_back(imagePoints_L[i]);
+            points_R.push_back(imagePoints_R[i]);
+            rvecs.push_back(r1);
+            tvecs.push_back(t1);
+            rvecs_R.push_back(r2);
+            tvecs_R.push_back(t2);
+        }
+        if (list_L.size() < 3)
+            return err("Not enough posed images!\n", -1);
+        detect_list_L.swap(list_L);
+        detect_list_R.swap(list_R);
+        imagePoints_L.swap(points_L);
+        imagePoints_R.swap(points_R);
+        objectPoints.assign(detect_list_L.size(), object);
+
+        if (priorFilename) {
+            rvec = prior_rvec;
+            tvec = prior_tvec;
+        }
+        else
+            estimateStereoExtrinsics(std::vector<cv::Vec3d>(rvecs.end() - rvecs_R.size(), rvecs.end()),
+                std::vector<cv::Vec3d>(tvecs.end() - tvecs_R.size(), tvecs.end()), rvecs_R, tvecs_R, rvec, tvec);
 
-    _xi1 = xi1.at<double>(0);
-    _xi2 = xi2.at<double>(0);
+        rms = refineStereo(objectPoints, imagePoints_L, imagePoints_R, cam1, cam2, rvec, tvec, rvecs, tvecs, flags, criteria);
+        idx.create(1, (int)detect_list_L.size(), CV_32S);
+        for (int i{ 0 }; i < (int)idx.total(); ++i)
+            idx.at<int>(i) = i; //All pairs kept
+    }
+    else {
+        rms = cv::omnidir::stereoCalibrate(objectPoints, imagePoints_L, imagePoints_R, imageSize, imageSize, K1, xi1, D1, K2, xi2, D2, rvec, tvec, rvecs, tvecs, flags, criteria, idx);
+        cam1.K = cv::Matx33d(K1.ptr<double>());
+        cam1.D = cv::Vec4d(D1.ptr<double>());
+        cam1.xi = xi1.at<double>(0);
+        cam2.K = cv::Matx33d(K2.ptr<double>());
+        cam2.D = cv::Vec4d(D2.ptr<double>());
+        cam2.xi = xi2.at<double>(0);
+    }
 
-    saveCameraParams(outputFilename, flags, K1, K2, D1, D2, _xi1, _xi2, rvec, tvec, rvecs, tvecs, detect_list_L, detect_list_R, idx, rms, imagePoints_L, imagePoints_R);
+    // only the pairs the solver kept, in its order
+    std::vector<std::string> used_L, used_R;
+    std::vector<cv::Mat> used_points_L, used_points_R;
+    for (int i{ 0 }; i < (int)idx.total(); ++i) {
+        used_L.push_back(detect_list_L[idx.at<int>(i)]);
+        used_R.push_back(detect_list_R[idx.at<int>(i)]);
+        used_points_L.push_back(imagePoints_L[idx.at<int>(i)]);
+        used_points_R.push_back(imagePoints_R[idx.at<int>(i)]);
+    }
+    detect_list_L.swap(used_L);
+    detect_list_R.swap(used_R);
+    imagePoints_L.swap(used_points_L);
+    imagePoints_R.swap(used_points_R);
+    objectPoints.assign(detect_list_L.size(), object);
+
+    // per pair errors, one blurry frame shouldn't need a manual rerun
+    std::vector<ViewError> errors1, errors2;
+    std::vector<std::string> rejected_L, rejected_R;
+    rejectOutliers(flags, criteria, cam1, cam2, rvec, tvec, rms, objectPoints, imagePoints_L, imagePoints_R, detect_list_L, detect_list_R,
+        rvecs, tvecs, errors1, errors2, rejected_L, rejected_R);
+
+    K1 = cv::Mat(cam1.K);
+    K2 = cv::Mat(cam2.K);
+    D1 = cv::Mat(cam1.D).reshape(1, 1);
+    D2 = cv::Mat(cam2.D).reshape(1, 1);
+    _xi1 = cam1.xi;
+    _xi2 = cam2.xi;
+    idx.create(1, (int)detect_list_L.size(), CV_32S);
+    for (int i{ 0 }; i < (int)idx.total(); ++i)
+        idx.at<int>(i) = i;
+
+    saveCameraParams(outputFilename, flags, K1, K2, D1, D2, _xi1, _xi2, rvec, tvec, rvecs, tvecs, detect_list_L, detect_list_R, idx, rms, imagePoints_L, imagePoints_R,
+        errors1, errors2, rejected_L, rejected_R);
 
     return 0;
 }
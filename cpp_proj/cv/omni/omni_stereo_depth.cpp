@@ -0,0 +1,96 @@
+/*
+ * omni_stereo_depth.cpp
+ * Live disparity of a stereo rig
+ *
+ * Rectifies the live pair with its stereo calibration & computes its
+ * disparity with SGBM, over the full range every frame or, in temporal
+ * mode, around the previous frame's disparities, at full or reduced
+ * resolution (see omni_disparity.h).
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "opencv2/core.hpp"
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+#include "omni_atlas.h"
+#include "omni_disparity.h"
+#include "omni_refine.h"
+#include "omni_source.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define NUM_DISPARITIES (16 * 15) //Default, overridden from the command line
+#define STATS_INTERVAL 30 //Frames between 2 timing prints
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [SOURCE_LEFT]  [SOURCE_RIGHT]  [full|temporal]  [NUM_DISPARITIES]  [SCALE (1|2|4)]\n", 1);
+
+    cv::FileStorage fs(argv[1], cv::FileStorage::READ);
+    OmniIntrinsics cam1, cam2;
+    cv::Mat rvec, tvec;
+    if (!fs.isOpened() || !cam1.read(fs, "_1") || !cam2.read(fs, "_2") || fs["rvec"].empty() || fs["tvec"].empty())
+        return err("Invalid stereo calibration file!", -1);
+    fs["rvec"] >> rvec;
+    fs["tvec"] >> tvec;
+    const std::string mode{ argc > 4 ? argv[4] : "temporal" };
+    if (mode != "full" && mode != "temporal")
+        return err("Invalid mode, expected full or temporal", 1);
+    DisparityParams params;
+    int numDisparities{ NUM_DISPARITIES }, scale{ 1 };
+    if (argc > 5 && (!parseInt(argv[5], numDisparities) || numDisparities <= 0 || numDisparities > 16 * 256))
+        return err("Invalid number of disparities, expected 1 - 4096", 1);
+    params.numDisparities = (numDisparities + 15) / 16 * 16;
+    if ((argc > 6 && !parseInt(argv[6], scale)) || (scale != 1 && scale != 2 && scale != 4))
+        return err("Invalid scale, expected 1, 2 or 4", 1);
+
+    cv::VideoCapture capL, capR;
+    if (!openSource(argv[2], capL) || !openSource(argv[3], capR))
+        return err("Failed to open camera.", -1);
+    cv::Mat frameL, frameR;
+    if (!capL.read(frameL) || !capR.read(frameR) || frameL.empty() || frameL.size() != frameR.size())
+        return err("Capture read error", -1);
+    const cv::Size size{ frameL.size() };
+
+    UnwrapView viewL, viewR;
+    stereoViews(rvec, tvec, size, viewL, viewR);
+    const UnwrapAtlas rectL(cam1, size, std::vector<UnwrapView>(1, viewL)), rectR(cam2, size, std::vector<UnwrapView>(1, viewR));
+    MultiResDisparity stereo(params, scale, mode == "temporal");
+
+    cv::Mat recL, recR, disparity, shown, preview;
+    double totalMs{ 0.0 }, totalSearched{ 0.0 };
+    std::cout << "Hit ESC to exit" << std::endl;
+    for (long frame{ 1 };; ++frame) {
+        rectL.unwrap(frameL, recL);
+        rectR.unwrap(frameR, recR);
+        const int64 t{ cv::getTickCount() };
+        stereo.compute(recL, recR, disparity);
+        totalMs += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        totalSearched += stereo.searchedFraction();
+        if (frame % STATS_INTERVAL == 0) {
+            std::cout << "Disparity: " << totalMs / STATS_INTERVAL << " ms / frame, " << 100.0 * totalSearched / STATS_INTERVAL << "% of the range searched" << std::endl;
+            totalMs = totalSearched = 0.0;
+        }
+
+        disparity.convertTo(shown, CV_8U, 255.0 / (params.numDisparities * 16.0), -255.0 * params.minDisparity / params.numDisparities);
+        cv::applyColorMap(shown, shown, cv::COLORMAP_JET);
+        cv::hconcat(recL, shown, preview);
+        cv::imshow("Disparity", preview);
+        if ((cv::waitKey(1) & 0xff) == 27)
+            break;
+
+        if (!capL.read(frameL) || !capR.read(frameR) || frameL.empty() || frameR.empty())
+            return err("Capture read error", 0);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * omni_stereo_monitor.cpp
+ * Live epipolar consistency monitoring of a stereo rig
+ *
+ * Rectifies the live pair with its stereo calibration and, every few
+ * frames, checks in the background that matched features still lie on the
+ * same rows (see omni_epipolar.h). The smoothed median row offset is shown
+ * on the preview & a warning is printed once it exceeds MAX_DRIFT, i.e.
+ * the rig needs recalibrating.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "opencv2/core.hpp"
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+#include "omni_atlas.h"
+#include "omni_epipolar.h"
+#include "omni_refine.h"
+#include "omni_source.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define CHECK_INTERVAL 15 //Frames between 2 checks, defaults overridden from the command line
+#define MAX_DRIFT 1.0 //px, median row offset of the matches
+#define DRIFT_ALPHA 0.2 //Smoothing over the checks
+#define MAX_FEATURES 1000
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [SOURCE_LEFT]  [SOURCE_RIGHT]  [CHECK_INTERVAL (frames)]  [MAX_DRIFT (px)]\n", 1);
+
+    cv::FileStorage fs(argv[1], cv::FileStorage::READ);
+    OmniIntrinsics cam1, cam2;
+    cv::Mat rvec, tvec;
+    if (!fs.isOpened() || !cam1.read(fs, "_1") || !cam2.read(fs, "_2") || fs["rvec"].empty() || fs["tvec"].empty())
+        return err("Invalid stereo calibration file!", -1);
+    fs["rvec"] >> rvec;
+    fs["tvec"] >> tvec;
+    int interval{ CHECK_INTERVAL };
+    if (argc > 4 && (!parseInt(argv[4], interval) || interval <= 0))
+        return err("Invalid check interval, expected a number of frames > 0", 1);
+    double maxDrift{ MAX_DRIFT };
+    if (argc > 5 && (!parseDouble(argv[5], maxDrift) || !(maxDrift > 0)))
+        return err("Invalid maximum drift, expected px > 0", 1);
+
+    cv::VideoCapture capL, capR;
+    if (!openSource(argv[2], capL) || !openSource(argv[3], capR))
+        return err("Failed to open camera.", -1);
+    cv::Mat frameL, frameR;
+    if (!capL.read(frameL) || !capR.read(frameR) || frameL.empty() || frameL.size() != frameR.size())
+        return err("Capture read error", -1);
+    const cv::Size size{ frameL.size() };
+
+    UnwrapView viewL, viewR;
+    stereoViews(rvec, tvec, size, viewL, viewR);
+    const UnwrapAtlas rectL(cam1, size, std::vector<UnwrapView>(1, viewL)), rectR(cam2, size, std::vector<UnwrapView>(1, viewR));
+
+    EpipolarMonitor monitor(DRIFT_ALPHA, maxDrift, MAX_FEATURES);
+    cv::Mat recL, recR, grayL, grayR, preview;
+    bool warned{ false };
+    std::cout << "Hit ESC to exit" << std::endl;
+    for (long frame{ 0 };; ++frame) {
+        rectL.unwrap(frameL, recL);
+        rectR.unwrap(frameR, recR);
+        if (frame % interval == 0 && monitor.idle()) {
+            cv::cvtColor(recL, grayL, cv::COLOR_BGR2GRAY); //New buffers each time, the monitor keeps the previous ones until done
+            cv::cvtColor(recR, grayR, cv::COLOR_BGR2GRAY);
+            monitor.submit(grayL, grayR);
+            grayL.release();
+            grayR.release();
+        }
+
+        EpipolarStats stats;
+        if (monitor.poll(stats)) {
+            const double drift{ monitor.drift() };
+            std::cout << "Matches: " << stats.matches << "\trow offset median: " << stats.median << " px, 90%: " << stats.p90
+                      << " px, bias: " << stats.bias << " px\tdrift: " << drift << " px" << std::endl;
+            if (monitor.degraded() != warned) {
+                warned = !warned;
+                if (warned)
+                    std::cout << "\x1B[31mWarning\033[0m: rectified rows drifted by " << drift << " px, the rig needs recalibrating" << std::endl;
+            }
+        }
+
+        cv::hconcat(recL, recR, preview);
+        for (int y{ preview.rows / 16 }; y < preview.rows; y += preview.rows / 16)
+            cv::line(preview, cv::Point(0, y), cv::Point(preview.cols, y), cv::Scalar(0, 0, 255), 1);
+        const double drift{ monitor.drift() };
+        cv::putText(preview, drift < 0 ? std::string("drift: -") : "drift: " + std::to_string(drift) + " px", cv::Point(10, 30),
+            cv::FONT_HERSHEY_SIMPLEX, 0.8, warned ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0), 2);
+        cv::imshow("Stereo monitor", preview);
+        if ((cv::waitKey(1) & 0xff) == 27)
+            break;
+
+        if (!capL.read(frameL) || !capR.read(frameR) || frameL.empty() || frameR.empty())
+            return err("Capture read error", 0);
+    }
+    return 0;
+}
@@ -0,0 +1,669 @@
+/*
+ * omni_synth.cpp
+ * Synthetic omnidirectional views with ground truth
+ *
+ * Renders chessboard views or textured scenes through the Mei model of a
+ * calibration file (omni_calib / omni_calib_stereo output), at any
+ * resolution & count, for scale tests of calibration, rectification &
+ * stereo without hardware.
+ *
+ * Every camera gets a ray map once (pixel -> unit ray, by inverting the
+ * distortion & lifting to the unit sphere). A view is a textured room
+ * around the camera, plus the board (board mode) or floating textured
+ * quads (scene mode); each pixel is the closest hit along its ray, looked
+ * up in a texture atlas with a single remap. Views are rendered in
+ * parallel, each from its own RNG (SEED + view index), so the output does
+ * not depend on the number of threads.
+ *
+ * Output in OUT_DIR:
+ *   img_XXXXX.png / left_XXXXX.png & right_XXXXX.png, with imagelist(_left/_right).xml
+ *   depth_XXXXX.png / depth_left_XXXXX.png & depth_right_XXXXX.png: 16 bit range
+ *     along the ray from the projection centre, in depth_scale units (0: no hit)
+ *   ground_truth.xml: the (rescaled) calibration, readable by omni_rectify(_stereo),
+ *     & the board poses & projected inner corners (calcChessboardCorners order)
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/core.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "omni_refine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#define SEED 1487 //Default, overridden from the command line
+#define IMG_EXT ".png"
+
+// Scene, in square widths
+#define ROOM_SIZE 60.0 //Side of the room around the camera
+#define ROOM_OFFSET 0.2 //Camera offset from the room centre, fraction of ROOM_SIZE
+#define BOARD_MIN_DIST 1.2 //Board distance range, in board diagonals
+#define BOARD_MAX_DIST 3.5
+#define BOARD_MAX_TILT 50.0 //deg
+#define BOARD_MAX_ROLL 30.0 //deg
+#define BOARD_MARGIN 0.03 //Inner corners stay this far (fraction of the size) from the image border
+#define SCENE_QUADS 5 //Floating textured quads in scene mode
+#define POSE_TRIES 500
+
+// Rendering
+#define TILE_SIZE 1024 //Atlas tile per room wall
+#define BOARD_PX_PER_SQUARE 64
+#define BLUR_SIGMA 0.6 //Lens blur
+#define NOISE_SIGMA 2.0 //Sensor noise
+#define DEPTH_STEPS_PER_SQUARE 100.0 //Depth unit: 1 / DEPTH_STEPS_PER_SQUARE square
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+// === CAMERA MODEL ===
+
+// Calibrated camera (see omni_refine.h) at the resolution it is rendered at
+struct MeiCamera {
+    OmniIntrinsics model;
+    cv::Size size;
+
+    bool project(const cv::Vec3d& X, cv::Point2d& p) const
+    {
+        cv::Vec2d q;
+        if (!model.project(X, q))
+            return false;
+        p = cv::Point2d(q[0], q[1]);
+        return true;
+    }
+
+    // Unit ray of a pixel, false outside the part of the image the model maps
+    bool unproject(const cv::Point2d& p, cv::Vec3d& ray) const
+    {
+        if (!model.lift(cv::Vec2d(p.x, p.y), ray))
+            return false;
+        // The iteration doesn't converge everywhere with strong distortion
+        cv::Point2d q;
+        return project(ray, q) && std::hypot(q.x - p.x, q.y - p.y) < 0.05;
+    }
+
+    // Same camera at another resolution, the calibration size is taken as 2x the principal point
+    MeiCamera scaled(const cv::Size& to) const
+    {
+        MeiCamera c = *this;
+        const cv::Matx33d& K = model.K;
+        const double sx{ to.width / (2 * K(0, 2)) }, sy{ to.height / (2 * K(1, 2)) };
+        c.model.K = cv::Matx33d(K(0, 0) * sx, K(0, 1) * sx, K(0, 2) * sx, 0, K(1, 1) * sy, K(1, 2) * sy, 0, 0, 1);
+        c.size = to;
+        return c;
+    }
+};
+
+static bool readCamera(const cv::FileStorage& fs, const std::string& suffix, MeiCamera& cam)
+{
+    if (!cam.model.read(fs, suffix))
+        return false;
+    cam.size = cv::Size(cvRound(2 * cam.model.K(0, 2)), cvRound(2 * cam.model.K(1, 2)));
+    return true;
+}
+
+// Ray map (CV_32FC3), (0, 0, 0) where the model has no ray
+class RayMapBody : public cv::ParallelLoopBody {
+public:
+    RayMapBody(const MeiCamera& cam, cv::Mat& rays)
+        : cam_(cam)
+        , rays_(rays)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int y{ range.start }; y < range.end; ++y) {
+            cv::Vec3f* row = rays_.ptr<cv::Vec3f>(y);
+            for (int x{ 0 }; x < rays_.cols; ++x) {
+                cv::Vec3d r;
+                row[x] = cam_.unproject(cv::Point2d(x, y), r) ? cv::Vec3f((float)r[0], (float)r[1], (float)r[2]) : cv::Vec3f();
+            }
+        }
+    }
+
+private:
+    const MeiCamera& cam_;
+    cv::Mat& rays_;
+};
+
+// === SCENE ===
+
+// Textured rectangle [x0, x1] x [y0, y1] in the plane z = 0 of its frame (X_cam = R * X + t),
+// atlas pixel = origin + (X - x0, Y - y0) * scale
+struct Quad {
+    cv::Matx33d R;
+    cv::Vec3d t;
+    double x0, x1, y0, y1;
+    cv::Point2d origin;
+    double scale;
+};
+
+// Everything in camera 1 coordinates
+struct Scene {
+    cv::Matx33d roomR; //Room frame -> camera
+    cv::Vec3d roomC; //Room centre
+    double half; //Half side of the room
+    std::vector<Quad> quads;
+};
+
+// A camera in the scene: ray map, ray rotation & centre in camera 1 coordinates
+struct View {
+    const MeiCamera* cam;
+    const cv::Mat* rays;
+    cv::Matx33d R;
+    cv::Vec3d c;
+};
+
+static cv::Matx33d rotation(const cv::Vec3d& rvec)
+{
+    cv::Matx33d R;
+    cv::Rodrigues(rvec, R);
+    return R;
+}
+
+static cv::Vec3d randomAxis(cv::RNG& rng)
+{
+    const double z{ rng.uniform(-1.0, 1.0) }, phi{ rng.uniform(0.0, 2 * CV_PI) }, r{ std::sqrt(1 - z * z) };
+    return cv::Vec3d(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+class Generator {
+public:
+    Generator(bool board, const cv::Size& boardSize, double square, uint64_t seed)
+        : board_(board)
+        , boardSize_(boardSize)
+        , sq_(square)
+        , seed_(seed)
+    {
+    }
+
+    bool init(const MeiCamera& cam1, const MeiCamera* cam2, const cv::Vec3d& rvec, const cv::Vec3d& tvec)
+    {
+        cams_.push_back(cam1);
+        if (cam2) {
+            cams_.push_back(*cam2);
+            R_ = rotation(rvec);
+            T_ = tvec;
+        }
+        rays_.resize(cams_.size());
+        for (size_t i{ 0 }; i < cams_.size(); ++i) {
+            rays_[i].create(cams_[i].size, CV_32FC3);
+            cv::parallel_for_(cv::Range(0, rays_[i].rows), RayMapBody(cams_[i], rays_[i]));
+            cv::Mat mask;
+            cv::inRange(rays_[i], cv::Scalar::all(0), cv::Scalar::all(0), mask);
+            if (cv::countNonZero(mask) == (int)mask.total())
+                return false;
+        }
+        makeAtlas();
+        return true;
+    }
+
+    // Render & write view idx, false if no valid board pose was found
+    bool render(int idx, const std::string& outDir)
+    {
+        cv::RNG rng(seed_ * 1000003ULL + (uint64_t)idx);
+        Scene s;
+        if (!makeScene(rng, s, idx))
+            return false;
+
+        cv::Mat img, depth;
+        for (size_t i{ 0 }; i < cams_.size(); ++i) {
+            View v;
+            v.cam = &cams_[i];
+            v.rays = &rays_[i];
+            // Camera 2: X2 = R * X1 + T, so its rays are R^T * r from -R^T * T
+            v.R = i ? R_.t() : cv::Matx33d::eye();
+            v.c = i ? cv::Vec3d(-(R_.t() * T_)) : cv::Vec3d();
+            renderView(s, v, rng, img, depth);
+            const std::string name{ cams_.size() == 1 ? "img" : (i ? "right" : "left") };
+            if (!cv::imwrite(outDir + "/" + fileName(name, idx, IMG_EXT), img) ||
+                !cv::imwrite(outDir + "/" + fileName(cams_.size() == 1 ? "depth" : "depth_" + name, idx, ".png"), depth))
+                return false;
+        }
+        return true;
+    }
+
+    static std::string fileName(const std::string& prefix, int idx, const char* ext)
+    {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "_%05d", idx);
+        return prefix + buf + ext;
+    }
+
+    // Ground truth storage for count views
+    void resize(int count)
+    {
+        boardR.assign(count, cv::Vec3d());
+        boardT.assign(count, cv::Vec3d());
+        corners[0].assign(count, std::vector<cv::Vec2d>());
+        corners[1].assign(cams_.size() > 1 ? count : 0, std::vector<cv::Vec2d>());
+    }
+
+    void stereo(cv::Vec3d& rvec, cv::Vec3d& tvec) const
+    {
+        cv::Rodrigues(R_, rvec);
+        tvec = T_;
+    }
+
+    size_t cameras() const { return cams_.size(); }
+    const MeiCamera& camera(int i) const { return cams_[i]; }
+    double depthScale() const { return sq_ / DEPTH_STEPS_PER_SQUARE; }
+
+    // Ground truth of the rendered views, indexed by view
+    std::vector<cv::Vec3d> boardR, boardT;
+    std::vector<std::vector<cv::Vec2d> > corners[2];
+
+private:
+    // Board corners in the board frame, calcChessboardCorners order
+    std::vector<cv::Vec3d> objectPoints() const
+    {
+        std::vector<cv::Vec3d> pts;
+        for (int i{ 0 }; i < boardSize_.height; ++i)
+            for (int j{ 0 }; j < boardSize_.width; ++j)
+                pts.push_back(cv::Vec3d(j * sq_, i * sq_, 0.0));
+        return pts;
+    }
+
+    bool inRoom(const Scene& s, const cv::Vec3d& p) const
+    {
+        const cv::Vec3d q{ s.roomR.t() * (p - s.roomC) };
+        return std::abs(q[0]) < s.half && std::abs(q[1]) < s.half && std::abs(q[2]) < s.half;
+    }
+
+    // Projected corners for camera i, false if any falls outside the margin
+    bool projectCorners(const Quad& b, int i, std::vector<cv::Vec2d>& out) const
+    {
+        const MeiCamera& cam = cams_[i];
+        const double mx{ BOARD_MARGIN * cam.size.width }, my{ BOARD_MARGIN * cam.size.height };
+        const cv::Vec3d normal(b.R(0, 2), b.R(1, 2), b.R(2, 2));
+        const cv::Vec3d c{ i ? cv::Vec3d(-(R_.t() * T_)) : cv::Vec3d() };
+        out.clear();
+        for (const cv::Vec3d& P : objectPoints()) {
+            cv::Vec3d X{ b.R * P + b.t };
+            if (normal.dot(X - c) <= 0) //Seen from the back
+                return false;
+            if (i)
+                X = R_ * X + T_;
+            cv::Point2d p;
+            if (!cam.project(X, p) || p.x < mx || p.y < my || p.x > cam.size.width - 1 - mx || p.y > cam.size.height - 1 - my)
+                return false;
+            out.push_back(cv::Vec2d(p.x, p.y));
+        }
+        return true;
+    }
+
+    bool makeScene(cv::RNG& rng, Scene& s, int idx)
+    {
+        s.roomR = rotation(randomAxis(rng) * rng.uniform(0.0, 2 * CV_PI));
+        s.half = ROOM_SIZE * sq_ / 2;
+        s.roomC = cv::Vec3d(rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0)) * (ROOM_OFFSET * ROOM_SIZE * sq_);
+        if (!board_) {
+            for (int i{ 0 }; i < SCENE_QUADS; ++i)
+                s.quads.push_back(randomQuad(rng, s));
+            return true;
+        }
+
+        // Board facing camera 1 around a random pixel's ray, tilted & rolled
+        const cv::Size sz{ cams_[0].size };
+        const double diag{ sq_ * std::hypot(boardSize_.width + 3.0, boardSize_.height + 3.0) };
+        const cv::Vec3d centre((boardSize_.width - 1) * sq_ / 2, (boardSize_.height - 1) * sq_ / 2, 0.0);
+        for (int t{ 0 }; t < POSE_TRIES; ++t) {
+            const cv::Vec3f r{ rays_[0].at<cv::Vec3f>(rng.uniform(0, sz.height), rng.uniform(0, sz.width)) };
+            if (r == cv::Vec3f())
+                continue;
+            const cv::Vec3d ez(r[0], r[1], r[2]);
+            const cv::Vec3d ex{ cv::normalize((std::abs(ez[1]) < 0.9 ? cv::Vec3d(0, 1, 0) : cv::Vec3d(1, 0, 0)).cross(ez)) };
+            const cv::Vec3d ey{ ez.cross(ex) };
+            const cv::Matx33d R0(ex[0], ey[0], ez[0], ex[1], ey[1], ez[1], ex[2], ey[2], ez[2]);
+            const double phi{ rng.uniform(0.0, 2 * CV_PI) };
+            const double tilt{ rng.uniform(0.0, BOARD_MAX_TILT) * CV_PI / 180 }, roll{ rng.uniform(-BOARD_MAX_ROLL, BOARD_MAX_ROLL) * CV_PI / 180 };
+
+            Quad b;
+            b.R = rotation((std::cos(phi) * ex + std::sin(phi) * ey) * tilt) * rotation(ez * roll) * R0;
+            b.t = ez * (rng.uniform(BOARD_MIN_DIST, BOARD_MAX_DIST) * diag) - b.R * centre;
+            b.x0 = -2 * sq_;
+            b.x1 = (boardSize_.width + 1) * sq_;
+            b.y0 = -2 * sq_;
+            b.y1 = (boardSize_.height + 1) * sq_;
+            b.origin = boardOrigin_;
+            b.scale = BOARD_PX_PER_SQUARE / sq_;
+
+            bool inside{ true };
+            for (int k{ 0 }; k < 4 && inside; ++k)
+                inside = inRoom(s, b.R * cv::Vec3d(k & 1 ? b.x1 : b.x0, k & 2 ? b.y1 : b.y0, 0) + b.t);
+            if (!inside || !projectCorners(b, 0, corners[0][idx]) || (cams_.size() > 1 && !projectCorners(b, 1, corners[1][idx])))
+                continue;
+
+            cv::Rodrigues(b.R, boardR[idx]);
+            boardT[idx] = b.t;
+            s.quads.push_back(b);
+            return true;
+        }
+        return false;
+    }
+
+    // Textured quad of 4 - 12 squares floating in the room, randomly oriented
+    Quad randomQuad(cv::RNG& rng, const Scene& s) const
+    {
+        Quad q;
+        const double w{ rng.uniform(4.0, 12.0) * sq_ }, h{ rng.uniform(4.0, 12.0) * sq_ };
+        q.R = rotation(randomAxis(rng) * rng.uniform(0.0, 2 * CV_PI));
+        q.t = randomAxis(rng) * rng.uniform(6 * sq_, 0.5 * s.half); //Away from the camera, inside the room
+        q.x0 = -w / 2;
+        q.x1 = w / 2;
+        q.y0 = -h / 2;
+        q.y1 = h / 2;
+        const int tile{ rng.uniform(0, 6) };
+        q.origin = cv::Point2d((tile % 3) * TILE_SIZE, (tile / 3) * TILE_SIZE);
+        q.scale = (TILE_SIZE - 1) / std::max(w, h);
+        return q;
+    }
+
+    // Closest hit per pixel -> atlas coordinates & range, then remap
+    void renderView(const Scene& s, const View& v, cv::RNG& rng, cv::Mat& img, cv::Mat& depth)
+    {
+        const cv::Size sz{ v.cam->size };
+        cv::Mat mapX(sz, CV_32FC1), mapY(sz, CV_32FC1);
+        depth.create(sz, CV_16UC1);
+        const cv::Matx33d roomRt{ s.roomR.t() };
+        const cv::Vec3d cb{ roomRt * (v.c - s.roomC) };
+        const double h{ s.half }, toDepth{ 1.0 / depthScale() };
+
+        for (int y{ 0 }; y < sz.height; ++y) {
+            const cv::Vec3f* ray = v.rays->ptr<cv::Vec3f>(y);
+            float* mx = mapX.ptr<float>(y);
+            float* my = mapY.ptr<float>(y);
+            ushort* d = depth.ptr<ushort>(y);
+            for (int x{ 0 }; x < sz.width; ++x) {
+                if (ray[x] == cv::Vec3f()) {
+                    mx[x] = my[x] = -10.f; //Black outside the image circle
+                    d[x] = 0;
+                    continue;
+                }
+                const cv::Vec3d r{ v.R * cv::Vec3d(ray[x][0], ray[x][1], ray[x][2]) };
+
+                // Room: exit through the closest wall, 1 atlas tile per wall
+                const cv::Vec3d rb{ roomRt * r };
+                double best{ std::numeric_limits<double>::max() };
+                int axis{ 0 };
+                for (int a{ 0 }; a < 3; ++a) {
+                    if (std::abs(rb[a]) < 1e-12)
+                        continue;
+                    const double t{ ((rb[a] > 0 ? h : -h) - cb[a]) / rb[a] };
+                    if (t < best) {
+                        best = t;
+                        axis = a;
+                    }
+                }
+                const cv::Vec3d hit{ cb + rb * best };
+                const int face{ axis * 2 + (rb[axis] > 0) };
+                const double u{ (hit[(axis + 1) % 3] + h) / (2 * h) * (TILE_SIZE - 1) };
+                const double w{ (hit[(axis + 2) % 3] + h) / (2 * h) * (TILE_SIZE - 1) };
+                mx[x] = (float)((face % 3) * TILE_SIZE + u);
+                my[x] = (float)((face / 3) * TILE_SIZE + w);
+
+                // Quads in front of the wall
+                for (const Quad& q : s.quads) {
+                    const cv::Vec3d n(q.R(0, 2), q.R(1, 2), q.R(2, 2));
+                    const double den{ n.dot(r) };
+                    if (std::abs(den) < 1e-12)
+                        continue;
+                    const double t{ n.dot(q.t - v.c) / den };
+                    if (t <= 0 || t >= best)
+                        continue;
+                    const cv::Vec3d P{ q.R.t() * (v.c + r * t - q.t) };
+                    if (P[0] < q.x0 || P[0] > q.x1 || P[1] < q.y0 || P[1] > q.y1)
+                        continue;
+                    best = t;
+                    mx[x] = (float)(q.origin.x + (P[0] - q.x0) * q.scale - 0.5);
+                    my[x] = (float)(q.origin.y + (P[1] - q.y0) * q.scale - 0.5);
+                }
+                d[x] = cv::saturate_cast<ushort>(best * toDepth);
+            }
+        }
+
+        cv::remap(atlas_, img, mapX, mapY, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+        cv::GaussianBlur(img, img, cv::Size(0, 0), BLUR_SIGMA);
+        cv::Mat noise(sz, CV_16SC3);
+        rng.fill(noise, cv::RNG::NORMAL, 0, NOISE_SIGMA);
+        cv::add(img, noise, img, cv::noArray(), CV_8UC3);
+    }
+
+    // 3x2 wall tiles (smooth noise, fine noise & shapes, for stereo matching) + the board below
+    void makeAtlas()
+    {
+        const int bw{ (boardSize_.width + 3) * BOARD_PX_PER_SQUARE }, bh{ (boardSize_.height + 3) * BOARD_PX_PER_SQUARE };
+        atlas_.create(2 * TILE_SIZE + bh, std::max(3 * TILE_SIZE, bw), CV_8UC3);
+        atlas_.setTo(cv::Scalar::all(128));
+        cv::RNG rng(seed_);
+        for (int t{ 0 }; t < 6; ++t) {
+            cv::Mat tile = atlas_(cv::Rect((t % 3) * TILE_SIZE, (t / 3) * TILE_SIZE, TILE_SIZE, TILE_SIZE));
+            cv::Mat coarse(TILE_SIZE / 32, TILE_SIZE / 32, CV_8UC3), fine(TILE_SIZE / 4, TILE_SIZE / 4, CV_8UC3), up;
+            rng.fill(coarse, cv::RNG::UNIFORM, 0, 256);
+            rng.fill(fine, cv::RNG::UNIFORM, 0, 256);
+            cv::resize(coarse, tile, tile.size(), 0, 0, cv::INTER_CUBIC);
+            cv::resize(fine, up, tile.size(), 0, 0, cv::INTER_LINEAR);
+            cv::addWeighted(tile, 0.6, up, 0.4, 0, tile);
+            for (int i{ 0 }; i < 60; ++i) {
+                const cv::Scalar c(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+                const cv::Point p(rng.uniform(0, TILE_SIZE), rng.uniform(0, TILE_SIZE));
+                if (i & 1)
+                    cv::circle(tile, p, rng.uniform(8, TILE_SIZE / 10), c, -1, cv::LINE_AA);
+                else
+                    cv::rectangle(tile, cv::Rect(p.x, p.y, rng.uniform(8, TILE_SIZE / 8), rng.uniform(8, TILE_SIZE / 8)), c, -1);
+            }
+        }
+
+        // Board: (w + 1) x (h + 1) squares, 1 white square of margin around
+        boardOrigin_ = cv::Point2d(0, 2 * TILE_SIZE);
+        cv::Mat board = atlas_(cv::Rect(0, 2 * TILE_SIZE, bw, bh));
+        board.setTo(cv::Scalar::all(255));
+        for (int y{ 0 }; y <= boardSize_.height; ++y)
+            for (int x{ 0 }; x <= boardSize_.width; ++x)
+                if (!((x + y) & 1))
+                    board(cv::Rect((x + 1) * BOARD_PX_PER_SQUARE, (y + 1) * BOARD_PX_PER_SQUARE, BOARD_PX_PER_SQUARE, BOARD_PX_PER_SQUARE))
+                        .setTo(cv::Scalar::all(0));
+    }
+
+    bool board_;
+    cv::Size boardSize_;
+    double sq_;
+    uint64_t seed_;
+    std::vector<MeiCamera> cams_;
+    std::vector<cv::Mat> rays_;
+    cv::Matx33d R_;
+    cv::Vec3d T_;
+    cv::Mat atlas_;
+    cv::Point2d boardOrigin_;
+};
+
+// Renders a batch of views, failures are flagged per view
+class RenderBody : public cv::ParallelLoopBody {
+public:
+    RenderBody(Generator& gen, const std::string& outDir, int first, std::vector<uchar>& ok)
+        : gen_(gen)
+        , outDir_(outDir)
+        , first_(first)
+        , ok_(ok)
+    {
+    }
+
+    void operator()(const cv::Range& range) const
+    {
+        for (int i{ range.start }; i < range.end; ++i)
+            ok_[first_ + i] = gen_.render(first_ + i, outDir_);
+    }
+
+private:
+    Generator& gen_;
+    const std::string& outDir_;
+    int first_;
+    std::vector<uchar>& ok_;
+};
+
+// === OUTPUT ===
+
+static bool writeImageList(const std::string& path, const std::string& outDir, const std::string& prefix, int count)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    fs << "images"
+       << "[";
+    for (int i{ 0 }; i < count; ++i)
+        fs << outDir + "/" + Generator::fileName(prefix, i, IMG_EXT);
+    fs << "]";
+    return true;
+}
+
+static cv::Mat pointsMat(const std::vector<std::vector<cv::Vec2d> >& pts)
+{
+    if (pts.empty() || pts[0].empty())
+        return cv::Mat();
+    cv::Mat m((int)pts.size(), (int)pts[0].size(), CV_64FC2);
+    for (int i{ 0 }; i < m.rows; ++i)
+        std::copy(pts[i].begin(), pts[i].end(), m.ptr<cv::Vec2d>(i));
+    return m;
+}
+
+static bool writeGroundTruth(const std::string& path, const Generator& gen, const std::string& calib, bool board,
+    int count, const cv::Size& boardSize, double square, uint64_t seed)
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+        return false;
+    time_t tt;
+    time(&tt);
+    char buf[512];
+    strftime(buf, sizeof(buf) - 1, "%c", localtime(&tt));
+
+    // Calibration first, same layout as omni_calib(_stereo) so the rectify tools accept it
+    fs << "calibration_time" << buf;
+    fs << "nFrames" << count;
+    const bool stereo{ gen.cameras() > 1 };
+    for (int i{ 0 }; i < (int)gen.cameras(); ++i) {
+        const std::string suffix{ stereo ? "_" + std::to_string(i + 1) : "" };
+        const MeiCamera& cam = gen.camera(i);
+        fs << "camera_matrix" + suffix << cv::Mat(cam.model.K);
+        fs << "distortion_coefficients" + suffix << cv::Mat(cam.model.D).reshape(1, 1);
+        fs << "xi" + suffix << cam.model.xi;
+    }
+    if (stereo) {
+        cv::Vec3d rvec, tvec;
+        gen.stereo(rvec, tvec);
+        fs << "rvec" << rvec;
+        fs << "tvec" << tvec;
+    }
+
+    fs << "source_calibration" << calib;
+    fs << "mode" << (board ? "board" : "scene");
+    fs << "seed" << (int)seed;
+    fs << "image_width" << gen.camera(0).size.width;
+    fs << "image_height" << gen.camera(0).size.height;
+    fs << "depth_scale" << gen.depthScale(); //Range = depth pixel * depth_scale
+    if (!board)
+        return true;
+
+    fs << "board_width" << boardSize.width;
+    fs << "board_height" << boardSize.height;
+    fs << "square_width" << square;
+    cv::Mat rvec_tvec(count, 6, CV_64F);
+    for (int i{ 0 }; i < count; ++i) {
+        cv::Mat(gen.boardR[i]).reshape(1, 1).copyTo(rvec_tvec(cv::Rect(0, i, 3, 1)));
+        cv::Mat(gen.boardT[i]).reshape(1, 1).copyTo(rvec_tvec(cv::Rect(3, i, 3, 1)));
+    }
+    //Board pose in camera 1 per view (rotation vector + translation vector)
+    fs << "extrinsic_parameters" << rvec_tvec;
+    fs << (stereo ? "image_points_1" : "image_points") << pointsMat(gen.corners[0]);
+    if (stereo)
+        fs << "image_points_2" << pointsMat(gen.corners[1]);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [OUT_DIR]  [board|scene]  [COUNT]  [WIDTHxHEIGHT (calibration)]  [CHECKBOARD_HORIZONTAL_POINTS (9)]  [CHECKBOARD_VERTICAL_POINTS (6)]  [SQUARE_WIDTH (mm, 30)]  [SEED]\n", 1);
+
+    const std::string calib{ argv[1] }, outDir{ argv[2] }, mode{ argv[3] };
+    const int count{ atoi(argv[4]) };
+    if (mode != "board" && mode != "scene")
+        return err("\nMode has to be board or scene!\n", 2);
+    if (count < 1)
+        return err("\n[COUNT] has to be > 0!\n", 2);
+    cv::Size size;
+    if (argc > 5 && sscanf(argv[5], "%dx%d", &size.width, &size.height) != 2)
+        return err("\nInvalid resolution, use WIDTHxHEIGHT!\n", 2);
+    const cv::Size boardSize(argc > 6 ? atoi(argv[6]) : 9, argc > 7 ? atoi(argv[7]) : 6);
+    if (boardSize.width <= 2 || boardSize.height <= 2)
+        return err("\n[CHECKBOARD_HORIZONTAL_POINTS] & [CHECKBOARD_VERTICAL_POINTS] have to be > 2!\n", 2);
+    const double square{ argc > 8 ? atof(argv[8]) : 30.0 };
+    if (square <= 0.0)
+        return err("\n[SQUARE_WIDTH] have to be > 0.0!\n", 2);
+    const uint64_t seed{ argc > 9 ? (uint64_t)atoll(argv[9]) : (uint64_t)SEED };
+
+    // Mono (omni_calib) or stereo (omni_calib_stereo) calibration
+    cv::FileStorage fs(calib, cv::FileStorage::READ);
+    if (!fs.isOpened())
+        return err("Error reading calibration file...", -1);
+    MeiCamera cam1, cam2;
+    cv::Vec3d rvec, tvec;
+    const bool stereo{ readCamera(fs, "_1", cam1) };
+    if (stereo) {
+        if (!readCamera(fs, "_2", cam2))
+            return err("Invalid stereo calibration file!", -1);
+        fs["rvec"] >> rvec;
+        fs["tvec"] >> tvec;
+    }
+    else if (!readCamera(fs, "", cam1))
+        return err("Invalid calibration file!", -1);
+    fs.release();
+    if (size.area() > 0) {
+        cam1 = cam1.scaled(size);
+        if (stereo)
+            cam2 = cam2.scaled(size);
+    }
+
+    std::cout << "\n[CONFIG]\nCalibration:\t" << calib << (stereo ? " (stereo)" : " (mono)") << "\nOutput:\t\t" << outDir
+              << "\nMode:\t\t" << mode << "\nCount:\t\t" << count << "\nResolution:\t" << cam1.size.width << "x" << cam1.size.height
+              << "\nBoard:\t\t" << boardSize.width << "x" << boardSize.height << ", " << square << " mm\nSeed:\t\t" << seed << std::endl;
+
+    Generator gen(mode == "board", boardSize, square, seed);
+    if (!gen.init(cam1, stereo ? &cam2 : nullptr, rvec, tvec))
+        return err("Calibration maps no pixel to a ray!", -1);
+    gen.resize(count);
+
+    // Batches, for progress & so a failure stops early
+    const int batch{ 64 };
+    std::vector<uchar> ok(count, 0);
+    for (int first{ 0 }; first < count; first += batch) {
+        const int n{ std::min(batch, count - first) };
+        cv::parallel_for_(cv::Range(0, n), RenderBody(gen, outDir, first, ok));
+        for (int i{ first }; i < first + n; ++i)
+            if (!ok[i])
+                return err("\nView " + std::to_string(i) + " failed: no valid board pose (board too large for the FOV?) or cannot write to " + outDir, -1);
+        std::cout << "\rRendered " << first + n << " / " << count << std::flush;
+    }
+    std::cout << std::endl;
+
+    const bool listsOk{ stereo ? writeImageList(outDir + "/imagelist_left.xml", outDir, "left", count) &&
+                writeImageList(outDir + "/imagelist_right.xml", outDir, "right", count)
+                               : writeImageList(outDir + "/imagelist.xml", outDir, "img", count) };
+    if (!listsOk || !writeGroundTruth(outDir + "/ground_truth.xml", gen, calib, mode == "board", count, boardSize, square, seed))
+        return err("Could not write the image lists / ground truth to " + outDir, -1);
+
+    std::cout << "\n=== Done! ===\n" << std::endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "omni_tiles.h"
+
+#include <algorithm>
+
+TileRectifier::TileRectifier(const OmniIntrinsics& cam, const cv::Size& imageSize, const UnwrapView& view, int tileSize, bool cacheFrame, int interpolation)
+    : cam_(cam)
+    , imageSize_(imageSize)
+    , view_(view)
+    , tileSize_(std::max(8, tileSize))
+    , interpolation_(interpolation)
+    , cacheFrame_(cacheFrame)
+    , tiles_((view.size.width + tileSize_ - 1) / tileSize_, (view.size.height + tileSize_ - 1) / tileSize_)
+    , tile_(tiles_.area())
+{
+    for (int ty{ 0 }; ty < tiles_.height; ++ty)
+        for (int tx{ 0 }; tx < tiles_.width; ++tx)
+            tile_[ty * tiles_.width + tx].rect = cv::Rect(tx * tileSize_, ty * tileSize_, tileSize_, tileSize_) & cv::Rect(cv::Point(), view.size);
+}
+
+void TileRectifier::setFrame(const cv::Mat& frame)
+{
+    CV_Assert(frame.size() == imageSize_);
+    frame_ = frame;
+    ++frameId_;
+    rectified_ = 0;
+}
+
+TileRectifier::Tile& TileRectifier::mapTile(int tx, int ty)
+{
+    Tile& t = tile_[ty * tiles_.width + tx];
+    if (!t.xy.empty())
+        return t;
+    cv::Mat map(t.rect.size(), CV_32FC2);
+    for (int y{ 0 }; y < map.rows; ++y) {
+        cv::Vec2f* m = map.ptr<cv::Vec2f>(y);
+        for (int x{ 0 }; x < map.cols; ++x) {
+            cv::Vec2d p;
+            if (cam_.project(view_.ray(t.rect.x + x, t.rect.y + y), p) && p[0] >= 0 && p[1] >= 0 && p[0] <= imageSize_.width - 1
+                && p[1] <= imageSize_.height - 1)
+                m[x] = cv::Vec2f((float)p[0], (float)p[1]);
+            else
+                m[x] = cv::Vec2f(-1.f, -1.f);
+        }
+    }
+    cv::convertMaps(map, cv::noArray(), t.xy, t.frac, CV_16SC2);
+    ++mapped_;
+    return t;
+}
+
+void TileRectifier::rectify(const cv::Rect& roi, cv::Mat& out)
+{
+    CV_Assert(!frame_.empty());
+    const cv::Rect r{ roi & cv::Rect(cv::Point(), view_.size) };
+    out.create(r.size(), frame_.type());
+    if (r.empty())
+        return;
+    for (int ty{ r.y / tileSize_ }; ty <= (r.y + r.height - 1) / tileSize_; ++ty)
+        for (int tx{ r.x / tileSize_ }; tx <= (r.x + r.width - 1) / tileSize_; ++tx) {
+            Tile& t = mapTile(tx, ty);
+            const cv::Rect part{ t.rect & r };
+            cv::Mat dst{ out(part - r.tl()) };
+            if (!cacheFrame_) { //Only the requested pixels
+                const cv::Rect local{ part - t.rect.tl() };
+                cv::remap(frame_, dst, t.xy(local), t.frac(local), interpolation_, cv::BORDER_CONSTANT);
+                continue;
+            }
+            if (t.frame != frameId_) {
+                cv::remap(frame_, t.pixels, t.xy, t.frac, interpolation_, cv::BORDER_CONSTANT);
+                t.frame = frameId_;
+                ++rectified_;
+            }
+            t.pixels(part - t.rect.tl()).copyTo(dst);
+        }
+}
@@ -0,0 +1,67 @@
+/*
+ * omni_tiles.h
+ * Lazy, tile-based rectification of regions of interest
+ *
+ * When only a few crops of the rectified image are needed (detections,
+ * markers...), building & applying the full map is mostly wasted work.
+ * TileRectifier splits one view (see omni_atlas.h) into square tiles and
+ * builds the gather map of a tile only the first time a region touches it,
+ * keeping it for the next frames. Per frame, only the pixels of the
+ * requested regions are remapped, so only the source areas they see are
+ * read. With cacheFrame, whole tiles are rectified instead & kept until
+ * the next frame, for regions that overlap or are requested repeatedly.
+ *
+ * Not thread safe, one instance per thread.
+ *
+ * Licensed under the MIT License.
+ */
+
+#ifndef OMNI_TILES_H
+#define OMNI_TILES_H
+
+#include "omni_atlas.h"
+#include "omni_refine.h"
+#include "opencv2/core.hpp"
+#include "opencv2/imgproc.hpp"
+#include <vector>
+
+class TileRectifier {
+public:
+    TileRectifier(const OmniIntrinsics& cam, const cv::Size& imageSize, const UnwrapView& view, int tileSize = 64, bool cacheFrame = false,
+        int interpolation = cv::INTER_LINEAR);
+
+    // Next frame (the calibration's size, not copied: must stay valid until the next setFrame)
+    void setFrame(const cv::Mat& frame);
+    // Rectified pixels of roi (view coordinates, clipped to the view)
+    void rectify(const cv::Rect& roi, cv::Mat& out);
+
+    const UnwrapView& view() const { return view_; }
+    int tileSize() const { return tileSize_; }
+    // Tiles whose map has been built so far, maps are kept across frames
+    int mappedTiles() const { return mapped_; }
+    // Tiles rectified whole into the frame cache since the last setFrame, 0 without cacheFrame
+    int rectifiedTiles() const { return rectified_; }
+
+private:
+    struct Tile {
+        cv::Rect rect; //In the view
+        cv::Mat xy, frac; //Fixed point map, empty until first used
+        cv::Mat pixels; //Rectified, with cacheFrame
+        long frame{ -1 }; //Of pixels
+    };
+
+    Tile& mapTile(int tx, int ty);
+
+    OmniIntrinsics cam_;
+    cv::Size imageSize_;
+    UnwrapView view_;
+    int tileSize_, interpolation_;
+    bool cacheFrame_;
+    cv::Size tiles_; //Tile grid
+    std::vector<Tile> tile_;
+    cv::Mat frame_;
+    long frameId_{ -1 };
+    int mapped_{ 0 }, rectified_{ 0 };
+};
+
+#endif
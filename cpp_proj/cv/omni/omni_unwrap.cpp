@@ -0,0 +1,123 @@
+/*
+ * omni_unwrap.cpp
+ * Multi-view unwrapping of fisheye images / video
+ *
+ * Unwraps each frame into several pinhole views (and an optional
+ * longitude / latitude panorama) at once, through one precomputed map
+ * (see omni_atlas.h), and shows / writes them side by side.
+ *
+ * Licensed under the MIT License.
+ */
+
+#include "opencv2/core.hpp"
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+#include "omni_atlas.h"
+#include "omni_source.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define VIEWS "front,left,right" //Defaults, overridden from the command line
+#define FOV 90.0 //deg
+#define VIEW_WIDTH 640
+#define VIEW_HEIGHT 480
+#define PANO_HFOV 180.0 //deg
+#define PANO_VFOV 90.0
+#define OUT_FILE "unwrap.png" //Atlas of a single image input
+
+static int err(const std::string& msg, const int& rval)
+{
+    std::cerr << msg << std::endl;
+    return rval;
+}
+
+// Named directions (yaw, pitch in deg), "cube": all 6 faces at 90 deg
+static bool parseViews(const std::string& spec, double fov, const cv::Size& size, std::vector<UnwrapView>& views)
+{
+    static const struct {
+        const char* name;
+        double yaw, pitch;
+    } dirs[] = { { "front", 0, 0 }, { "left", -90, 0 }, { "right", 90, 0 }, { "back", 180, 0 }, { "up", 0, 90 }, { "down", 0, -90 } };
+    if (spec == "cube") {
+        for (const auto& d : dirs)
+            views.push_back(UnwrapView::perspective(d.name, d.yaw, d.pitch, 90.0, cv::Size(size.width, size.width)));
+        return true;
+    }
+    std::stringstream ss(spec);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        bool known{ false };
+        for (const auto& d : dirs)
+            if (name == d.name) {
+                views.push_back(UnwrapView::perspective(d.name, d.yaw, d.pitch, fov, size));
+                known = true;
+            }
+        if (!known)
+            return false;
+    }
+    return !views.empty();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return err((std::string) "\nUsage: " + argv[0] + "  [CALIBRATION_FILE]  [IMG_OR_VIDEO]  [VIEWS]  [FOV (deg)]  [VIEW_WIDTHxHEIGHT]  [PANORAMA_WIDTH]\n", 1);
+
+    cv::FileStorage fs(argv[1], cv::FileStorage::READ);
+    if (!fs.isOpened())
+        return err("Error reading calibration file...", -1);
+    OmniIntrinsics cam;
+    if (!cam.read(fs) && !cam.read(fs, "_1")) //Mono, else the left camera of a stereo calibration
+        return err("Invalid calibration file!", -1);
+
+    double fov{ FOV };
+    if ((argc > 4 && !parseDouble(argv[4], fov)) || fov <= 0.0 || fov >= 180.0)
+        return err("FOV must be within 0 <-> 180 deg", 1);
+    cv::Size viewSize(VIEW_WIDTH, VIEW_HEIGHT);
+    if (argc > 5 && std::sscanf(argv[5], "%dx%d", &viewSize.width, &viewSize.height) != 2)
+        return err("Invalid view size, expected WIDTHxHEIGHT", 1);
+    std::vector<UnwrapView> views;
+    if (!parseViews(argc > 3 ? argv[3] : VIEWS, fov, viewSize, views))
+        return err("Invalid views, expected cube or a list of front,left,right,back,up,down", 1);
+    int panoWidth{ 0 };
+    if (argc > 6 && (!parseInt(argv[6], panoWidth) || panoWidth < 0))
+        return err("Invalid panorama width, expected 0 (none) or a width in px", 1);
+    if (panoWidth > 0)
+        views.push_back(UnwrapView::longLati("panorama", PANO_HFOV, PANO_VFOV, cv::Size(panoWidth, (int)(panoWidth * PANO_VFOV / PANO_HFOV))));
+
+    cv::Mat frame = cv::imread(argv[2], cv::IMREAD_COLOR);
+    cv::VideoCapture cap;
+    if (frame.empty() && (!cap.open(argv[2]) || !cap.read(frame) || frame.empty()))
+        return err("Could not read img / video...", -1);
+
+    int64 t{ cv::getTickCount() };
+    const UnwrapAtlas atlas(cam, frame.size(), views, views.size() > 4 ? 3 : 0);
+    std::cout << "Map (" << atlas.size().width << "x" << atlas.size().height << ") built in "
+              << (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency() << " ms" << std::endl;
+
+    cv::Mat out;
+    cv::namedWindow("Unwrap", cv::WINDOW_NORMAL);
+    double totalMs{ 0.0 };
+    int frames{ 0 };
+    do {
+        t = cv::getTickCount();
+        atlas.unwrap(frame, out);
+        totalMs += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        ++frames;
+        for (size_t i{ 0 }; i < atlas.views().size(); ++i)
+            cv::putText(out, atlas.views()[i].name, atlas.views()[i].roi.tl() + cv::Point(10, 25), cv::FONT_HERSHEY_SIMPLEX, 0.7, cv::Scalar(0, 255, 0), 2);
+        cv::imshow("Unwrap", out);
+        if ((cv::waitKey(cap.isOpened() ? 1 : 0) & 0xff) == 27)
+            break;
+    } while (cap.isOpened() && cap.read(frame) && !frame.empty());
+
+    std::cout << "Unwrap: " << totalMs / frames << " ms / frame over " << frames << " frame(s)" << std::endl;
+    if (!cap.isOpened() && !cv::imwrite(OUT_FILE, out))
+        return err("Could not write " OUT_FILE, -1);
+    return 0;
+}
@@ -1,25 +1,32 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/cudev/common.hpp>
 
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
-#include <unordered_map>
 
-#include "vilib/cuda_common.h"
-#include "vilib/preprocess/pyramid.h"
-#include "vilib/storage/pyramid_pool.h"
-#include "vilib/feature_detection/fast/fast_gpu.h"
+#include <sys/stat.h>
 
-using namespace vilib;
+#include "detector_session.h"
+#include "keypoint_io.h"
+#include "marker_renderer.h"
+#include "spsc_queue.h"
 
-std::shared_ptr<vilib::DetectorBaseGPU> detector_gpu_;
+using namespace vilib;
 
 // Frame preprocessing
-#define PYRAMID_LEVELS 1
+#define PYRAMID_LEVELS 1 //Default, overridden from the command line
 #define PYRAMID_MIN_LEVEL 0
-#define PYRAMID_MAX_LEVEL PYRAMID_LEVELS
 
 // FAST detector parameters
 #define FAST_EPSILON (30.0f) //Tune this
@@ -33,70 +40,58 @@ std::shared_ptr<vilib::DetectorBaseGPU> detector_gpu_;
 #define VERTICAL_BORDER 0
 #define CELL_SIZE_WIDTH 32
 #define CELL_SIZE_HEIGHT 32
+#define PER_LEVEL_GRID true //CPU backend: every pyramid level gets its own cell grid (budget)
+
+// Threshold control (CPU backend), FAST_EPSILON is the starting point
+#define ADAPTIVE_THRESHOLD false //Adapt the threshold per cell from frame to frame
+#define CELL_TARGET 4.0f //Corners wanted per cell
+#define MAX_KEYPOINTS 0 //Keypoint budget per frame, strongest kept (0: unbounded)
+
+// Batch mode
+#define BATCH_DECODERS 0 //Decoding threads, 0: hardware threads - 2 (at least 1)
+#define BATCH_JOBS_PER_DECODER 2 //Images in flight per decoder
+#define JPEG_QUALITY 95
 
-std::unordered_map<int, int> pts; //Feature points detected
+// Detector backend, selected at runtime
+#ifdef WITH_VILIB
+DetectorBackend backend{ DetectorBackend::GPU };
+#else
+DetectorBackend backend{ DetectorBackend::CPU };
+#endif
+std::unique_ptr<DetectorSession> session; //Kept for the whole run
+
+KeypointBuffer pts; //Feature points detected, capacity kept across frames
 
 // === FEATURE DETECTOR ===
 
-//FASt corner detector fx, return all the points detected
-std::unordered_map<int, int> fDetector(cv::Mat img)
+//Detector parameters from the defines above, searching all the pyramid levels
+DetectorParams detectorParams(int levels)
 {
-    //For pyramid storage
-    int image_width_ = img.cols;
-    int image_height_ = img.rows;
-
-    //std::cout << "Detector (GPU) reset" << std::endl;
-    detector_gpu_.reset(new FASTGPU(image_width_,
-        image_height_,
-        CELL_SIZE_WIDTH,
-        CELL_SIZE_HEIGHT,
-        PYRAMID_MIN_LEVEL,
-        PYRAMID_MAX_LEVEL,
-        HORIZONTAL_BORDER,
-        VERTICAL_BORDER,
-        FAST_EPSILON,
-        FAST_MIN_ARC_LENGTH,
-        FAST_SCORE));
-
-    // Initialize the pyramid pool
-    PyramidPool::init(1,
-        image_width_,
-        image_height_,
-        1, // grayscale
-        PYRAMID_LEVELS,
-        IMAGE_PYRAMID_MEMORY_TYPE);
-
-    // Create a Frame (image upload, pyramid)
-    std::shared_ptr<Frame> frame0(new Frame(img, 0, PYRAMID_LEVELS));
-    // Reset detector's grid
-    // Note: this step could be actually avoided with custom processing
-    detector_gpu_->reset();
-    // Do the detection
-    detector_gpu_->detect(frame0->pyramid_);
-
-    // Display results
-    auto& points_gpu = detector_gpu_->getPoints();
-    auto& points_gpu_grid = detector_gpu_->getGrid();
-
-    std::unordered_map<int, int> points_combined;
-    points_combined.reserve(points_gpu.size());
-
-    int qqq = 0; //Index tracker
-    for (auto it = points_gpu.begin(); it != points_gpu.end(); ++it) {
-        int key = ((int)it->x_) | (((int)it->y_) << 16);
-
-        if (key) {
-            //std::cout << "#" << qqq << " , key: " << key << std::endl;
-            points_combined.emplace(key, 3);
-        }
-        else {
-            points_combined.emplace(key, 1);
-        }
-        qqq++;
-    }
-    std::cout << "All points: " << points_gpu.size() << ", Valid points: " << points_combined.size() << ", Epsilon: " << FAST_EPSILON << std::endl;
+    DetectorParams p;
+    p.pyramid_levels = levels;
+    p.min_level = PYRAMID_MIN_LEVEL;
+    p.max_level = levels;
+    p.threshold = FAST_EPSILON;
+    p.min_arc_length = FAST_MIN_ARC_LENGTH;
+    p.score = FAST_SCORE;
+    p.horizontal_border = HORIZONTAL_BORDER;
+    p.vertical_border = VERTICAL_BORDER;
+    p.cell_size_width = CELL_SIZE_WIDTH;
+    p.cell_size_height = CELL_SIZE_HEIGHT;
+    p.per_level_grid = PER_LEVEL_GRID;
+    p.adaptive_threshold = ADAPTIVE_THRESHOLD;
+    p.cell_target = CELL_TARGET;
+    p.max_keypoints = MAX_KEYPOINTS;
+    return p;
+}
 
-    return points_combined;
+//FASt corner detector fx, fill kps with all the points detected
+void fDetector(const cv::Mat& img, KeypointBuffer& kps)
+{
+    //Detector state is only (re)built on the first frame / when the size changes
+    session->detect(img, kps);
+    const ThresholdStats& eps = session->thresholdStats();
+    std::cout << "Valid points: " << kps.size() << ", Epsilon: " << eps.mean << " [" << eps.min << ", " << eps.max << "] (" << DetectorSession::name(backend) << ")" << std::endl;
 }
 
 // === GRAPHICS ===
@@ -109,37 +104,19 @@ cv::Mat drawText(cv::Mat img, int x, int y, std::string msg)
     return img;
 }
 
-//Draw circle
-cv::Mat dCircle(cv::Mat img, int x, int y)
-{
-    int thickness = 1;
-    cv::circle(img,
-        cv::Point(x, y),
-        1 * 3 * 1024,
-        cv::Scalar(0, 255, 255),
-        thickness,
-        8,
-        10);
-    return img;
-}
+//Marker sprites, built once. Radius grows with the pyramid level the corner was found on
+MarkerRenderer markers;
 
 //Draw text & detected features on img
-cv::Mat processImg(cv::Mat img, std::unordered_map<int, int> pts)
+cv::Mat processImg(cv::Mat img, const KeypointView& pts)
 {
-    // draw circles for the identified keypoints
-    for (auto it = pts.begin(); it != pts.end(); ++it) {
-        int x = (it->first & 0xFFFF) * 1024;
-        int y = ((it->first >> 16) & 0xFFFF) * 1024;
-        //std::cout << "x: " << x << " , y: " << y << std::endl;
-        cv::Scalar color; // B,G,R
-        int thickness = 1;
-        if (it->second == 3) {
-            img = dCircle(img, x, y);
-        }
-    }
+    // stamp a marker at every identified keypoint, in one pass
+    for (size_t i = 0; i < pts.size; ++i)
+        markers.add(pts.x[i], pts.y[i], markers.style(3 << pts.level[i], cv::Scalar(0, 255, 255)));
+    markers.render(img);
 
     //Draw text on img
-    std::string tPoints = "Corners: " + std::to_string(pts.size());
+    std::string tPoints = "Corners: " + std::to_string(pts.size);
     img = drawText(img, 30, 30, tPoints);
 
     return img;
@@ -151,28 +128,327 @@ cv::Mat runProcess(cv::Mat img)
     cv::Mat gImg;
     cvtColor(img, gImg, cv::COLOR_BGR2GRAY); //Convert to grayscale for detector
 
-    pts = fDetector(gImg); //Feature detector (FAST) with grayscale img
-    img = processImg(img, pts); //Draw the feature point(s)on the img/vid
+    fDetector(gImg, pts); //Feature detector (FAST) with grayscale img
+    img = processImg(img, pts.view()); //Draw the feature point(s)on the img/vid
 
     // showIMG(displayIMG(imgL,pts,fps));
 
-    // Deinitialize the pyramid pool (for consecutive frames)
-    PyramidPool::deinit();
     std::cout << "===" << std::endl;
     return img;
 }
 
+// === BATCH ===
+// Headless: images are decoded in parallel (decoder d takes images d, d + D, ...),
+// detected in order with the same session in the main thread, then the
+// keypoints (& optionally the annotated JPEG) are written by a writer thread.
+// Each decoder has its own job pool, recycled by the writer.
+
+typedef std::chrono::steady_clock Clock;
+
+struct BatchJob {
+    size_t index;
+    int decoder;
+    std::string path;
+    cv::Mat color; //Only decoded when rendering
+    cv::Mat gray;
+    KeypointBuffer kps;
+};
+typedef SpscQueue<BatchJob*> BatchQueue;
+
+bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool isDir(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+//File name without directory & extension
+std::string stem(const std::string& path)
+{
+    const size_t slash{ path.find_last_of('/') };
+    std::string name{ slash == std::string::npos ? path : path.substr(slash + 1) };
+    const size_t dot{ name.find_last_of('.') };
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+//Image paths from a directory, an XML/YAML image list (as for the omni tools) or a text file (1 path per line)
+bool listImages(const std::string& input, std::vector<std::string>& paths)
+{
+    paths.clear();
+    if (isDir(input)) {
+        std::vector<cv::String> files;
+        cv::glob(input + "/*", files, false); //Sorted
+        const char* exts[] = { ".jpg", ".jpeg", ".png", ".bmp", ".pgm", ".ppm", ".tif", ".tiff" };
+        for (size_t i{ 0 }; i < files.size(); ++i) {
+            std::string lower{ files[i] };
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            for (size_t e{ 0 }; e < sizeof(exts) / sizeof(exts[0]); ++e)
+                if (endsWith(lower, exts[e])) {
+                    paths.push_back(files[i]);
+                    break;
+                }
+        }
+        return true;
+    }
+    if (endsWith(input, ".xml") || endsWith(input, ".yml") || endsWith(input, ".yaml")) {
+        cv::FileStorage fs(input, cv::FileStorage::READ);
+        if (!fs.isOpened())
+            return false;
+        cv::FileNode n = fs.getFirstTopLevelNode();
+        if (n.type() != cv::FileNode::SEQ)
+            return false;
+        for (cv::FileNodeIterator it = n.begin(); it != n.end(); ++it)
+            paths.push_back((std::string)*it);
+        return true;
+    }
+    std::ifstream in(input.c_str());
+    if (!in)
+        return false;
+    std::string line;
+    while (std::getline(in, line))
+        if (!line.empty() && line[0] != '#')
+            paths.push_back(line);
+    return true;
+}
+
+//Output names: the stem of each image, prefixed with its index where stems collide (a.png & a.jpg, x/img.png & y/img.png).
+//False if 2 names are still equal
+bool outputNames(const std::vector<std::string>& paths, std::vector<std::string>& names)
+{
+    names.resize(paths.size());
+    std::map<std::string, int> count;
+    for (size_t i{ 0 }; i < paths.size(); ++i)
+        ++count[stem(paths[i])];
+    for (size_t i{ 0 }; i < paths.size(); ++i) {
+        const std::string s{ stem(paths[i]) };
+        names[i] = count[s] > 1 ? std::to_string(i) + "_" + s : s;
+    }
+    std::vector<std::string> sorted(names);
+    std::sort(sorted.begin(), sorted.end());
+    return std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+}
+
+// format: "bin" or "json", render: also write the annotated JPEG
+int runBatch(const std::string& input, const std::string& outDir, const std::string& format, bool render)
+{
+    std::vector<std::string> paths;
+    if (!listImages(input, paths) || paths.empty()) {
+        std::cerr << "No images found in " << input << std::endl;
+        return 1;
+    }
+    std::vector<std::string> names;
+    if (!outputNames(paths, names)) {
+        std::cerr << "Input images give duplicate output names" << std::endl;
+        return 1;
+    }
+    if (!isDir(outDir) && mkdir(outDir.c_str(), 0755) != 0) {
+        std::cerr << "Could not create " << outDir << std::endl;
+        return 1;
+    }
+    const bool json{ format == "json" };
+
+    int decoders{ BATCH_DECODERS };
+    if (decoders <= 0)
+        decoders = std::max(1, (int)std::thread::hardware_concurrency() - 2);
+    decoders = std::min<int>(decoders, (int)paths.size());
+    std::cout << "Batch: " << paths.size() << " images, " << decoders << " decoders, output: " << outDir << " (" << (json ? "json" : "bin") << (render ? " + jpg" : "") << ")" << std::endl;
+
+    // Per decoder queues & job pools
+    std::vector<std::unique_ptr<BatchQueue> > qFree, qDecoded;
+    std::vector<std::unique_ptr<BatchJob> > pool;
+    for (int d{ 0 }; d < decoders; ++d) {
+        qFree.emplace_back(new BatchQueue(BATCH_JOBS_PER_DECODER));
+        qDecoded.emplace_back(new BatchQueue(BATCH_JOBS_PER_DECODER));
+        for (int j{ 0 }; j < BATCH_JOBS_PER_DECODER; ++j) {
+            pool.emplace_back(new BatchJob());
+            pool.back()->decoder = d;
+            qFree[d]->push(pool.back().get());
+        }
+    }
+    BatchQueue qWrite(decoders * BATCH_JOBS_PER_DECODER);
+
+    std::vector<std::thread> tDecode;
+    for (int d{ 0 }; d < decoders; ++d) {
+        tDecode.emplace_back([&, d]() {
+            BatchJob* job;
+            for (size_t i = d; i < paths.size() && qFree[d]->pop(job); i += decoders) {
+                job->index = i;
+                job->path = paths[i];
+                if (render) {
+                    job->color = cv::imread(paths[i], cv::IMREAD_COLOR);
+                    if (!job->color.empty())
+                        cvtColor(job->color, job->gray, cv::COLOR_BGR2GRAY);
+                    else
+                        job->gray.release();
+                }
+                else
+                    job->gray = cv::imread(paths[i], cv::IMREAD_GRAYSCALE);
+                if (!qDecoded[d]->push(job))
+                    break;
+            }
+            qDecoded[d]->close();
+        });
+    }
+
+    size_t written{ 0 }, failed{ 0 }, total{ 0 };
+    std::thread tWrite([&]() {
+        std::vector<int> jpeg;
+        jpeg.push_back(cv::IMWRITE_JPEG_QUALITY);
+        jpeg.push_back(JPEG_QUALITY);
+        BatchJob* job;
+        while (qWrite.pop(job)) {
+            if (job->gray.empty()) {
+                std::cerr << "Could not read " << job->path << std::endl;
+                ++failed;
+            }
+            else {
+                const std::string base{ outDir + "/" + names[job->index] };
+                const bool ok{ json ? writeKeypointsJson(base + ".json", job->kps.view(), job->gray.size(), job->path)
+                                    : writeKeypointsBinary(base + ".kps", job->kps.view(), job->gray.size()) };
+                if (ok && render)
+                    cv::imwrite(base + ".jpg", processImg(job->color, job->kps.view()), jpeg);
+                if (ok)
+                    ++written;
+                else {
+                    std::cerr << "Could not write " << base << std::endl;
+                    ++failed;
+                }
+            }
+            qFree[job->decoder]->push(job); //Recycle
+        }
+    });
+
+    // Detect in input order
+    auto t0 = Clock::now();
+    double detectMs{ 0.0 };
+    for (size_t i{ 0 }; i < paths.size(); ++i) {
+        BatchJob* job;
+        if (!qDecoded[i % decoders]->pop(job))
+            break;
+        if (!job->gray.empty()) {
+            auto td = Clock::now();
+            session->detect(job->gray, job->kps);
+            detectMs += std::chrono::duration<double, std::milli>(Clock::now() - td).count();
+            total += job->kps.size();
+        }
+        else
+            job->kps.clear();
+        qWrite.push(job);
+    }
+    qWrite.close();
+    tWrite.join();
+    for (int d{ 0 }; d < decoders; ++d)
+        qFree[d]->close();
+    for (size_t d{ 0 }; d < tDecode.size(); ++d)
+        tDecode[d].join();
+
+    const double sec{ std::max(1e-6, std::chrono::duration<double>(Clock::now() - t0).count()) };
+    const size_t done{ std::max<size_t>(1, written) };
+    std::cout << "Images: " << written << " written, " << failed << " failed, " << (int)(written / sec) << " img/s\n"
+              << "Keypoints: " << total << " (" << total / done << " per image)\n"
+              << "Detect: " << detectMs / done << " ms per image (" << DetectorSession::name(backend) << ", " << session->rebuilds() << " rebuild(s))" << std::endl;
+    return failed ? 2 : 0;
+}
+
 cv::Mat mImg; //Main img
 
 std::string wTitle{ "Img" };
 
+//Backend from its name, false if unsupported
+bool parseBackend(const std::string& b)
+{
+    if (b == "cpu")
+        backend = DetectorBackend::CPU;
+#ifdef WITH_VILIB
+    else if (b == "gpu")
+        backend = DetectorBackend::GPU;
+#endif
+    else {
+        std::cerr << "Unsupported backend: " << b << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char** argv)
 {
 
+    if (argc < 2) {
+        std::cerr << "\nUsage: " << argv[0] << "  [IMG]  [BACKEND (gpu|cpu)]  [PYRAMID_LEVELS (1)]\n"
+                  << "       " << argv[0] << "  --batch  [DIR|IMG_LIST]  [OUT_DIR]  [FORMAT (bin|json)]  [RENDER (0|1)]  [BACKEND (gpu|cpu)]  [PYRAMID_LEVELS (1)]\n"
+                  << "       " << argv[0] << "  --show  [KPS_FILE]  [IMG]\n" << std::endl;
+        return 1;
+    }
+
+    // Keypoint file over its image, e.g. $ ./vfast_img --show out/a.kps imgs/a.png
+    if (std::string(argv[1]) == "--show") {
+        if (argc < 4) {
+            std::cerr << "\nUsage: " << argv[0] << "  --show  [KPS_FILE]  [IMG]\n" << std::endl;
+            return 1;
+        }
+        KeypointBuffer kps;
+        cv::Size size;
+        if (!readKeypointsBinary(argv[2], kps, size)) {
+            std::cerr << "Could not read keypoints from " << argv[2] << std::endl;
+            return -1;
+        }
+        mImg = imread(argv[3], cv::IMREAD_COLOR);
+        if (mImg.empty() || mImg.size() != size) {
+            std::cerr << "Could not read img, or its size differs from the keypoint file (" << size.width << "x" << size.height << ")" << std::endl;
+            return -1;
+        }
+        cv::imshow(wTitle, processImg(mImg, kps.view()));
+        cv::waitKey(0);
+        return 0;
+    }
+
+    // Batch mode, e.g. $ ./vfast_img --batch imgs/ out/ json 0 cpu 2
+    if (std::string(argv[1]) == "--batch") {
+        if (argc < 4) {
+            std::cerr << "\nUsage: " << argv[0] << "  --batch  [DIR|IMG_LIST]  [OUT_DIR]  [FORMAT (bin|json)]  [RENDER (0|1)]  [BACKEND (gpu|cpu)]  [PYRAMID_LEVELS (1)]\n" << std::endl;
+            return 1;
+        }
+        const std::string format{ argc > 4 ? argv[4] : "bin" };
+        if (format != "bin" && format != "json") {
+            std::cerr << "Unsupported format: " << format << std::endl;
+            return 1;
+        }
+        const bool render{ argc > 5 && atoi(argv[5]) != 0 };
+        if (argc > 6 && !parseBackend(argv[6]))
+            return 1;
+        const int levels{ argc > 7 ? atoi(argv[7]) : PYRAMID_LEVELS };
+        if (levels < 1) {
+            std::cerr << "PYRAMID_LEVELS must be >= 1" << std::endl;
+            return 1;
+        }
+        session.reset(new DetectorSession(backend, detectorParams(levels)));
+        const int ret{ runBatch(argv[2], argv[3], format, render) };
+        session.reset();
+        return ret;
+    }
+
+    if (argc > 2 && !parseBackend(argv[2]))
+        return 1;
+    const int levels{ argc > 3 ? atoi(argv[3]) : PYRAMID_LEVELS };
+    if (levels < 1) {
+        std::cerr << "PYRAMID_LEVELS must be >= 1" << std::endl;
+        return 1;
+    }
+
     //mImg = imread("a.jpg", IMREAD_COLOR);
     mImg = imread(argv[1], cv::IMREAD_COLOR); //Enter image path, e.g. $ ./vfast_img a.jpg
+    if (mImg.empty()) {
+        std::cerr << "Could not read img..." << std::endl;
+        return -1;
+    }
 
+    session.reset(new DetectorSession(backend, detectorParams(levels)));
     mImg = runProcess(mImg);
+    session.reset(); //Release the detector (& vilib's pyramid pool)
     cv::namedWindow(wTitle, cv::WINDOW_AUTOSIZE);
     cv::imshow(wTitle, mImg);
     cv::waitKey(0);
@@ -1,36 +1,29 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/cudev/common.hpp>
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <memory>
-#include <unordered_map>
+#include <string>
 
+#include <atomic>
+#include <chrono>
 #include <thread>
-#include <future>
-#include <mutex>
-
-#include "vilib/cuda_common.h"
-#include "vilib/preprocess/pyramid.h"
-#include "vilib/storage/pyramid_pool.h"
-#include "vilib/feature_detection/fast/fast_gpu.h"
-#include "vilib/feature_detection/detector_base.h"
-#include "vilib/feature_detection/detector_base_gpu.h"
-#include "vilib/config.h"
-#include "vilib/timer.h"
-#include "vilib/statistics.h"
+
+#include "detector_session.h"
+#include "klt_tracker.h"
+#include "marker_renderer.h"
+#include "spsc_queue.h"
 
 using namespace cv;
 using namespace vilib;
 
-std::shared_ptr<vilib::DetectorBaseGPU> detector_gpu_;
-
 // Frame preprocessing
-#define PYRAMID_LEVELS 1
+#define PYRAMID_LEVELS 1 //Default, overridden from the command line
 #define PYRAMID_MIN_LEVEL 0
-#define PYRAMID_MAX_LEVEL PYRAMID_LEVELS
 
 // FAST detector parameters
 #define FAST_EPSILON (10.0f)
@@ -44,88 +37,102 @@ std::shared_ptr<vilib::DetectorBaseGPU> detector_gpu_;
 #define VERTICAL_BORDER 0
 #define CELL_SIZE_WIDTH 32
 #define CELL_SIZE_HEIGHT 32
-
-Mat imgL; // Colored Feed
-Mat imgGray; // Grayscale version
-int capr{ 0 }; //VidCapture
-bool startP{ false };
-bool vidEnd{ false };
-std::unordered_map<int, int> pts; //Feature points detected
-
-//Threading
-std::mutex m; //you can use std::lock_guard if you want to be exception safe
-
-// Track time
-long frameCounter{ 0 };
-long fps{ 0 };
-std::time_t timeBegin{ std::time(0) };
-int tick{ 0 };
+#define PER_LEVEL_GRID true //CPU backend: every pyramid level gets its own cell grid (budget)
+
+// Threshold control (CPU backend), FAST_EPSILON is the starting point
+#define ADAPTIVE_THRESHOLD true //Adapt the threshold per cell from frame to frame
+#define CELL_TARGET 4.0f //Corners wanted per cell
+#define MAX_KEYPOINTS 600 //Keypoint budget per frame, strongest kept (0: unbounded)
+
+// Tracking mode: KLT tracks, FAST only in the cells short of tracks
+#define KLT_MIN_TRACKS_PER_CELL 1 //Cells below are redetected
+#define KLT_MAX_TRACKS_PER_CELL 3
+#define KLT_MATURE_AGE 10 //Frames until a track is drawn as mature
+
+// Detector backend, selected at runtime
+#ifdef WITH_VILIB
+DetectorBackend backend{ DetectorBackend::GPU };
+#else
+DetectorBackend backend{ DetectorBackend::CPU };
+#endif
+std::unique_ptr<DetectorSession> session; //Kept for the whole run
+bool trackMode{ false };
+std::unique_ptr<KltTracker> tracker; //Tracking mode only
+
+// Pipeline: decode -> convert -> detect -> annotate -> display
+// Every stage runs in its own thread (display in main), joined by bounded
+// SPSC queues. Frames are recycled from display back to decode, so all
+// buffers (incl. the keypoints) are reused.
+#define POOL_SIZE 6 //Frames in flight
+#define QUEUE_SIZE 2
+
+typedef std::chrono::steady_clock Clock;
+
+struct FrameJob {
+    long id;
+    Mat yuv; // I420 from the decoder
+    Mat gray; // Header of the Y plane, no copy
+    Mat bgr; // Colored, annotated in place
+    KeypointBuffer kps; //Feature points detected
+    ThresholdStats eps; //Detector thresholds after this frame
+    // Tracking mode, parallel to kps
+    std::vector<long> ids;
+    std::vector<int> ages;
+    KltStats klt;
+};
+typedef SpscQueue<FrameJob*> JobQueue;
+
+// Per stage throughput
+struct Stage {
+    explicit Stage(const char* n) : name(n), frames(0), busyUs(0) {}
+    const char* name;
+    std::atomic<long> frames;
+    std::atomic<long long> busyUs;
+};
+
+Stage stDecode{ "decode" }, stConvert{ "convert" }, stDetect{ "detect" }, stAnnotate{ "annotate" }, stDisplay{ "display" };
+JobQueue qFree{ POOL_SIZE }, qDecoded{ QUEUE_SIZE }, qConverted{ QUEUE_SIZE }, qDetected{ QUEUE_SIZE }, qAnnotated{ QUEUE_SIZE };
+
+std::atomic<long> fps{ 0 }; //Displayed frames per second
 
 // === FEATURE DETECTOR ===
 
-//FASt corner detector fx, return all the points detected
-std::unordered_map<int, int> fDetector(Mat img)
+//Detector parameters from the defines above, searching all the pyramid levels
+DetectorParams detectorParams(int levels)
 {
-    //For pyramid storage
-    int image_width_ = img.cols;
-    int image_height_ = img.rows;
-
-    //std::cout << "Detector (GPU) reset" << std::endl;
-    detector_gpu_.reset(new FASTGPU(image_width_,
-        image_height_,
-        CELL_SIZE_WIDTH,
-        CELL_SIZE_HEIGHT,
-        PYRAMID_MIN_LEVEL,
-        PYRAMID_MAX_LEVEL,
-        HORIZONTAL_BORDER,
-        VERTICAL_BORDER,
-        FAST_EPSILON,
-        FAST_MIN_ARC_LENGTH,
-        FAST_SCORE));
-
-    // Initialize the pyramid pool
-    PyramidPool::init(1,
-        image_width_,
-        image_height_,
-        1, // grayscale
-        PYRAMID_LEVELS,
-        IMAGE_PYRAMID_MEMORY_TYPE);
-
-    // Create a Frame (image upload, pyramid)
-    std::shared_ptr<Frame> frame0(new Frame(img, 0, PYRAMID_LEVELS));
-    // Reset detector's grid
-    // Note: this step could be actually avoided with custom processing
-    detector_gpu_->reset();
-    // Do the detection
-    detector_gpu_->detect(frame0->pyramid_);
-
-    // Display results
-    //std::cout << "Display" << std::endl;
-
-    auto& points_gpu = detector_gpu_->getPoints();
-    auto& points_gpu_grid = detector_gpu_->getGrid();
-
-    std::unordered_map<int, int> points_combined;
-    points_combined.reserve(points_gpu.size());
-
-    int qqq = 0;
-    for (auto it = points_gpu.begin(); it != points_gpu.end(); ++it) {
-        int key = ((int)it->x_) | (((int)it->y_) << 16);
-
-        if (key) {
-            //std::cout << "#" << qqq << " , key: " << key << std::endl;
-            points_combined.emplace(key, 3);
-        }
-        else {
-            points_combined.emplace(key, 1);
-        }
-        qqq++;
-    }
+    DetectorParams p;
+    p.pyramid_levels = levels;
+    p.min_level = PYRAMID_MIN_LEVEL;
+    p.max_level = levels;
+    p.threshold = FAST_EPSILON;
+    p.min_arc_length = FAST_MIN_ARC_LENGTH;
+    p.score = FAST_SCORE;
+    p.horizontal_border = HORIZONTAL_BORDER;
+    p.vertical_border = VERTICAL_BORDER;
+    p.cell_size_width = CELL_SIZE_WIDTH;
+    p.cell_size_height = CELL_SIZE_HEIGHT;
+    p.per_level_grid = PER_LEVEL_GRID;
+    p.adaptive_threshold = ADAPTIVE_THRESHOLD;
+    p.cell_target = CELL_TARGET;
+    p.max_keypoints = MAX_KEYPOINTS;
+    return p;
+}
 
-    //std::cout<<"All points: "<<points_gpu.size()<<std::endl;
-    // std::cout<<"Interest points: "<<points_combined.size()<<std::endl;
+//FASt corner detector fx, fill kps with all the points detected
+void fDetector(const Mat& img, KeypointBuffer& kps)
+{
+    //Detector state is only (re)built on the first frame / when the size changes
+    session->detect(img, kps);
+}
 
-    return points_combined;
+//Track the previous keypoints into img & redetect where tracks are missing
+void fTracker(const Mat& img, FrameJob& job)
+{
+    tracker->process(img, *session);
+    job.kps = tracker->keypoints(); //Copies into the job's buffers, capacity kept
+    job.ids = tracker->ids();
+    job.ages = tracker->ages();
+    job.klt = tracker->stats();
 }
 
 // === GRAPHICS ===
@@ -138,122 +145,157 @@ Mat drawText(Mat img, int x, int y, std::string msg)
     return img;
 }
 
-//Draw circle
-Mat dCircle(Mat img, int x, int y)
-{
-    int thickness = 1;
-    cv::circle(img,
-        cv::Point(x, y),
-        1 * 3 * 1024,
-        cv::Scalar(0, 255, 255),
-        thickness,
-        8,
-        10);
-    return img;
-}
-
+//Marker sprites, built once. Radius grows with the pyramid level the corner was found on
+MarkerRenderer markers; //Only used by the annotate stage
 
-//Draw text & detected features on img
-Mat processImg(Mat img, std::unordered_map<int, int> pts, int fps)
+//Draw text & detected features on img, ages: track ages (tracking mode) or nullptr
+Mat processImg(Mat img, const KeypointView& pts, int fps, const ThresholdStats& eps, const int* ages)
 {
 
-    // draw circles for the identified keypoints
-    for (auto it = pts.begin(); it != pts.end(); ++it) {
-        int x = (it->first & 0xFFFF) * 1024;
-        int y = ((it->first >> 16) & 0xFFFF) * 1024;
-        //std::cout << "x: " << x << " , y: " << y << std::endl;
-        cv::Scalar color; // B,G,R
-        int thickness = 1;
-        if (it->second == 3) {
-            img = dCircle(img, x, y);
-        }
+    // stamp a marker at every identified keypoint in one pass, tracks fade from yellow (new) to green (mature)
+    for (size_t i = 0; i < pts.size; ++i) {
+        int red = ages ? 255 - 255 * std::min(ages[i], KLT_MATURE_AGE) / KLT_MATURE_AGE : 255;
+        markers.add(pts.x[i], pts.y[i], markers.style(3 << pts.level[i], cv::Scalar(0, 255, red)));
     }
+    markers.render(img);
 
     //Draw text on img
-    std::string tPoints = "Corners: " + std::to_string(pts.size());
+    std::string tPoints = (ages ? "Tracks: " : "Corners: ") + std::to_string(pts.size);
     img = drawText(img, 30, 30, tPoints);
 
     // Display fps
     std::string t_fps = "FPS: " + std::to_string(fps);
     img = drawText(img, 30, 50, t_fps);
 
-	std::cout << tPoints <<", " <<t_fps<< "\t=== ";	//Detector, then display threads running
+    // Display the FAST thresholds (mean [min, max])
+    std::string t_eps = "Eps: " + std::to_string(cvRound(eps.mean)) + " [" + std::to_string(cvRound(eps.min)) + ", " + std::to_string(cvRound(eps.max)) + "]";
+    img = drawText(img, 30, 70, t_eps);
 
     return img;
 }
 
 // === THREADS ===
 
-// Main detector thread (MDT)
-void runProcess(VideoCapture capL)
+// Pop from in, process, push to out; stops when in is closed & drained,
+// when out is closed, or when fx fails. Closing out cascades the shutdown.
+template <typename Fx>
+void runStage(Stage& st, JobQueue& in, JobQueue& out, Fx fx)
 {
-    while (true&&!vidEnd) {
-        startP = false; //Wait for image to be process
-        m.lock(); //Lock imgL from other thread access
-
-        capr = capL.read(imgL); //Get video frame
-        imgGray = imgL.clone();
-        if (!capr) {
-            std::cout << "Capture read error" << std::endl;
-            vidEnd = true;
+    FrameJob* job;
+    while (in.pop(job)) {
+        auto t0 = Clock::now();
+        if (!fx(*job))
+            break;
+        st.busyUs += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        ++st.frames;
+        if (!out.push(job))
             break;
-        }
-
-        cvtColor(imgGray, imgGray, COLOR_YUV2GRAY_I420); //Convert to grayscale for detector
-        cvtColor(imgL, imgL, COLOR_YUV2BGR_I420); //Convert to BGR to display later
-
-        pts = fDetector(imgGray); //Feature detector (FAST)
-        imgL = processImg(imgL, pts, fps); //Draw the feature point(s)on the img/vid
-
-        std::cout << "MDT ";	//Detector
-        // showIMG(displayIMG(imgL,pts,fps));
-
-        startP = true;
-        m.unlock(); //Release var lock
-
-        // FPS
-        frameCounter++;
-        std::time_t timeNow = std::time(0) - timeBegin;
-        if (timeNow - tick >= 1) {
-            tick++;
-            fps = frameCounter;
-            // std::cout << "Frames per second: " << frameCounter << std::endl;
-            frameCounter = 0;
-        }
-
-        // Deinitialize the pyramid pool (for consecutive frames)
-        PyramidPool::deinit();
-        std::cout << "==="<< std::endl;
     }
+    out.close();
+}
 
-    //When video has ended
-    capL.release();
-    destroyAllWindows();
+// Stop every stage, blocked ones are woken up
+void closeAll()
+{
+    qFree.close();
+    qDecoded.close();
+    qConverted.close();
+    qDetected.close();
+    qAnnotated.close();
+}
 
+// Once per second: throughput, busy ratio & input queue depth of every stage, detector thresholds
+void printStats(double dt, const ThresholdStats& eps)
+{
+    static long last[5] = {};
+    static long long lastBusy[5] = {};
+    Stage* st[5] = { &stDecode, &stConvert, &stDetect, &stAnnotate, &stDisplay };
+    JobQueue* q[5] = { &qFree, &qDecoded, &qConverted, &qDetected, &qAnnotated };
+    for (int i{ 0 }; i < 5; ++i) {
+        long f{ st[i]->frames };
+        long long b{ st[i]->busyUs };
+        std::cout << st[i]->name << ": " << (int)((f - last[i]) / dt) << " FPS, "
+                  << (int)((b - lastBusy[i]) / (dt * 1e4)) << "% busy, q " << q[i]->size() << "/" << q[i]->capacity() << "\t";
+        last[i] = f;
+        lastBusy[i] = b;
+    }
+    std::cout << "eps: " << eps.mean << " [" << eps.min << ", " << eps.max << "] bias " << eps.bias
+              << ", cells +" << eps.raised << "/-" << eps.lowered << std::endl;
 }
 
-// Display thread (DSP)
+// Display (DSP), runs in the main thread for HighGUI
 void showIMG()
 {
     std::cout << "Starting loop..." << std::endl;
-    while (1) {
-        if (startP) {
-            std::cout << "DSP ";
-            namedWindow("Feature detection", WINDOW_NORMAL);
-            cv::imshow("Feature detection", imgL);
-
-            // ESC to escape
-            int keycode = waitKey(30) & 0xff;
-            if (keycode == 27){
-                break;
-}
+    namedWindow("Feature detection", WINDOW_NORMAL);
+
+    long lastFrames{ 0 };
+    auto tick = Clock::now();
+    FrameJob* job;
+    while (qAnnotated.pop(job)) {
+        auto t0 = Clock::now();
+        cv::imshow("Feature detection", job->bgr);
+        int keycode = waitKey(1) & 0xff;
+        stDisplay.busyUs += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t0).count();
+        ++stDisplay.frames;
+        const ThresholdStats eps = job->eps;
+        qFree.push(job); //Recycle
+
+        // FPS
+        double dt = std::chrono::duration<double>(Clock::now() - tick).count();
+        if (dt >= 1.0) {
+            fps = (long)((stDisplay.frames - lastFrames) / dt);
+            lastFrames = stDisplay.frames;
+            tick = Clock::now();
+            printStats(dt, eps);
         }
+
+        // ESC to escape
+        if (keycode == 27)
+            break;
     }
-vidEnd=true;
+    closeAll();
 }
 
 int main(int argc, char** argv)
 {
+    // Optional detector backend, pyramid levels & mode, e.g. $ ./vfast_vid cpu 3 track
+    const std::string usage{ std::string("\nUsage: ") + argv[0] + "  [BACKEND (gpu|cpu)]  [PYRAMID_LEVELS (1)]  [MODE (detect|track)]\n" };
+    if (argc > 1) {
+        std::string b{ argv[1] };
+        if (b == "cpu")
+            backend = DetectorBackend::CPU;
+#ifdef WITH_VILIB
+        else if (b == "gpu")
+            backend = DetectorBackend::GPU;
+#endif
+        else {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+    }
+    const int levels{ argc > 2 ? atoi(argv[2]) : PYRAMID_LEVELS };
+    if (levels < 1) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+    if (argc > 3) {
+        std::string m{ argv[3] };
+        if (m != "detect" && m != "track") {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+        trackMode = m == "track";
+    }
+    std::cout << "Detector: " << (backend == DetectorBackend::CPU ? std::string("CPU (") + FastCPU::simd() + ")" : std::string("GPU")) << ", pyramid levels: " << levels << ", mode: " << (trackMode ? "track" : "detect") << std::endl;
+    session.reset(new DetectorSession(backend, detectorParams(levels)));
+    if (trackMode) {
+        KltParams kp;
+        kp.min_tracks_per_cell = KLT_MIN_TRACKS_PER_CELL;
+        kp.max_tracks_per_cell = KLT_MAX_TRACKS_PER_CELL;
+        tracker.reset(new KltTracker(kp));
+    }
+
     //Read video file (Finds for "a.mp4" in current directory)
     VideoCapture capL("filesrc location=a.mp4 ! qtdemux name=demux.video_0 ! queue ! h264parse ! omxh264dec ! nvvidconv ! video/x-raw, format=(string)I420 ! appsink", CAP_GSTREAMER);
 
@@ -262,11 +304,63 @@ int main(int argc, char** argv)
         return (-1);
     }
 
+    //Frame pool, all in the free queue to start with
+    std::vector<std::unique_ptr<FrameJob> > pool;
+    for (int i{ 0 }; i < POOL_SIZE; ++i) {
+        pool.emplace_back(new FrameJob());
+        qFree.push(pool.back().get());
+    }
+
     //Start Threads
-    auto t1 = std::async(runProcess, capL); //Main feature detector thread
-    std::thread t2(showIMG); //Display thread
+    long nextId{ 0 };
+    std::thread tDecode([&]() {
+        runStage(stDecode, qFree, qDecoded, [&](FrameJob& job) -> bool {
+            if (!capL.read(job.yuv)) { //Get video frame, in place after the 1st one
+                std::cout << "Capture read error" << std::endl;
+                return false;
+            }
+            job.id = nextId++;
+            return true;
+        });
+    });
+    std::thread tConvert([]() {
+        runStage(stConvert, qDecoded, qConverted, [](FrameJob& job) -> bool {
+            job.gray = job.yuv.rowRange(0, job.yuv.rows * 2 / 3); //I420: Y plane first, grayscale for the detector
+            cvtColor(job.yuv, job.bgr, COLOR_YUV2BGR_I420); //Convert to BGR to display later
+            return true;
+        });
+    });
+    std::thread tDetect([]() {
+        runStage(stDetect, qConverted, qDetected, [](FrameJob& job) -> bool {
+            if (trackMode)
+                fTracker(job.gray, job); //KLT + FAST where tracks are missing
+            else
+                fDetector(job.gray, job.kps); //Feature detector (FAST)
+            job.eps = session->thresholdStats();
+            return true;
+        });
+    });
+    std::thread tAnnotate([]() {
+        runStage(stAnnotate, qDetected, qAnnotated, [](FrameJob& job) -> bool {
+            job.bgr = processImg(job.bgr, job.kps.view(), fps, job.eps, trackMode ? job.ages.data() : nullptr); //Draw the feature point(s)on the img/vid
+            if (trackMode)
+                job.bgr = drawText(job.bgr, 30, 90, "New: " + std::to_string(job.klt.added) + ", lost: " + std::to_string(job.klt.lost));
+            return true;
+        });
+    });
+
+    showIMG(); //Until ESC or the end of the video
+
+    closeAll();
+    tDecode.join();
+    tConvert.join();
+    tDetect.join();
+    tAnnotate.join();
 
-    t2.join(); //Join to main thread
+    capL.release();
+    destroyAllWindows();
+    tracker.reset();
+    session.reset(); //Release the detector (& vilib's pyramid pool)
 
 
     return 0;